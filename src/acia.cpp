@@ -0,0 +1,210 @@
+#include "acia.h"
+#include <algorithm>
+
+namespace
+{
+	constexpr std::size_t STATE_SIZE = 13;
+
+	// a stuck output ring is looked at again after this many cycles at the earliest
+	constexpr std::uint64_t TX_RETRY_CYCLES = 64;
+
+	// the 6551 rates for CONTROL bits 3-0, 0 is the external clock
+	constexpr double BAUD_RATES[16] = {
+		0, 50, 75, 109.92, 134.58, 150, 300, 600, 1200, 1800, 2400, 3600, 4800, 7200, 9600, 19200,
+	};
+}
+
+Acia::Acia(Emulator &emulator, unsigned irq_source) : ClockedDevice(emulator), irq_source(irq_source) {}
+
+// the host thread has to be done with input() by now, or it could raise the line again
+Acia::~Acia()
+{
+	rx_irq.store(false, std::memory_order_relaxed);
+	emulator.interrupts.releaseIrq(irq_source);
+}
+
+std::size_t Acia::input(const Byte *data, std::size_t size)
+{
+	std::size_t pushed = rx.push(data, size);
+	if (pushed != 0 && rx_irq.load(std::memory_order_acquire))
+	{
+		emulator.interrupts.assertIrq(irq_source);
+	}
+	return pushed;
+}
+
+std::size_t Acia::output(Byte *data, std::size_t size)
+{
+	return tx.pop(data, size);
+}
+
+// a start bit, the data bits, parity and the stop bits; 1.5 stop bits count as 2
+std::uint64_t Acia::charCycles() const
+{
+	double baud = BAUD_RATES[control & BAUD_RATE];
+	if (baud == 0)
+	{
+		return 0;
+	}
+	unsigned bits = 1 + (8 - ((control & WORD_BITS) >> 5)) + ((command & PARITY_ENABLE) ? 1 : 0) + ((control & STOP_BITS) ? 2 : 1);
+	return std::uint64_t(emulator.pacer.clock_hz * bits / baud + 0.5);
+}
+
+void Acia::transmit(std::uint64_t cycle)
+{
+	if (!tdr_full || cycle < tx_start)
+	{
+		return;
+	}
+
+	if (tx.push(tdr))
+	{
+		tdr_full = false;
+		tx_free = tx_start + charCycles();
+		irq_pending |= txIrqEnabled();
+	}
+	else
+	{
+		// the host isn't keeping up, TDRE stays clear until it does
+		tx_start = cycle + std::max(charCycles(), TX_RETRY_CYCLES);
+	}
+}
+
+void Acia::receive()
+{
+	if (!rdr_full && (command & DTR) && rx.pop(rdr))
+	{
+		rdr_full = true;
+		irq_pending |= !(command & RX_IRQ_DISABLE);
+	}
+}
+
+void Acia::updateRxIrq()
+{
+	rx_irq.store((command & DTR) && !(command & RX_IRQ_DISABLE), std::memory_order_release);
+}
+
+void Acia::settle()
+{
+	transmit(now());
+
+	if (!irq_pending)
+	{
+		// input() may have raised the line after receive() last looked, so it is dropped first and
+		// the input looked at again after, or an IRQ could get lost in between
+		emulator.interrupts.releaseIrq(irq_source);
+		std::atomic_thread_fence(std::memory_order_acquire);
+		irq_asserted = false;
+		receive();
+	}
+
+	if (irq_pending && !irq_asserted)
+	{
+		emulator.interrupts.assertIrq(irq_source);
+		irq_asserted = true;
+	}
+
+	if (tdr_full)
+	{
+		wakeAt(tx_start);
+	}
+	else
+	{
+		sleep();
+	}
+}
+
+Byte Acia::readRegister(Word address)
+{
+	receive();
+
+	Byte value = 0;
+	switch (address & 0x03)
+	{
+	case DATA:
+		value = rdr;
+		rdr_full = false;
+		break;
+	case STATUS:
+		value = (rdr_full ? RDRF : 0) | (tdr_full ? 0 : TDRE) | (irq_pending ? IRQ : 0);
+		irq_pending = false;
+		break;
+	case COMMAND:
+		value = command;
+		break;
+	case CONTROL:
+		value = control;
+		break;
+	}
+
+	settle();
+	return value;
+}
+
+void Acia::writeRegister(Word address, Byte value)
+{
+	std::uint64_t cycle = now();
+
+	switch (address & 0x03)
+	{
+	case DATA:
+		// a byte still waiting in TDR is overwritten, as on the chip
+		tdr = value;
+		tdr_full = true;
+		tx_start = std::max(cycle, tx_free);
+		break;
+	case STATUS:
+		command &= 0xE0;
+		irq_pending = false;
+		break;
+	case COMMAND:
+		command = value;
+		break;
+	case CONTROL:
+		control = value;
+		break;
+	}
+
+	updateRxIrq();
+	settle();
+}
+
+// the rings are host I/O in flight and stay out of it, the times are stored as cycles to go
+void Acia::saveState(std::vector<Byte> &out) const
+{
+	std::uint64_t cycle = now();
+
+	std::size_t at = out.size();
+	out.resize(at + STATE_SIZE);
+	Byte *state = &out[at];
+	state[0] = command;
+	state[1] = control;
+	state[2] = rdr;
+	state[3] = tdr;
+	state[4] = rdr_full | (tdr_full << 1) | (irq_pending << 2);
+	putLittleEndian(state + 5, tx_start > cycle ? tx_start - cycle : 0, 4);
+	putLittleEndian(state + 9, tx_free > cycle ? tx_free - cycle : 0, 4);
+}
+
+bool Acia::loadState(const Byte *data, std::size_t size)
+{
+	if (size != STATE_SIZE)
+	{
+		return false;
+	}
+
+	std::uint64_t cycle = now();
+	command = data[0];
+	control = data[1];
+	rdr = data[2];
+	tdr = data[3];
+	rdr_full = data[4] & 1;
+	tdr_full = data[4] & 2;
+	irq_pending = data[4] & 4;
+	tx_start = cycle + getLittleEndian(data + 5, 4);
+	tx_free = cycle + getLittleEndian(data + 9, 4);
+
+	updateRxIrq();
+	settle();
+	return true;
+}
@@ -0,0 +1,105 @@
+#ifndef ACIA_H
+#define ACIA_H
+
+#include "types.h"
+#include "clocked_device.h"
+#include "spsc_ring.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/*
+ * A 6551 ACIA: data, status, command and control, 4 registers mirrored across the pages it is
+ * mapped on.
+ * The serial side is a pair of SpscRing: the guest fills output and drains input, one host
+ * thread (SerialPort, or the test) does the opposite through input() and output(). Neither side
+ * ever waits for the other. A full output ring leaves the byte in TDR with TDRE clear, which is
+ * exactly what a guest that polls TDRE or waits for the TX interrupt already copes with.
+ * Transmit is paced at the baud rate in CONTROL, in CPU cycles; the external clock (rate 0)
+ * sends instantly. Receive takes the next byte as soon as RDR is free, so the host decides the
+ * pace and overrun never happens.
+ * Receive interrupts are raised by the host thread itself, straight on emulator.interrupts, so
+ * a guest waiting in its IRQ loop hears about input without the CPU thread polling anything.
+ * Echo mode, parity checking and the modem lines are not modelled: DCD and DSR always read active.
+ */
+class Acia : public ClockedDevice
+{
+public:
+    // register select, the low 2 bits of the address
+    enum Register : Byte
+    {
+        DATA,
+        STATUS, // writing it is a programmed reset
+        COMMAND,
+        CONTROL,
+    };
+
+    /* STATUS bits */
+    constexpr static Byte PARITY_ERROR  = 0x01;
+    constexpr static Byte FRAMING_ERROR = 0x02;
+    constexpr static Byte OVERRUN       = 0x04;
+    constexpr static Byte RDRF          = 0x08; // receive data register full
+    constexpr static Byte TDRE          = 0x10; // transmit data register empty
+    constexpr static Byte DCD           = 0x20; // active low
+    constexpr static Byte DSR           = 0x40; // active low
+    constexpr static Byte IRQ           = 0x80; // cleared by reading STATUS
+
+    /* COMMAND bits */
+    constexpr static Byte DTR            = 0x01; // enables the receiver and all interrupts
+    constexpr static Byte RX_IRQ_DISABLE = 0x02;
+    constexpr static Byte TX_CONTROL     = 0x0C;
+    constexpr static Byte TX_IRQ         = 0x04; // TX_CONTROL value for interrupts on TDRE
+    constexpr static Byte PARITY_ENABLE  = 0x20;
+
+    /* CONTROL bits */
+    constexpr static Byte BAUD_RATE  = 0x0F; // 0 is the external clock
+    constexpr static Byte WORD_BITS  = 0x60; // 8, 7, 6 or 5 data bits
+    constexpr static Byte STOP_BITS  = 0x80;
+
+    using Ring = SpscRing<Byte, 4096>;
+
+    // raises IRQ source irq_source of emulator.interrupts
+    explicit Acia(Emulator &emulator, unsigned irq_source = 0);
+    ~Acia() override;
+
+    void saveState(std::vector<Byte> &out) const override;
+    bool loadState(const Byte *data, std::size_t size) override;
+
+    /* the host thread, one at a time, never the CPU thread */
+    std::size_t input(const Byte *data, std::size_t size); // towards the guest, returns how much fit
+    std::size_t output(Byte *data, std::size_t size);      // from the guest, returns how much there was
+    std::size_t inputSpace() const { return Ring::CAPACITY - rx.size(); }
+
+    std::uint64_t charCycles() const; // one character at the programmed rate and format
+
+protected:
+    Byte readRegister(Word address) override;
+    void writeRegister(Word address, Byte value) override;
+    void catchUp(std::uint64_t, std::uint64_t to) override { transmit(to); }
+    void deadline(std::uint64_t) override { settle(); }
+
+private:
+    void transmit(std::uint64_t cycle); // TDR into the shift register once it is free
+    void receive();                     // the next input byte into RDR once it is free
+    void settle();                      // the IRQ line and the deadline after anything changed
+    void updateRxIrq();
+
+    bool txIrqEnabled() const { return (command & DTR) && (command & TX_CONTROL) == TX_IRQ; }
+
+    unsigned irq_source;
+    bool irq_asserted = false;
+    std::atomic<bool> rx_irq{false}; // tells the host thread to raise IRQ with its input
+
+    Ring rx, tx;
+
+    Byte command = 0, control = 0;
+    Byte rdr = 0, tdr = 0;
+    bool rdr_full = false;
+    bool tdr_full = false;
+    bool irq_pending = false;
+    std::uint64_t tx_start = 0; // when TDR can go out: written, shift register free, room in the ring
+    std::uint64_t tx_free = 0;  // when the shift register is done with the last character
+};
+
+#endif // ACIA_H
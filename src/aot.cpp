@@ -0,0 +1,75 @@
+#include "aot.h"
+#include "mos6502.h"
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+namespace
+{
+	// a function so registering from other static initializers doesn't depend on their order
+	std::vector<const AotImage *> &linkedImages()
+	{
+		static std::vector<const AotImage *> images;
+		return images;
+	}
+}
+
+bool registerAotImage(const AotImage &image)
+{
+	linkedImages().push_back(&image);
+	return true;
+}
+
+const AotImage *findAotImage(const Byte *rom, std::size_t size, Word base)
+{
+	for (const AotImage *image : linkedImages())
+	{
+		if (image->base == base && image->rom_size == size && std::memcmp(image->rom, rom, size) == 0)
+		{
+			return image;
+		}
+	}
+	return nullptr;
+}
+
+void AotRuntime::attach(const AotImage &aot_image)
+{
+	image = &aot_image;
+	std::fill(std::begin(checked), std::end(checked), false);
+}
+
+void AotRuntime::verifyPage(Byte page, Memory &mem)
+{
+	mem.watch(page, Memory::WATCH_CODE); // its generation has to move when it is written
+	// the part of the page the image covers has to be unchanged, the rest can't hold translated code
+	std::size_t page_start = (std::size_t)page << 8;
+	std::size_t start = std::max(page_start, (std::size_t)image->base);
+	std::size_t end = std::min(page_start + 0x100, (std::size_t)image->base + image->rom_size);
+
+	const Byte *bytes = mem.read_pages[page];
+	matches[page] = start >= end || (bytes != nullptr && std::memcmp(bytes + (start - page_start), image->rom + (start - image->base), end - start) == 0);
+	verified_generation[page] = mem.page_generation[page];
+	checked[page] = true;
+}
+
+bool Emulator::runAot(const std::uint64_t &cycle_limit)
+{
+	while (cycles < cycle_limit)
+	{
+		// the image keeps running until it leaves the translated code or spends its budget
+		std::uint32_t budget = (std::uint32_t)std::min<std::uint64_t>(AotRuntime::BUDGET, cycle_limit - cycles);
+		std::uint32_t block_cycles = aot.run(cpu, mem, budget, !testing);
+		if (block_cycles != 0)
+		{
+			cycles += block_cycles;
+			continue;
+		}
+
+		// anything the tool couldn't see (computed jumps, RAM, patched code) and traps go through cycle()
+		if (!cycle())
+		{
+			return false;
+		}
+	}
+	return true;
+}
@@ -0,0 +1,79 @@
+#ifndef AOT_H
+#define AOT_H
+
+#include "types.h"
+#include "components.h"
+#include "opcodes.h"
+#include <cstddef>
+#include <cstdint>
+
+class AotRuntime;
+
+/* One basic block of a ROM, translated to C++ ahead of time by the aot tool */
+struct AotBlock
+{
+    Word pc;
+    Word end; // one past its last byte
+    std::uint32_t (*run)(MOS_6502 &cpu, Memory &mem); // returns the cycles taken, pc is left on the next instruction
+};
+
+/* Everything the aot tool generates for one ROM image */
+struct AotImage
+{
+    const char *name;
+    Word base;       // where the image is loaded
+    const Byte *rom; // the bytes the blocks were translated from
+    std::size_t rom_size;
+    const AotBlock *blocks; // sorted by pc
+    std::size_t block_count;
+
+    // runs blocks back to back until budget cycles are spent or pc leaves the translated code,
+    // a block starting with BRK isn't entered when trap_brk is set; returns the cycles taken
+    std::uint32_t (*run)(MOS_6502 &cpu, Memory &mem, AotRuntime &runtime, std::uint32_t budget, bool trap_brk);
+};
+
+// the images linked into a program register themselves at startup, findAotImage() looks them up
+bool registerAotImage(const AotImage &image);
+
+// the linked image translated from exactly size bytes of rom loaded at base, nullptr if none was
+const AotImage *findAotImage(const Byte *rom, std::size_t size, Word base);
+
+/*
+ * Runs the attached AotImage for Engine::AOT.
+ * A block only runs while the memory under it still holds the bytes it was translated from,
+ * each page is compared again whenever its write generation changes.
+ */
+class AotRuntime
+{
+public:
+    constexpr static std::uint32_t BUDGET = 1 << 20; // cycles per call when nothing needs to interrupt the image
+
+    void attach(const AotImage &image);
+    bool attached() const { return image != nullptr; }
+
+    // 0 if pc has to be interpreted
+    std::uint32_t run(MOS_6502 &cpu, Memory &mem, std::uint32_t budget, bool trap_brk)
+    {
+        return image == nullptr ? 0 : image->run(cpu, mem, *this, budget, trap_brk);
+    }
+
+    // called by the generated code before entering a block
+    bool pageMatches(Byte page, Memory &mem)
+    {
+        if (!checked[page] || verified_generation[page] != mem.page_generation[page])
+        {
+            verifyPage(page, mem);
+        }
+        return matches[page];
+    }
+
+private:
+    void verifyPage(Byte page, Memory &mem);
+
+    const AotImage *image = nullptr;
+    std::uint32_t verified_generation[0x100] = {};
+    bool checked[0x100] = {};
+    bool matches[0x100] = {};
+};
+
+#endif // AOT_H
@@ -0,0 +1,107 @@
+#include "recompiler.h"
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+
+/*
+ * Ahead-of-time recompiler: turns a ROM image into a C++ file to link next to EmulatorCore.
+ *
+ * usage: aot <rom.bin> <output.cpp> [--name NAME] [--base ADDR] [--entry ADDR]...
+ *
+ * The image is loaded at --base ($8000 by default). Discovery starts at the base, where the
+ * emulator starts executing, at the NMI/RESET/IRQ vectors and at every --entry.
+ */
+static void usage()
+{
+    std::cerr << "usage: aot <rom.bin> <output.cpp> [--name NAME] [--base ADDR] [--entry ADDR]..." << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 3)
+    {
+        usage();
+        return 1;
+    }
+
+    std::string input = argv[1];
+    std::string output = argv[2];
+    std::string name = "aot_rom";
+    Word base = Memory::ROM_START;
+    std::vector<Word> entries;
+
+    for (int i = 3; i < argc; ++i)
+    {
+        std::string option = argv[i];
+        if (i + 1 >= argc)
+        {
+            usage();
+            return 1;
+        }
+
+        std::string value = argv[++i];
+        if (option == "--name")
+        {
+            name = value;
+        }
+        else if (option == "--base")
+        {
+            base = (Word)std::strtoul(value.c_str(), nullptr, 0);
+        }
+        else if (option == "--entry")
+        {
+            entries.push_back((Word)std::strtoul(value.c_str(), nullptr, 0));
+        }
+        else
+        {
+            usage();
+            return 1;
+        }
+    }
+
+    std::ifstream infile(input, std::ios_base::binary);
+    if (!infile.is_open())
+    {
+        std::cerr << "Cannot open " << input << std::endl;
+        return 1;
+    }
+    std::vector<Byte> rom{std::istreambuf_iterator<char>(infile), std::istreambuf_iterator<char>()};
+    if (rom.empty() || base + rom.size() > WORD_MAX + 1)
+    {
+        std::cerr << input << " doesn't fit at $" << std::hex << base << std::endl;
+        return 1;
+    }
+
+    Recompiler recompiler(rom, base);
+    recompiler.addEntry(base);
+    recompiler.addVectorEntries();
+    for (Word entry : entries)
+    {
+        recompiler.addEntry(entry);
+    }
+    recompiler.discover();
+
+    if (recompiler.blocks().empty())
+    {
+        std::cerr << "No code found in " << input << std::endl;
+        return 1;
+    }
+
+    std::ofstream outfile(output);
+    outfile << recompiler.generate(name);
+    if (!outfile)
+    {
+        std::cerr << "Cannot write " << output << std::endl;
+        return 1;
+    }
+
+    std::size_t instructions = 0;
+    for (const auto &[pc, block] : recompiler.blocks())
+    {
+        instructions += block.instructions.size();
+    }
+    std::cout << name << ": " << recompiler.blocks().size() << " blocks, " << instructions << " instructions" << std::endl;
+    return 0;
+}
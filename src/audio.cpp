@@ -0,0 +1,320 @@
+#include "audio.h"
+#include <algorithm>
+#include <bit>
+
+namespace
+{
+	constexpr std::size_t STATE_SIZE = 8;
+
+	// four sources at full volume add up to full scale
+	constexpr float GAIN = 0.25f;
+
+	// WAV is little endian whatever the host is
+	void putLittle(std::FILE *file, std::uint32_t value, int bytes)
+	{
+		Byte field[4];
+		putLittleEndian(field, value, bytes);
+		std::fwrite(field, 1, bytes, file);
+	}
+
+	std::uint32_t phaseIncrement(double frequency, unsigned rate)
+	{
+		return std::uint32_t(std::min(frequency / rate * 4294967296.0, 4294967295.0));
+	}
+}
+
+Audio::Audio(Emulator &emulator, unsigned sample_rate, std::size_t block) : emulator(emulator), rate(sample_rate), block(block)
+{
+	mix.reserve(block);
+	pcm.reserve(block);
+	clock = std::uint64_t(emulator.pacer.clock_hz);
+	for (Byte reg = 0; reg < 8; ++reg)
+	{
+		apply(reg, registers[reg]);
+	}
+
+	// periodic and drift free, only pending while there is an output
+	event = emulator.scheduler.add([this](std::uint64_t deadline)
+	{
+		render();
+		this->emulator.scheduler.scheduleAt(event, deadline + block_cycles);
+	});
+}
+
+Audio::~Audio()
+{
+	closeWav();
+	stream(false);
+	emulator.scheduler.cancel(event);
+}
+
+Byte Audio::read(Word address)
+{
+	return registers[address & 7];
+}
+
+void Audio::write(Word address, Byte value)
+{
+	Byte reg = address & 7;
+	registers[reg] = value;
+	if (outputting())
+	{
+		log.push_back({emulator.cycles, reg, value});
+	}
+	else
+	{
+		apply(reg, value);
+	}
+}
+
+void Audio::apply(Byte reg, Byte value)
+{
+	voice[reg] = value;
+	switch (reg)
+	{
+	case DAC:
+		dac = (int(value) - 128) / 128.0f * GAIN;
+		break;
+	case SQUARE1_LOW:
+	case SQUARE1_HIGH:
+	case SQUARE1_VOLUME:
+		update(squares[0], Word(voice[SQUARE1_LOW] | (voice[SQUARE1_HIGH] << 8)), voice[SQUARE1_VOLUME]);
+		break;
+	case SQUARE2_LOW:
+	case SQUARE2_HIGH:
+	case SQUARE2_VOLUME:
+		update(squares[1], Word(voice[SQUARE2_LOW] | (voice[SQUARE2_HIGH] << 8)), voice[SQUARE2_VOLUME]);
+		break;
+	case NOISE:
+		noise_amplitude = (value & 0x0F) / 15.0f * GAIN;
+		noise_increment = phaseIncrement(double(clock) / (64.0 * ((value >> 4) + 1)), rate);
+		break;
+	}
+}
+
+void Audio::update(Square &square, Word period, Byte volume)
+{
+	square.increment = period != 0 ? phaseIncrement(double(clock) / (16.0 * period), rate) : 0;
+	square.amplitude = square.increment != 0 ? (volume & 0x0F) / 15.0f * GAIN : 0;
+}
+
+// one stretch without register writes. The square loops compute every sample from its index
+// alone, so nothing is carried from one iteration to the next and they vectorize
+void Audio::synthesize(float *out, std::size_t count)
+{
+	std::fill_n(out, count, dac);
+
+	for (Square &square : squares)
+	{
+		std::uint32_t phase = square.phase, increment = square.increment;
+		if (square.amplitude != 0)
+		{
+			float high = square.amplitude, low = -square.amplitude;
+			for (std::size_t i = 0; i < count; ++i)
+			{
+				out[i] += (std::uint32_t(phase + std::uint32_t(i) * increment) >> 31) ? low : high;
+			}
+		}
+		square.phase = phase + std::uint32_t(count) * increment;
+	}
+
+	if (noise_amplitude != 0)
+	{
+		// the shift register steps whenever the phase wraps, one sample depends on the last
+		std::uint32_t phase = noise_phase;
+		for (std::size_t i = 0; i < count; ++i)
+		{
+			std::uint32_t next = phase + noise_increment;
+			if (next < phase)
+			{
+				lfsr = std::uint16_t((lfsr >> 1) | (((lfsr ^ (lfsr >> 1)) & 1) << 14));
+			}
+			phase = next;
+			out[i] += (lfsr & 1) ? noise_amplitude : -noise_amplitude;
+		}
+		noise_phase = phase;
+	}
+}
+
+std::uint64_t Audio::sampleAt(std::uint64_t cycle) const
+{
+	return cycle <= origin ? 0 : ((cycle - origin) * rate + clock - 1) / clock;
+}
+
+void Audio::render()
+{
+	if (!outputting())
+	{
+		return;
+	}
+
+	std::uint64_t end = std::max(sampleAt(emulator.cycles), next_sample); // a restored snapshot doesn't take samples back
+	std::size_t count = std::size_t(end - next_sample);
+	mix.resize(count);
+
+	std::size_t done = 0;
+	for (const Write &logged : log)
+	{
+		std::size_t at = std::size_t(std::clamp(sampleAt(logged.cycle), next_sample, end) - next_sample);
+		at = std::max(at, done); // writes logged after a restore took the cycles back keep their order
+		synthesize(mix.data() + done, at - done);
+		done = at;
+		apply(logged.reg, logged.value);
+	}
+	synthesize(mix.data() + done, count - done);
+	log.clear();
+
+	emit(mix.data(), count);
+	next_sample = end;
+}
+
+void Audio::emit(const float *samples, std::size_t count)
+{
+	// the sources never add up past full scale, so there is nothing to clip
+	pcm.resize(count);
+	std::int16_t *out = pcm.data();
+	for (std::size_t i = 0; i < count; ++i)
+	{
+		out[i] = std::int16_t(samples[i] * 32767.0f);
+	}
+
+	if (wav != nullptr)
+	{
+		if constexpr (std::endian::native == std::endian::little)
+		{
+			std::fwrite(pcm.data(), sizeof(std::int16_t), count, wav);
+		}
+		else
+		{
+			for (std::int16_t sample : pcm)
+			{
+				putLittle(wav, std::uint16_t(sample), 2);
+			}
+		}
+		wav_samples += std::uint32_t(count);
+	}
+	if (streaming)
+	{
+		samples_dropped += count - ring.push(pcm.data(), count);
+	}
+	samples_rendered += count;
+}
+
+void Audio::start()
+{
+	clock = std::uint64_t(emulator.pacer.clock_hz);
+	origin = emulator.cycles;
+	next_sample = 0;
+	block_cycles = std::max<std::uint64_t>(1, block * clock / rate);
+	for (Byte reg = 0; reg < 8; ++reg)
+	{
+		apply(reg, registers[reg]); // in case the clock changed
+	}
+	emulator.scheduler.scheduleAt(event, origin + block_cycles);
+}
+
+void Audio::stop()
+{
+	emulator.scheduler.cancel(event);
+}
+
+// 16 bit mono PCM, the sizes are filled in by closeWav()
+bool Audio::openWav(const std::string &path)
+{
+	if (wav != nullptr)
+	{
+		return false;
+	}
+	std::FILE *file = std::fopen(path.c_str(), "wb");
+	if (file == nullptr)
+	{
+		return false;
+	}
+
+	std::fputs("RIFF", file);
+	putLittle(file, 0, 4);
+	std::fputs("WAVEfmt ", file);
+	putLittle(file, 16, 4);
+	putLittle(file, 1, 2); // PCM
+	putLittle(file, 1, 2); // mono
+	putLittle(file, rate, 4);
+	putLittle(file, rate * 2, 4);
+	putLittle(file, 2, 2);
+	putLittle(file, 16, 2);
+	std::fputs("data", file);
+	putLittle(file, 0, 4);
+
+	bool started = outputting();
+	wav = file;
+	wav_samples = 0;
+	if (!started)
+	{
+		start();
+	}
+	return true;
+}
+
+void Audio::closeWav()
+{
+	if (wav == nullptr)
+	{
+		return;
+	}
+	render();
+
+	std::uint32_t bytes = wav_samples * 2;
+	std::fseek(wav, 4, SEEK_SET);
+	putLittle(wav, 36 + bytes, 4);
+	std::fseek(wav, 40, SEEK_SET);
+	putLittle(wav, bytes, 4);
+	std::fclose(wav);
+	wav = nullptr;
+
+	if (!outputting())
+	{
+		stop();
+	}
+}
+
+void Audio::stream(bool enabled)
+{
+	if (enabled == streaming)
+	{
+		return;
+	}
+	render();
+	bool started = outputting();
+	streaming = enabled;
+	if (!started)
+	{
+		start();
+	}
+	else if (!outputting())
+	{
+		stop();
+	}
+}
+
+std::size_t Audio::readSamples(std::int16_t *out, std::size_t count)
+{
+	return ring.pop(out, count);
+}
+
+// the registers, the synthesizer picks them up from the current cycle on
+void Audio::saveState(std::vector<Byte> &out) const
+{
+	out.insert(out.end(), registers, registers + STATE_SIZE);
+}
+
+bool Audio::loadState(const Byte *data, std::size_t size)
+{
+	if (size != STATE_SIZE)
+	{
+		return false;
+	}
+	for (Byte reg = 0; reg < STATE_SIZE; ++reg)
+	{
+		write(reg, data[reg]);
+	}
+	return true;
+}
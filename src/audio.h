@@ -0,0 +1,123 @@
+#ifndef AUDIO_H
+#define AUDIO_H
+
+#include "types.h"
+#include "mos6502.h"
+#include "spsc_ring.h"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+/*
+ * Simple sound: an 8 bit DAC, two square wave channels and a noise channel, 8 registers mirrored
+ * across the pages it is mapped on.
+ * A register write only stores the value and, while there is an output, logs it with its cycle.
+ * Nothing is synthesized per instruction: a scheduler event every block of samples replays the
+ * log against the sample clock and renders the stretches between writes in tight loops over
+ * the whole stretch, which the compiler vectorizes (the noise shift register is the exception).
+ * The cost is a few writes to a log per guest write and a pass per output sample.
+ * Samples are 16 bit mono, into a WAV file and/or a ring a host audio thread drains; a full
+ * ring drops samples rather than holding anything up.
+ *
+ * square frequency = clock / (16 * period), period 0 is silent
+ * noise steps a 15 bit LFSR at clock / (64 * (rate + 1))
+ */
+class Audio : public Device
+{
+public:
+    // register select, the low 3 bits of the address
+    enum Register : Byte
+    {
+        DAC,            // unsigned, 128 is the middle
+        SQUARE1_LOW,    // period
+        SQUARE1_HIGH,
+        SQUARE1_VOLUME, // low 4 bits
+        SQUARE2_LOW,
+        SQUARE2_HIGH,
+        SQUARE2_VOLUME,
+        NOISE,          // volume in the low 4 bits, rate in the high 4
+    };
+
+    using SampleRing = SpscRing<std::int16_t, 16384>;
+
+    explicit Audio(Emulator &emulator, unsigned sample_rate = 44'100, std::size_t block = 1024);
+    ~Audio() override;
+
+    Audio(const Audio &) = delete;
+    Audio &operator=(const Audio &) = delete;
+
+    Byte read(Word address) override;
+    void write(Word address, Byte value) override;
+
+    void saveState(std::vector<Byte> &out) const override;
+    bool loadState(const Byte *data, std::size_t size) override;
+
+    /* output, from the current cycle on */
+    bool openWav(const std::string &path);
+    void closeWav();                      // renders what is left and finishes the header
+    void stream(bool enabled);            // samples go to the ring as well
+    void render();                        // everything up to the current cycle, the event does it every block
+    std::size_t readSamples(std::int16_t *out, std::size_t count); // the host audio thread
+
+    unsigned sampleRate() const { return rate; }
+
+    std::uint64_t samples_rendered = 0;
+    std::uint64_t samples_dropped = 0; // the ring was full
+
+private:
+    struct Write
+    {
+        std::uint64_t cycle;
+        Byte reg;
+        Byte value;
+    };
+
+    struct Square
+    {
+        std::uint32_t phase = 0;
+        std::uint32_t increment = 0; // per sample, 2^32 is a full wave
+        float amplitude = 0;
+    };
+
+    bool outputting() const { return wav != nullptr || streaming; }
+    void start(); // the sample clock begins at the current cycle
+    void stop();  // after the last render
+    void apply(Byte reg, Byte value); // a logged write reaches the synthesizer
+    void update(Square &square, Word period, Byte volume);
+    void synthesize(float *out, std::size_t count);
+    std::uint64_t sampleAt(std::uint64_t cycle) const; // the first sample at or after cycle
+    void emit(const float *mix, std::size_t count);
+
+    Emulator &emulator;
+    Scheduler::Event event;
+    unsigned rate;
+    std::size_t block;
+    std::uint64_t block_cycles = 0;
+
+    Byte registers[8] = {0x80};
+    std::vector<Write> log;
+
+    // the synthesizer, as of the last rendered sample
+    Byte voice[8] = {0x80}; // the registers it has seen
+    float dac = 0;
+    Square squares[2];
+    std::uint32_t noise_phase = 0, noise_increment = 0;
+    std::uint16_t lfsr = 1;
+    float noise_amplitude = 0;
+
+    std::uint64_t clock = 0;       // Hz, fixed while there is an output
+    std::uint64_t origin = 0;      // the cycle of sample 0
+    std::uint64_t next_sample = 0; // the first one not rendered yet
+    std::vector<float> mix;
+    std::vector<std::int16_t> pcm;
+
+    std::FILE *wav = nullptr;
+    std::uint32_t wav_samples = 0;
+    bool streaming = false;
+    SampleRing ring;
+};
+
+#endif // AUDIO_H
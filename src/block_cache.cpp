@@ -0,0 +1,171 @@
+#include "block_cache.h"
+#include "mos6502.h"
+
+Block *BlockCache::lookup(Word pc, Memory &mem, const Instruction *instruction_map)
+{
+	if (entries.empty())
+	{
+		entries.assign(WORD_MAX + 1, NO_BLOCK);
+	}
+
+	std::int32_t index = entries[pc];
+	Byte invalidations = 0;
+	if (index != NO_BLOCK)
+	{
+		if (!isStale(blocks[index], mem))
+		{
+			return &blocks[index];
+		}
+		invalidations = blocks[index].invalidations + (blocks[index].invalidations != 0xFF);
+	}
+
+	return decode(pc, mem, instruction_map, invalidations);
+}
+
+void BlockCache::clear()
+{
+	std::fill(entries.begin(), entries.end(), NO_BLOCK);
+	blocks.clear();
+	instructions.clear();
+}
+
+Block *BlockCache::decode(Word pc, Memory &mem, const Instruction *instruction_map, Byte invalidations)
+{
+	if (instructions.size() + max_block_length > MAX_INSTRUCTIONS)
+	{
+		clear();
+	}
+
+	Block block;
+	block.first = (std::uint32_t)instructions.size();
+	block.length = 0;
+	block.first_page = pc >> 8;
+	block.last_page = pc >> 8;
+	block.invalidations = invalidations;
+
+	Word address = pc;
+	while (block.length < max_block_length && !mem.isDevice(address >> 8))
+	{
+		Byte opcode = mem.peekByte(address);
+		const Instruction &instruction = instruction_map[opcode];
+
+		// halting opcodes never get decoded, BRK only runs as the first instruction
+		// so Emulator::runBlocks() gets to decide whether it traps
+		if ((instruction.flags & Instruction::HALT) ||
+			((instruction.flags & Instruction::TRAP) && block.length > 0))
+		{
+			break;
+		}
+
+		// reading code off a device could have side effects, cycle() runs it
+		if (mem.isDevice(Word(address + instruction.args_count - 1) >> 8))
+		{
+			break;
+		}
+
+		Word operand = mem.peekByte(Word(address + 1));
+		if (instruction.args_count == 3)
+		{
+			operand |= (Word)mem.peekByte(Word(address + 2)) << 8;
+		}
+
+		instructions.push_back({ops::DECODED_HANDLERS[opcode], operand, opcode, instruction.cycles});
+		block.length++;
+		block.last_page = Word(address + instruction.args_count - 1) >> 8;
+		address += instruction.args_count;
+
+		if (ops::ENDS_BLOCK[opcode])
+		{
+			break;
+		}
+	}
+
+	if (block.length == 0)
+	{
+		return nullptr;
+	}
+
+	// from now on every write to them has to move their generations
+	mem.watch(block.first_page, Memory::WATCH_CODE);
+	mem.watch(block.last_page, Memory::WATCH_CODE);
+	block.first_generation = mem.page_generation[block.first_page];
+	block.last_generation = mem.page_generation[block.last_page];
+
+	// a stale block at this pc is simply orphaned until the next flush
+	entries[pc] = (std::int32_t)blocks.size();
+	blocks.push_back(block);
+	return &blocks.back();
+}
+
+bool Emulator::runBlocks(const std::uint64_t &cycle_limit)
+{
+	while (cycles < cycle_limit)
+	{
+		if (!runBlock())
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+bool Emulator::runBlock()
+{
+	// translated code skips the page table on plain pages, so it can't outlive the layout it was compiled for
+	if (engine == Engine::JIT && jit.layout_generation != mem.layout_generation)
+	{
+		block_cache.clear();
+		jit.clear();
+		jit.layout_generation = mem.layout_generation;
+	}
+
+	// halting opcodes and code on device pages
+	Block *block = block_cache.lookup(cpu.program_counter, mem, instruction_map);
+	if (block == nullptr)
+	{
+		return cycle();
+	}
+
+	// BRK only ever starts a block
+	if (!testing && (instruction_map[block_cache.instructions[block->first].opcode].flags & Instruction::TRAP))
+	{
+		return false;
+	}
+
+	if (engine == Engine::JIT)
+	{
+		if (block->native == nullptr && block->executions++ == jit.hot_threshold &&
+			block->invalidations < Jit::MAX_INVALIDATIONS)
+		{
+			if (jit.full())
+			{
+				// every native block points into the arena, so they all go together
+				block_cache.clear();
+				jit.clear();
+				return true;
+			}
+			block->native = jit.compile(*block, cpu.program_counter, block_cache, instruction_map, mem);
+		}
+
+		if (block->native != nullptr)
+		{
+			cycles += block->native(&cpu, &mem);
+			return true;
+		}
+	}
+
+	const DecodedInstruction *instruction = &block_cache.instructions[block->first];
+	const DecodedInstruction *end = instruction + block->length;
+	for (; instruction != end; ++instruction)
+	{
+		Byte extra_cycles = instruction->handler(cpu, mem, instruction->operand);
+		cycles += instruction->cycles + extra_cycles;
+
+		// the block just overwrote its own code
+		if (block_cache.isStale(*block, mem))
+		{
+			break;
+		}
+	}
+	return true;
+}
@@ -0,0 +1,73 @@
+#ifndef BLOCK_CACHE_H
+#define BLOCK_CACHE_H
+
+#include "types.h"
+#include "components.h"
+#include "opcodes.h"
+#include <cstdint>
+#include <vector>
+
+struct Instruction;
+
+/* One instruction with its operand bytes already read out of memory */
+struct DecodedInstruction
+{
+    ops::DecodedHandler handler;
+    Word operand;
+    Byte opcode;
+    Byte cycles;
+};
+
+// a block translated to host code by the JIT, runs the whole block, leaves the next pc in cpu and returns its cycles
+using NativeBlock = std::uint32_t (*)(MOS_6502 *cpu, Memory *mem);
+
+/*
+ * A straight run of instructions starting at one PC and ending at the first branch,
+ * jump, subroutine call/return, interrupt or halting opcode.
+ * The code bytes live on at most two pages, and the block remembers both write
+ * generations so it can tell when the guest has modified them. Decoding watches
+ * both pages, writes to unwatched RAM don't move the generations.
+ */
+struct Block
+{
+    std::uint32_t first; // index into BlockCache::instructions
+    Byte length;
+    Byte first_page;
+    Byte last_page;
+    std::uint32_t first_generation;
+    std::uint32_t last_generation;
+
+    std::uint32_t executions = 0; // counted by Engine::JIT to find hot blocks
+    Byte invalidations = 0;       // how often the code at this pc was modified and decoded again
+    NativeBlock native = nullptr;
+};
+
+/* Predecoded basic blocks keyed by entry PC, used by Engine::BLOCK_CACHE */
+class BlockCache
+{
+public:
+    // nullptr if the instruction at pc halts the program or has to be read off a device
+    Block *lookup(Word pc, Memory &mem, const Instruction *instruction_map);
+    void clear();
+
+    bool isStale(const Block &block, const Memory &mem) const
+    {
+        return mem.page_generation[block.first_page] != block.first_generation ||
+               mem.page_generation[block.last_page] != block.last_generation;
+    }
+
+    std::vector<DecodedInstruction> instructions;
+    std::size_t max_block_length = MAX_BLOCK_LENGTH;
+
+    constexpr static std::size_t MAX_BLOCK_LENGTH = 32;
+    constexpr static std::size_t MAX_INSTRUCTIONS = 1 << 20; // flush everything once this many are decoded
+
+private:
+    Block *decode(Word pc, Memory &mem, const Instruction *instruction_map, Byte invalidations);
+
+    constexpr static std::int32_t NO_BLOCK = -1;
+    std::vector<std::int32_t> entries; // pc -> index into blocks, allocated on first use
+    std::vector<Block> blocks;
+};
+
+#endif // BLOCK_CACHE_H
@@ -0,0 +1,318 @@
+#include "block_device.h"
+#include "rom_image.h"
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+#if MOS6502_POSIX
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+	constexpr std::size_t STATE_SIZE = 8;
+	constexpr std::size_t UNIT = 256; // dirty tracking granularity, the smaller sector size
+}
+
+BlockDevice::BlockDevice(Emulator &emulator, unsigned irq_source) : emulator(emulator), irq_source(irq_source)
+{
+	// the CPU gets the bus back once the transfers are paid for
+	stall_event = emulator.scheduler.add([this](std::uint64_t)
+	{
+		this->emulator.cycles += stall;
+		stall = 0;
+		complete();
+	});
+	flush_event = emulator.scheduler.add([this](std::uint64_t) { flush(false); });
+}
+
+BlockDevice::~BlockDevice()
+{
+	close();
+	emulator.scheduler.cancel(stall_event);
+	emulator.scheduler.cancel(flush_event);
+	if (irq_asserted)
+	{
+		emulator.interrupts.releaseIrq(irq_source);
+	}
+}
+
+bool BlockDevice::open(const std::string &image_path)
+{
+	close();
+
+#if MOS6502_POSIX
+	if (!mapFile(image_path, PROT_READ | PROT_WRITE, image, length))
+	{
+		return false;
+	}
+	mapped = length;
+#else
+	std::ifstream input(image_path, std::ios_base::binary);
+	if (!input.is_open())
+	{
+		return false;
+	}
+	buffer.assign(std::istreambuf_iterator<char>(input), std::istreambuf_iterator<char>());
+	length = buffer.size();
+	image = buffer.data();
+#endif
+
+	path = image_path;
+	dirty.assign((length + UNIT * 64 - 1) / (UNIT * 64), 0);
+	return true;
+}
+
+void BlockDevice::close()
+{
+	flush(true);
+#if MOS6502_POSIX
+	if (mapped != 0)
+	{
+		munmap(image, mapped);
+	}
+#endif
+	image = nullptr;
+	length = 0;
+	mapped = 0;
+	buffer.clear();
+	path.clear();
+	dirty.clear();
+}
+
+std::size_t BlockDevice::dirtySectors() const
+{
+	std::size_t count = 0;
+	for (std::uint64_t word : dirty)
+	{
+		count += std::popcount(word);
+	}
+	return count;
+}
+
+void BlockDevice::markDirty(std::size_t offset, std::size_t size)
+{
+	for (std::size_t unit = offset / UNIT; unit <= (offset + size - 1) / UNIT; ++unit)
+	{
+		dirty[unit >> 6] |= std::uint64_t(1) << (unit & 63);
+	}
+	if (!emulator.scheduler.pending(flush_event))
+	{
+		emulator.scheduler.scheduleIn(flush_event, flush_cycles);
+	}
+}
+
+// each run of dirty units is one call, runs that meet on a host page are merged first
+void BlockDevice::flush(bool wait)
+{
+	emulator.scheduler.cancel(flush_event);
+
+#if MOS6502_POSIX
+	std::size_t host_page = std::size_t(sysconf(_SC_PAGESIZE));
+	auto sync = [&](std::size_t start, std::size_t end)
+	{
+		msync(image + start, end - start, wait ? MS_SYNC : MS_ASYNC);
+		syncs++;
+	};
+#else
+	(void)wait; // write backs finish before they return
+	std::ofstream output;
+	auto sync = [&](std::size_t start, std::size_t end)
+	{
+		if (!output.is_open())
+		{
+			output.open(path, std::ios_base::binary | std::ios_base::in | std::ios_base::out);
+		}
+		output.seekp(std::streamoff(start));
+		output.write(reinterpret_cast<const char *>(image + start), std::streamsize(end - start));
+		syncs++;
+	};
+	std::size_t host_page = 1;
+#endif
+
+	std::size_t run_start = 0, run_end = 0;
+	for (std::size_t word = 0; word < dirty.size(); ++word)
+	{
+		for (std::uint64_t bits = dirty[word]; bits != 0; bits &= bits - 1)
+		{
+			std::size_t unit = word * 64 + std::countr_zero(bits);
+			std::size_t start = unit * UNIT / host_page * host_page;
+			std::size_t end = std::min((unit + 1) * UNIT, length);
+			if (run_end != 0 && start <= run_end)
+			{
+				run_end = std::max(run_end, end);
+				continue;
+			}
+			if (run_end != 0)
+			{
+				sync(run_start, run_end);
+			}
+			run_start = start;
+			run_end = end;
+		}
+		dirty[word] = 0;
+	}
+	if (run_end != 0)
+	{
+		sync(run_start, run_end);
+	}
+}
+
+bool BlockDevice::transfer(bool to_memory, std::size_t offset, Word address, std::size_t size)
+{
+	if (image == nullptr || offset + size > length || address + size > 0x10000)
+	{
+		return false;
+	}
+
+	Memory &mem = emulator.mem;
+	bool plain = true;
+	for (std::size_t page = address >> 8; page <= (address + size - 1) >> 8; ++page)
+	{
+		if (to_memory && mem.copy_on_write[page])
+		{
+			mem.unshare(Byte(page)); // the first write would, all of it is about to be written
+		}
+		plain &= to_memory ? mem.isPlain(Byte(page)) : mem.direct_read[page];
+	}
+
+	if (to_memory && plain)
+	{
+		std::memcpy(mem.memory + address, image + offset, size);
+		mem.noteWrites(address, size);
+	}
+	else if (to_memory)
+	{
+		for (std::size_t i = 0; i < size; ++i)
+		{
+			mem.writeByte(Word(address + i), image[offset + i]);
+		}
+	}
+	else
+	{
+		if (plain)
+		{
+			std::memcpy(image + offset, mem.memory + address, size);
+		}
+		else
+		{
+			for (std::size_t i = 0; i < size; ++i)
+			{
+				image[offset + i] = mem.readByte(Word(address + i));
+			}
+		}
+		markDirty(offset, size);
+	}
+
+	bytes_transferred += size;
+	return true;
+}
+
+void BlockDevice::execute(Byte command)
+{
+	std::size_t sector = registers[SECTOR_LOW] | (registers[SECTOR_MIDDLE] << 8) | (registers[SECTOR_HIGH] << 16);
+	std::size_t count = registers[COUNT] != 0 ? registers[COUNT] : 256;
+	std::size_t size = count * sectorSize();
+	Word address = Word(registers[ADDRESS_LOW] | (registers[ADDRESS_HIGH] << 8));
+
+	bool ok = false;
+	stall += SETUP_CYCLES;
+	switch (command)
+	{
+	case READ:
+	case WRITE:
+		ok = transfer(command == READ, sector * sectorSize(), address, size);
+		stall += ok ? size : 0;
+		break;
+	case FLUSH:
+		ok = image != nullptr;
+		flush(true);
+		break;
+	}
+
+	status = (status & ~(ERROR | IRQ)) | BUSY | (ok ? 0 : ERROR);
+	settle();
+	emulator.scheduler.scheduleAt(stall_event, emulator.cycles);
+}
+
+void BlockDevice::complete()
+{
+	status = (status & ~BUSY) | IRQ;
+	settle();
+}
+
+void BlockDevice::settle()
+{
+	bool irq = (status & IRQ) && (control & IRQ_ENABLE);
+	if (irq != irq_asserted)
+	{
+		irq_asserted = irq;
+		if (irq)
+		{
+			emulator.interrupts.assertIrq(irq_source);
+		}
+		else
+		{
+			emulator.interrupts.releaseIrq(irq_source);
+		}
+	}
+}
+
+Byte BlockDevice::read(Word address)
+{
+	switch (address & 7)
+	{
+	case COMMAND:
+	{
+		Byte value = status | (image != nullptr ? READY : 0);
+		status &= ~IRQ;
+		settle();
+		return value;
+	}
+	case CONTROL:
+		return control;
+	default:
+		return registers[address & 7];
+	}
+}
+
+void BlockDevice::write(Word address, Byte value)
+{
+	switch (address & 7)
+	{
+	case COMMAND:
+		execute(value);
+		break;
+	case CONTROL:
+		control = value;
+		settle();
+		break;
+	default:
+		registers[address & 7] = value;
+		break;
+	}
+}
+
+// the registers, a command in flight counts as completed. The image is the disk, not machine state
+void BlockDevice::saveState(std::vector<Byte> &out) const
+{
+	out.insert(out.end(), registers, registers + COMMAND);
+	out.push_back(control);
+	out.push_back((status & BUSY) ? Byte((status & ~BUSY) | IRQ) : status);
+}
+
+bool BlockDevice::loadState(const Byte *data, std::size_t size)
+{
+	if (size != STATE_SIZE)
+	{
+		return false;
+	}
+	std::copy(data, data + COMMAND, registers);
+	control = data[COMMAND];
+	status = data[COMMAND + 1];
+	settle();
+	return true;
+}
@@ -0,0 +1,107 @@
+#ifndef BLOCK_DEVICE_H
+#define BLOCK_DEVICE_H
+
+#include "types.h"
+#include "mos6502.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+ * A block storage controller on a host disk image, 8 registers mirrored across the pages it is
+ * mapped on.
+ * The image is mapped shared and read/write, and a command moves its sectors by DMA: one
+ * memcpy between the mapping and memory[] when every page on the way is plain RAM, the bus
+ * byte by byte otherwise (ROM drops the bytes, devices see them). Nothing is buffered in between.
+ * The CPU is held off the bus for the transfer, a cycle per byte: a scheduler event adds the
+ * stall to the cycle counter as soon as the engine stops for it, and the command only completes,
+ * raising IRQ if enabled, once it has been paid.
+ * Written sectors are only marked; msync() writes them back in as few calls as the dirty runs
+ * allow, asynchronously every flush_cycles and synchronously for FLUSH and on close.
+ * Without mmap the image is read into a buffer and the dirty sectors are written back instead.
+ */
+class BlockDevice : public Device
+{
+public:
+    // register select, the low 3 bits of the address
+    enum Register : Byte
+    {
+        SECTOR_LOW,
+        SECTOR_MIDDLE,
+        SECTOR_HIGH,
+        ADDRESS_LOW, // where in guest memory the transfer starts
+        ADDRESS_HIGH,
+        COUNT,       // sectors, 0 is 256
+        COMMAND,     // STATUS when read
+        CONTROL,
+    };
+
+    /* COMMAND values */
+    constexpr static Byte READ  = 0x01; // image to memory
+    constexpr static Byte WRITE = 0x02; // memory to image
+    constexpr static Byte FLUSH = 0x03; // everything written so far to the host disk
+
+    /* STATUS bits */
+    constexpr static Byte ERROR = 0x01; // no image, the sectors are past its end or the memory past $FFFF
+    constexpr static Byte READY = 0x08; // an image is attached
+    constexpr static Byte BUSY  = 0x40; // the transfer holds the bus
+    constexpr static Byte IRQ   = 0x80; // the last command completed, cleared by reading STATUS
+
+    /* CONTROL bits */
+    constexpr static Byte IRQ_ENABLE = 0x01;
+    constexpr static Byte SECTOR_512 = 0x02; // 256 byte sectors otherwise
+
+    constexpr static std::uint64_t SETUP_CYCLES = 8; // per command, then a cycle per byte
+
+    // raises IRQ source irq_source of emulator.interrupts
+    explicit BlockDevice(Emulator &emulator, unsigned irq_source = 0);
+    ~BlockDevice() override;
+
+    BlockDevice(const BlockDevice &) = delete;
+    BlockDevice &operator=(const BlockDevice &) = delete;
+
+    bool open(const std::string &path); // the image keeps its size, sectors past the end are an ERROR
+    void close();                       // flushes
+    void flush(bool wait = true);       // the dirty sectors to the host disk
+
+    Byte read(Word address) override;
+    void write(Word address, Byte value) override;
+
+    void saveState(std::vector<Byte> &out) const override;
+    bool loadState(const Byte *data, std::size_t size) override;
+
+    std::size_t sectorSize() const { return (control & SECTOR_512) ? 512 : 256; }
+    std::size_t imageSize() const { return length; }
+    std::size_t dirtySectors() const; // in 256 byte units
+
+    std::uint64_t flush_cycles = 1'000'000;
+    std::uint64_t bytes_transferred = 0;
+    std::uint64_t syncs = 0; // msync() calls, or write backs without mmap
+
+private:
+    void execute(Byte command);
+    bool transfer(bool to_memory, std::size_t offset, Word address, std::size_t size);
+    void markDirty(std::size_t offset, std::size_t size);
+    void complete(); // the stall is over
+    void settle();   // the IRQ line
+
+    Emulator &emulator;
+    Scheduler::Event stall_event, flush_event;
+    unsigned irq_source;
+    bool irq_asserted = false;
+
+    Byte registers[COMMAND] = {}; // the ones that read back what was written
+    Byte control = 0;
+    Byte status = 0;
+    std::uint64_t stall = 0; // cycles the bus still owes the last commands
+
+    Byte *image = nullptr;
+    std::size_t length = 0;
+    std::size_t mapped = 0;           // bytes to munmap, 0 when the image lives in buffer
+    std::vector<Byte> buffer;         // systems without mmap
+    std::string path;
+    std::vector<std::uint64_t> dirty; // a bit per 256 bytes of the image
+};
+
+#endif // BLOCK_DEVICE_H
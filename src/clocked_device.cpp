@@ -0,0 +1,50 @@
+#include "clocked_device.h"
+
+ClockedDevice::ClockedDevice(Emulator &emulator) : emulator(emulator), synced(emulator.cycles)
+{
+	event = emulator.scheduler.add([this](std::uint64_t cycle)
+	{
+		sync();
+		deadline(cycle);
+	});
+}
+
+ClockedDevice::~ClockedDevice()
+{
+	emulator.scheduler.cancel(event);
+}
+
+Byte ClockedDevice::read(Word address)
+{
+	sync();
+	return readRegister(address);
+}
+
+void ClockedDevice::write(Word address, Byte value)
+{
+	sync();
+	writeRegister(address, value);
+}
+
+void ClockedDevice::sync()
+{
+	std::uint64_t cycle = now();
+	if (cycle > synced)
+	{
+		catchUp(synced, cycle);
+	}
+	synced = cycle;
+}
+
+void ClockedDevice::wakeAt(std::uint64_t cycle)
+{
+	if (!emulator.scheduler.pending(event) || emulator.scheduler.deadline(event) != cycle)
+	{
+		emulator.scheduler.scheduleAt(event, cycle);
+	}
+}
+
+void ClockedDevice::sleep()
+{
+	emulator.scheduler.cancel(event);
+}
@@ -0,0 +1,49 @@
+#ifndef CLOCKED_DEVICE_H
+#define CLOCKED_DEVICE_H
+
+#include "types.h"
+#include "mos6502.h"
+#include <cstdint>
+
+/*
+ * A device with a notion of time, run lazily instead of in lockstep with the CPU.
+ * It remembers the cycle it has run to and only catches up when it has to: right before the
+ * guest reads or writes one of its registers, and when a deadline it asked for with wakeAt()
+ * comes up. catchUp() gets the whole stretch since the last time in one call, so the work is
+ * one bulk loop (or a closed form) rather than a step per cycle.
+ * The CPU cycle it catches up to is exact on TABLE, THREADED, BLOCK_CACHE and in the batch
+ * functions; JIT and AOT code that calls out to a device reports the cycle its block started on.
+ */
+class ClockedDevice : public Device
+{
+public:
+    explicit ClockedDevice(Emulator &emulator);
+    ~ClockedDevice() override;
+
+    // sync() and then the register access
+    Byte read(Word address) final;
+    void write(Word address, Byte value) final;
+
+    void sync(); // runs the device up to the current cycle
+    std::uint64_t syncedTo() const { return synced; }
+
+protected:
+    virtual Byte readRegister(Word address) = 0;
+    virtual void writeRegister(Word address, Byte value) = 0;
+
+    // [from, to) has passed since the last call. Time going backwards (a restored snapshot) never gets here
+    virtual void catchUp(std::uint64_t from, std::uint64_t to) = 0;
+    virtual void deadline(std::uint64_t) {} // the device has just been synced for its wakeAt() deadline
+
+    void wakeAt(std::uint64_t cycle); // replaces the last deadline
+    void sleep();                     // drops it
+    std::uint64_t now() const { return emulator.cycles; }
+
+    Emulator &emulator;
+
+private:
+    Scheduler::Event event;
+    std::uint64_t synced;
+};
+
+#endif // CLOCKED_DEVICE_H
@@ -1,6 +1,14 @@
+#ifndef COMPONENTS_H
+#define COMPONENTS_H
+
 #include "types.h"
 #include "cstddef"
+#include <array>
+#include <bit>
+#include <cstring>
+#include <memory>
 #include <sstream>
+#include <vector>
 #include <iomanip>
 
 struct MOS_6502 
@@ -13,7 +21,7 @@ struct MOS_6502
         lhs.X               == rhs.X &&
         lhs.Y               == rhs.Y &&
         lhs.S               == rhs.S &&
-        lhs.P               == rhs.P;
+        lhs.P()             == rhs.P();
     }
 
     std::string to_string() const
@@ -25,7 +33,7 @@ struct MOS_6502
             << "X: $"  << std::setw(2) << static_cast<int>(X)           << "  "
             << "Y: $"  << std::setw(2) << static_cast<int>(Y)           << "  "
             << "S: $"  << std::setw(2) << static_cast<int>(S)           << "  "
-            << "P: $"  << std::setw(2) << static_cast<int>(P);
+            << "P: $"  << std::setw(2) << static_cast<int>(P());
         return oss.str();
     }
 
@@ -46,8 +54,31 @@ struct MOS_6502
     /* Stack pointer starts at 0xFD for some 6502 specific things*/
     Byte S = 0xFD;
 
-    /* For processor state */
-    Byte P = P_UNUSED;
+    /* For processor state, builds the P register from the lazy flags below (this used to be a public P field) */
+    Byte P() const
+    {
+        return status | (negative_result & P_NEGATIVE) | ((overflow_result >> 1) & P_OVERFLOW) |
+               (zero_result == 0 ? P_ZERO : 0) | carry_result;
+    }
+
+    void setP(Byte value)
+    {
+        status = value & ~(P_NEGATIVE | P_OVERFLOW | P_ZERO | P_CARRY);
+        negative_result = value;
+        overflow_result = value << 1;
+        zero_result = ~value & P_ZERO;
+        carry_result = value & P_CARRY;
+    }
+
+    /*
+     * Instructions only record where N/Z/C/V come from, P() puts them together when something
+     * actually reads the status (branches, PHP, BRK, the public API).
+     */
+    Byte status = P_UNUSED;   // every bit of P except N, Z, C and V
+    Byte negative_result = 0; // N is its bit 7
+    Byte zero_result = 1;     // Z is set when it is 0
+    Byte carry_result = 0;    // C, always 0 or 1
+    Byte overflow_result = 0; // V is its bit 7
 
     /* Bit fields for the P register */
     constexpr static Byte P_NEGATIVE    =  0b10000000;
@@ -62,11 +93,95 @@ struct MOS_6502
 };
 
 
-/* Struct to handle addressing and memory stuff */
+// one page of guest memory frozen by a snapshot, shared by every snapshot and machine that still has it unchanged
+using SharedPage = std::shared_ptr<const std::array<Byte, 0x100>>;
+
+/* Memory mapped hardware, sees every read and write to the pages it is mapped on */
+class Device
+{
+public:
+    virtual ~Device() = default;
+
+    // address is the full bus address, not an offset into the device
+    virtual Byte read(Word address) = 0;
+    virtual void write(Word address, Byte value) = 0;
+
+    // for save states, a device without state appends nothing and accepts nothing
+    virtual void saveState(std::vector<Byte> &) const {}
+    virtual bool loadState(const Byte *, std::size_t size) { return size == 0; }
+};
+
+// the little-endian fields of save states, bytes long and starting at at
+inline void putLittleEndian(Byte *at, std::uint64_t value, int bytes)
+{
+    for (int i = 0; i < bytes; ++i)
+    {
+        at[i] = Byte(value >> (8 * i));
+    }
+}
+
+inline std::uint64_t getLittleEndian(const Byte *at, int bytes)
+{
+    std::uint64_t value = 0;
+    for (int i = 0; i < bytes; ++i)
+    {
+        value |= std::uint64_t(at[i]) << (8 * i);
+    }
+    return value;
+}
+
+/*
+ * The memory bus, split into 256 pages.
+ * A page either points at host memory for RAM and ROM or belongs to a Device that gets called
+ * for each access. Every page starts out on memory[] itself, those direct pages are read and
+ * written inline without touching the page table at all.
+ * Reads and writes are mapped separately: ROM has no write pointer and drops writes, a page
+ * can also read host memory and send its writes to a device (the registers of a Mapper).
+ * Pages restored from a snapshot read the shared copy until the first write clones it back
+ * into memory[], memory[] itself is stale for them until then.
+ */
 struct Memory
 {
     Byte memory[WORD_MAX + 1];
-    bool did_write = false; // used in test suite
+    // bumped on writes to watched pages and whenever a page changes under the bus, so predecoded
+    // code and snapshots can tell when a page went stale. Unwatched pages keep theirs
+    std::uint32_t page_generation[0x100] = {};
+
+    // one bit per page and per 64 byte line written since the last clearDirty(), only while track_dirty is set
+    std::uint64_t dirty_pages[0x100 / 64] = {};
+    std::uint64_t dirty_lines[0x10000 / 64 / 64] = {};
+    bool track_dirty = false;
+
+    /* Why writes to a page have to do more than the store, see watch() */
+    constexpr static Byte WATCH_CODE = 1;   // code was decoded or translated from it
+    constexpr static Byte WATCH_SHARED = 2; // memory[] still matches the snapshot copy, until the first write
+    constexpr static Byte WATCH_DIRTY = 4;  // track_dirty
+    Byte watched[0x100] = {};
+
+    // the page table, a nullptr sends the access to the page's device, or drops a write without one
+    const Byte *read_pages[0x100];
+    Byte *write_pages[0x100];
+    Device *devices[0x100] = {};
+
+    // the page points at its own part of memory[]. Testing this instead of loading the pointer
+    // keeps the page table off the critical path of every RAM access
+    bool direct_read[0x100] = {};
+    bool direct_write[0x100] = {};
+    // direct and not watched: a write is the bare store, nothing else to keep up to date
+    bool bare_write[0x100] = {};
+
+    // bumped whenever a page stops being direct, so translated code can tell its layout is gone
+    std::uint32_t layout_generation = 0;
+
+    // the last snapshot copy of each page, still current while the page generation hasn't moved
+    SharedPage shared_pages[0x100];
+    std::uint32_t shared_generation[0x100] = {};
+    bool copy_on_write[0x100] = {}; // reads go to shared_pages, the first write clones it
+
+    // the page table entry of the last instruction fetch
+    unsigned fetch_page = NO_FETCH_PAGE;
+    const Byte *fetch_base = nullptr;
+    constexpr static unsigned NO_FETCH_PAGE = 0x100;
 
     Memory()
     {
@@ -74,16 +189,377 @@ struct Memory
        {
             memory[i] = 0xFE; // to terminate the program asap for testing
        } 
+       mapMemory(0x00, 0x100);
+       clearDirty();
+    }
+
+    // the page table points into this object
+    Memory(const Memory &) = delete;
+    Memory &operator=(const Memory &) = delete;
+
+    FORCE_INLINE Byte readByte(Word address)
+    {
+        if (direct_read[address >> 8]) [[likely]]
+        {
+            return memory[address];
+        }
+        return readPage(address);
+    }
+
+    FORCE_INLINE void writeByte(Word address, Byte value)
+    {
+        if (bare_write[address >> 8]) [[likely]]
+        {
+            memory[address] = value;
+            return;
+        }
+        writePage(address, value);
+    }
+
+    // read-modify-write instructions write the unmodified value back before the result, devices see both
+    FORCE_INLINE void modifyByte(Word address, Byte old_value, Byte value)
+    {
+        if (bare_write[address >> 8]) [[likely]]
+        {
+            memory[address] = value;
+            return;
+        }
+        if (devices[address >> 8] != nullptr)
+        {
+            writePage(address, old_value);
+        }
+        writePage(address, value);
+    }
+
+    // everything but bare pages, kept out of line so the RAM path stays small enough to inline everywhere
+    [[gnu::noinline]] Byte readPage(Word address)
+    {
+        const Byte *page = read_pages[address >> 8];
+        if (page != nullptr)
+        {
+            return page[address & 0xFF];
+        }
+        return devices[address >> 8]->read(address);
+    }
+
+    [[gnu::noinline]] void writePage(Word address, Byte value)
+    {
+        Byte *page = write_pages[address >> 8];
+        if (page != nullptr)
+        {
+            page[address & 0xFF] = value;
+            noteWrite(address);
+            return;
+        }
+        if (copy_on_write[address >> 8])
+        {
+            unshare(address >> 8);
+            memory[address] = value;
+            noteWrite(address);
+            return;
+        }
+        if (devices[address >> 8] != nullptr)
+        {
+            devices[address >> 8]->write(address, value);
+        }
+    }
+
+    // opcode and operand bytes, instructions mostly run on from the page the last one was fetched from
+    FORCE_INLINE Byte fetchByte(Word address)
+    {
+        if ((address >> 8) == fetch_page) [[likely]]
+        {
+            return fetch_base[address & 0xFF];
+        }
+        return fetchPage(address);
+    }
+
+    [[gnu::noinline]] Byte fetchPage(Word address)
+    {
+        const Byte *page = read_pages[address >> 8];
+        if (page == nullptr)
+        {
+            return devices[address >> 8]->read(address); // never cached, every fetch has to reach the device
+        }
+        fetch_page = address >> 8;
+        fetch_base = page;
+        return page[address & 0xFF];
+    }
+
+    // reads without side effects for decoders and debuggers, device pages read as 0
+    Byte peekByte(Word address) const
+    {
+        const Byte *page = read_pages[address >> 8];
+        return page != nullptr ? page[address & 0xFF] : 0;
+    }
+
+    // the bookkeeping of a write that didn't go through writeByte(), or to a page that isn't bare
+    void noteWrite(Word address)
+    {
+        notePage(address >> 8);
+        if (track_dirty)
+        {
+            dirty_lines[address >> 12] |= std::uint64_t(1) << ((address >> 6) & 63);
+        }
+    }
+
+    // a block of memory[] written in one go (DMA), address + size may not run past $FFFF
+    void noteWrites(Word address, std::size_t size)
+    {
+        std::size_t last = address + size - 1;
+        for (std::size_t page = address >> 8; page <= last >> 8; ++page)
+        {
+            notePage(Byte(page));
+        }
+        for (std::size_t line = address >> 6; track_dirty && line <= last >> 6; ++line)
+        {
+            dirty_lines[line >> 6] |= std::uint64_t(1) << (line & 63);
+        }
+    }
+
+    // noteWrite() without the line
+    void notePage(Byte page)
+    {
+        page_generation[page]++;
+        if (watched[page] & WATCH_SHARED)
+        {
+            unwatch(page, WATCH_SHARED); // the generation has moved away from the snapshot's for good
+        }
+        if (track_dirty)
+        {
+            dirty_pages[page >> 6] |= std::uint64_t(1) << (page & 63);
+        }
+    }
+
+    /*
+     * A write to a bare page is just the store. A page is watched while something depends on
+     * seeing its writes: decoded code on it, a snapshot sharing it or dirty tracking. Its
+     * writes then leave the inline path and keep the generation and dirty bits up to date.
+     */
+    void watch(Byte page, Byte reasons)
+    {
+        watched[page] |= reasons;
+        bare_write[page] = false;
     }
 
-    Byte readByte(Word address) { return *(memory + address); } 
-    void writeByte(Word address, Byte value) { *(memory + address) = value; };
+    void unwatch(Byte page, Byte reasons)
+    {
+        watched[page] &= ~reasons;
+        bare_write[page] = direct_write[page] && watched[page] == 0;
+    }
+
+    // dirty bits are only kept while this is on, they cost every RAM write a trip through writePage()
+    void trackDirty(bool enabled)
+    {
+        track_dirty = enabled;
+        for (std::size_t page = 0; page < 0x100; ++page)
+        {
+            enabled ? watch(Byte(page), WATCH_DIRTY) : unwatch(Byte(page), WATCH_DIRTY);
+        }
+    }
+
+    /* Dirty tracking, the scans go a 64 bit word at a time and skip clean words entirely */
+    bool isDirty(Byte page) const { return (dirty_pages[page >> 6] >> (page & 63)) & 1; }
+    bool isLineDirty(Word address) const { return (dirty_lines[address >> 12] >> ((address >> 6) & 63)) & 1; }
+
+    // callback(page) for every dirty page in ascending order
+    template<typename Callback>
+    void forEachDirtyPage(Callback callback) const
+    {
+        forEachBit(dirty_pages, callback);
+    }
 
-    void stackPushByte(Byte& stack_register, Byte value); 
-    void stackPushWord(Byte& stack_register, Word value); 
+    // callback(address) with the first address of every dirty 64 byte line
+    template<typename Callback>
+    void forEachDirtyLine(Callback callback) const
+    {
+        forEachBit(dirty_lines, [&](std::size_t line) { callback(Word(line << 6)); });
+    }
+
+    std::size_t dirtyPageCount() const
+    {
+        std::size_t count = 0;
+        for (std::uint64_t word : dirty_pages)
+        {
+            count += std::popcount(word);
+        }
+        return count;
+    }
+
+    void clearDirty()
+    {
+        std::memset(dirty_pages, 0, sizeof(dirty_pages));
+        std::memset(dirty_lines, 0, sizeof(dirty_lines));
+    }
 
-    Byte stackPullByte(Byte& stack_register);
-    Word stackPullWord(Byte& stack_register);
+    void clearDirty(Byte page)
+    {
+        dirty_pages[page >> 6] &= ~(std::uint64_t(1) << (page & 63));
+        dirty_lines[page >> 4] &= ~(std::uint64_t(0xF) << ((page & 15) * 4));
+    }
+
+    template<std::size_t Words, typename Callback>
+    static void forEachBit(const std::uint64_t (&words)[Words], Callback callback)
+    {
+        for (std::size_t word = 0; word < Words; ++word)
+        {
+            for (std::uint64_t bits = words[word]; bits != 0; bits &= bits - 1)
+            {
+                callback(word * 64 + std::countr_zero(bits));
+            }
+        }
+    }
+
+    // reads of the page have to go through its device
+    bool isDevice(Byte page) const { return read_pages[page] == nullptr; }
+
+    // translated code may access the page in memory[] without going through the bus
+    bool isPlain(Byte page) const { return direct_read[page] && direct_write[page]; }
+
+    void mapDevice(Byte first_page, std::size_t pages, Device &device)
+    {
+        for (std::size_t page = first_page; page < first_page + pages && page < 0x100; ++page)
+        {
+            setPage(Byte(page), nullptr, nullptr, &device);
+        }
+    }
+
+    // back to memory[]
+    void mapMemory(Byte first_page, std::size_t pages)
+    {
+        for (std::size_t page = first_page; page < first_page + pages && page < 0x100; ++page)
+        {
+            setPage(Byte(page), memory + (page << 8), memory + (page << 8), nullptr);
+        }
+    }
+
+    // read-only pages on the image, which has to outlive the mapping
+    void mapROM(Byte first_page, std::size_t pages, const Byte *image)
+    {
+        for (std::size_t page = first_page; page < first_page + pages && page < 0x100; ++page)
+        {
+            setPage(Byte(page), image + ((page - first_page) << 8), nullptr, nullptr);
+        }
+    }
+
+    // keeps reading memory[] but drops every write
+    void protect(Byte first_page, std::size_t pages)
+    {
+        for (std::size_t page = first_page; page < first_page + pages && page < 0x100; ++page)
+        {
+            setPage(Byte(page), memory + (page << 8), nullptr, nullptr);
+        }
+    }
+
+    // the bytes behind the page changed without a write, so anything decoded from it goes stale
+    void setPage(Byte page, const Byte *read, Byte *write, Device *device)
+    {
+        bool read_direct = read == memory + (page << 8);
+        bool write_direct = write == memory + (page << 8);
+        if ((direct_read[page] && !read_direct) || (direct_write[page] && !write_direct))
+        {
+            layout_generation++; // code that skipped the bus for this page has to go, gaining a direct page is harmless
+        }
+        if (copy_on_write[page])
+        {
+            // whatever the page is mapped to next, memory[] holds its contents again
+            std::memcpy(memory + (page << 8), shared_pages[page]->data(), 0x100);
+            copy_on_write[page] = false;
+        }
+        read_pages[page] = read;
+        write_pages[page] = write;
+        devices[page] = device;
+        fetch_page = NO_FETCH_PAGE;
+        direct_read[page] = read_direct;
+        direct_write[page] = write_direct;
+        unwatch(page, 0);
+        notePage(page); // what the page reads has changed, all of it
+        if (track_dirty)
+        {
+            dirty_lines[page >> 4] |= std::uint64_t(0xF) << ((page & 15) * 4);
+        }
+    }
+
+    /*
+     * Snapshots. Pages written since the last snapshot are copied, all the others are shared with it.
+     * Shared pages are watched, so their first write moves the generation away from the snapshot's.
+     * Writes that bypass the bus (memory[] in tests) have to noteWrite() or they won't be seen.
+     * Only memory[] is saved, pages on ROM images and devices keep whatever they are mapped to.
+     */
+    std::array<SharedPage, 0x100> snapshot()
+    {
+        std::size_t dirty = 0;
+        for (std::size_t page = 0; page < 0x100; ++page)
+        {
+            dirty += !isShared(Byte(page));
+        }
+
+        // one allocation for all of them
+        auto copies = std::make_shared<std::array<Byte, 0x100>[]>(dirty);
+        std::size_t next = 0;
+        std::array<SharedPage, 0x100> pages;
+        for (std::size_t page = 0; page < 0x100; ++page)
+        {
+            if (!isShared(Byte(page)))
+            {
+                std::memcpy(copies[next].data(), memory + (page << 8), 0x100);
+                shared_pages[page] = SharedPage(copies, &copies[next++]);
+                shared_generation[page] = page_generation[page];
+                watch(Byte(page), WATCH_SHARED);
+            }
+            pages[page] = shared_pages[page];
+        }
+        return pages;
+    }
+
+    // plain pages start sharing the snapshot's copy, anything else gets it copied into memory[]
+    void restore(const std::array<SharedPage, 0x100> &pages)
+    {
+        for (std::size_t page = 0; page < 0x100; ++page)
+        {
+            if (pages[page] == shared_pages[page] && isShared(Byte(page)))
+            {
+                continue; // nothing changed since
+            }
+
+            if (copy_on_write[page] || isPlain(Byte(page)))
+            {
+                copy_on_write[page] = false; // memory[] is stale either way
+                shared_pages[page] = pages[page];
+                setPage(Byte(page), pages[page]->data(), nullptr, nullptr);
+                copy_on_write[page] = true;
+            }
+            else
+            {
+                shared_pages[page] = pages[page];
+                std::memcpy(memory + (page << 8), pages[page]->data(), 0x100);
+                noteWrite(Word(page << 8));
+                shared_generation[page] = page_generation[page];
+                watch(Byte(page), WATCH_SHARED);
+            }
+        }
+    }
+
+    // back to a plain page with its own copy in memory[]
+    void unshare(Byte page)
+    {
+        setPage(page, memory + (page << 8), memory + (page << 8), nullptr);
+        shared_generation[page] = page_generation[page];
+        watch(page, WATCH_SHARED);
+    }
+
+    // the page still holds exactly what shared_pages has
+    bool isShared(Byte page) const
+    {
+        return copy_on_write[page] || (shared_pages[page] != nullptr && shared_generation[page] == page_generation[page]);
+    }
+
+    // the stack helpers are inline so the interpreters can keep the stack pointer in a register
+    inline void stackPushByte(Byte& stack_register, Byte value); 
+    inline void stackPushWord(Byte& stack_register, Word value); 
+
+    inline Byte stackPullByte(Byte& stack_register);
+    inline Word stackPullWord(Byte& stack_register);
 
     // useful locations - zero page is the fastest memory
     constexpr static size_t ZERO_PAGE_MAX = 0x00FF;
@@ -93,6 +569,42 @@ struct Memory
     constexpr static size_t RAM_END = 0x7FFF; // 32KB RAM
     constexpr static size_t ROM_START = 0x8000; 
     constexpr static size_t ROM_END = 0x10000; // 32KB + 1B ROM 
-    constexpr static size_t BRK_INT = 0xFFFE; 
+    constexpr static size_t NMI_INT = 0xFFFA;
+    constexpr static size_t NMI_INT_HI = 0xFFFB;
+    constexpr static size_t RESET_INT = 0xFFFC;
+    constexpr static size_t RESET_INT_HI = 0xFFFD;
+    constexpr static size_t BRK_INT = 0xFFFE; // shared with IRQ
     constexpr static size_t BRK_INT_HI = 0xFFFF;
-};
\ No newline at end of file
+};
+
+// apparently the stack grows right to left
+inline void Memory::stackPushByte(Byte &stack_register, Byte value)
+{
+    writeByte(STACK_BASE + stack_register, value);
+    stack_register--;
+}
+
+// grows downward
+inline Byte Memory::stackPullByte(Byte &stack_register)
+{
+    ++stack_register;
+    Byte value = readByte(STACK_BASE + stack_register);
+    return value;
+}
+
+inline void Memory::stackPushWord(Byte &stack_register, Word value)
+{
+    Byte lower_byte = (Byte)(value & 0xFF);
+    Byte higher_byte = (Byte)(value >> 8);
+    stackPushByte(stack_register, higher_byte); // push high byte second (on lower address)
+    stackPushByte(stack_register, lower_byte);  // push low byte first (on higher address)
+}
+
+inline Word Memory::stackPullWord(Byte &stack_register)
+{
+    Byte lower_byte = stackPullByte(stack_register);  // pulled later = was pushed first
+    Byte higher_byte = stackPullByte(stack_register); // pulled first = was pushed second
+    return (Word)lower_byte | (((Word)higher_byte) << 8);
+}
+
+#endif // COMPONENTS_H
@@ -0,0 +1,354 @@
+#include "framebuffer.h"
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+#if MOS6502_POSIX
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+	constexpr auto IDLE = std::chrono::milliseconds(1);
+}
+
+Framebuffer::Framebuffer(Emulator &emulator, unsigned width, unsigned height, double frame_rate)
+	: emulator(emulator), columns(width), rows(height), tiles_x((width + TILE - 1) / TILE), tiles_y((height + TILE - 1) / TILE)
+{
+	screen.assign((size() + 0xFF) & ~std::size_t(0xFF), 0);
+	dirty.assign((tileCount() + 63) / 64, 0);
+	frame_cycles = std::max<std::uint64_t>(1, std::uint64_t(emulator.pacer.clock_hz / frame_rate));
+
+	for (unsigned i = 0; i < 256; ++i)
+	{
+		std::uint32_t r = ((i >> 5) & 7) * 255 / 7, g = ((i >> 2) & 7) * 255 / 7, b = (i & 3) * 255 / 3;
+		palette[i] = (r << 16) | (g << 8) | b;
+	}
+
+	for (Frame &slot : slots)
+	{
+		slot.pixels.assign(size(), 0);
+		slot.tiles.reserve(tileCount());
+		spare.push(&slot);
+	}
+
+	// periodic and drift free, only pending while output runs
+	event = emulator.scheduler.add([this](std::uint64_t deadline)
+	{
+		frame_number++;
+		present(false);
+		this->emulator.scheduler.scheduleAt(event, deadline + frame_cycles);
+	});
+}
+
+Framebuffer::~Framebuffer()
+{
+	stop();
+	emulator.scheduler.cancel(event);
+}
+
+void Framebuffer::map(Byte first_page)
+{
+	base = Word(first_page << 8);
+	for (std::size_t page = 0; page < screen.size() >> 8 && first_page + page < 0x100; ++page)
+	{
+		emulator.mem.setPage(Byte(first_page + page), screen.data() + (page << 8), nullptr, this);
+	}
+}
+
+Byte Framebuffer::read(Word address)
+{
+	Word offset = Word(address - base);
+	return offset < screen.size() ? screen[offset] : 0;
+}
+
+void Framebuffer::write(Word address, Byte value)
+{
+	Word offset = Word(address - base);
+	if (offset >= size())
+	{
+		return;
+	}
+	screen[offset] = value;
+
+	unsigned y = offset / columns, x = offset - y * columns;
+	std::size_t tile = (y / TILE) * tiles_x + x / TILE;
+	dirty[tile >> 6] |= std::uint64_t(1) << (tile & 63);
+}
+
+void Framebuffer::markAll()
+{
+	std::fill(dirty.begin(), dirty.end(), ~std::uint64_t(0));
+	if (tileCount() & 63)
+	{
+		dirty.back() = (std::uint64_t(1) << (tileCount() & 63)) - 1;
+	}
+}
+
+void Framebuffer::present(bool wait)
+{
+	if (std::all_of(dirty.begin(), dirty.end(), [](std::uint64_t word) { return word == 0; }))
+	{
+		return;
+	}
+
+	Frame *frame;
+	while (!spare.pop(frame))
+	{
+		if (!wait)
+		{
+			frames_skipped++; // the tiles stay dirty for the next frame
+			return;
+		}
+		std::this_thread::yield();
+	}
+
+	frame->number = frame_number;
+	frame->tiles.clear();
+	for (std::size_t word = 0; word < dirty.size(); ++word)
+	{
+		for (std::uint64_t bits = dirty[word]; bits != 0; bits &= bits - 1)
+		{
+			std::size_t tile = word * 64 + std::countr_zero(bits);
+			frame->tiles.push_back(std::uint32_t(tile));
+
+			std::size_t x = (tile % tiles_x) * TILE, y = (tile / tiles_x) * TILE;
+			std::size_t span = std::min<std::size_t>(TILE, columns - x);
+			for (std::size_t row = y; row < std::min<std::size_t>(y + TILE, rows); ++row)
+			{
+				std::memcpy(&frame->pixels[row * columns + x], &screen[row * columns + x], span);
+			}
+		}
+		dirty[word] = 0;
+	}
+
+	ready.push(frame);
+	frames_presented++;
+}
+
+void Framebuffer::convert(const Frame &frame, Byte *rgb) const
+{
+	for (std::uint32_t tile : frame.tiles)
+	{
+		std::size_t x = (tile % tiles_x) * TILE, y = (tile / tiles_x) * TILE;
+		std::size_t end_x = std::min<std::size_t>(x + TILE, columns), end_y = std::min<std::size_t>(y + TILE, rows);
+		for (std::size_t row = y; row < end_y; ++row)
+		{
+			for (std::size_t offset = row * columns + x; offset < row * columns + end_x; ++offset)
+			{
+				std::uint32_t colour = palette[frame.pixels[offset]];
+				rgb[offset * 3] = Byte(colour >> 16);
+				rgb[offset * 3 + 1] = Byte(colour >> 8);
+				rgb[offset * 3 + 2] = Byte(colour);
+			}
+		}
+	}
+}
+
+bool Framebuffer::writePpm(const Frame &frame, const std::vector<Byte> &rgb) const
+{
+	std::string number = std::to_string(unsigned(frame.number));
+	std::string path = path_head;
+	path.append(number.size() < number_width ? number_width - number.size() : 0, number_fill);
+	path += number;
+	path += path_tail;
+	std::FILE *file = std::fopen(path.c_str(), "wb");
+	if (file == nullptr)
+	{
+		return false;
+	}
+	std::fprintf(file, "P6\n%u %u\n255\n", columns, rows);
+	bool written = std::fwrite(rgb.data(), 1, rgb.size(), file) == rgb.size();
+	return std::fclose(file) == 0 && written;
+}
+
+void Framebuffer::encode()
+{
+	std::vector<Byte> rgb(shared != nullptr ? 0 : size() * 3); // the whole picture, for PPM
+	auto *header = reinterpret_cast<SharedHeader *>(shared);
+
+	while (true)
+	{
+		bool stopping = !running.load(std::memory_order_acquire); // anything pushed before is in ready now
+		Frame *frame;
+		if (!ready.pop(frame))
+		{
+			if (stopping)
+			{
+				return;
+			}
+			std::this_thread::sleep_for(IDLE);
+			continue;
+		}
+
+		if (header != nullptr)
+		{
+			std::atomic_ref<std::uint32_t> sequence(header->sequence);
+			sequence.fetch_add(1, std::memory_order_acq_rel);
+			convert(*frame, shared + sizeof(SharedHeader));
+			header->frame = frame->number;
+			sequence.fetch_add(1, std::memory_order_release);
+		}
+		else
+		{
+			convert(*frame, rgb.data());
+			writePpm(*frame, rgb);
+		}
+
+		frames_encoded.fetch_add(1, std::memory_order_release);
+		spare.push(frame);
+	}
+}
+
+bool Framebuffer::start()
+{
+	// the first frame is the whole screen
+	markAll();
+	running.store(true, std::memory_order_release);
+	encoder = std::thread(&Framebuffer::encode, this);
+	emulator.scheduler.scheduleAt(event, emulator.cycles + frame_cycles);
+	return true;
+}
+
+bool Framebuffer::startPpm(const std::string &path_pattern)
+{
+	if (running.load(std::memory_order_relaxed))
+	{
+		return false;
+	}
+
+	// the pattern is never handed to printf, anything but %%, %u, %d and their widths is refused
+	std::string head, tail;
+	unsigned width = 0;
+	char fill = ' ';
+	bool numbered = false;
+	for (std::size_t i = 0; i < path_pattern.size(); i++)
+	{
+		std::string &out = numbered ? tail : head;
+		if (path_pattern[i] != '%')
+		{
+			out += path_pattern[i];
+			continue;
+		}
+		if (++i < path_pattern.size() && path_pattern[i] == '%')
+		{
+			out += '%';
+			continue;
+		}
+		if (numbered)
+		{
+			return false;
+		}
+		if (i < path_pattern.size() && path_pattern[i] == '0')
+		{
+			fill = '0';
+		}
+		for (; i < path_pattern.size() && path_pattern[i] >= '0' && path_pattern[i] <= '9'; i++)
+		{
+			width = width * 10 + unsigned(path_pattern[i] - '0');
+			if (width > 20)
+			{
+				return false;
+			}
+		}
+		if (i >= path_pattern.size() || (path_pattern[i] != 'u' && path_pattern[i] != 'd'))
+		{
+			return false;
+		}
+		numbered = true;
+	}
+	if (!numbered)
+	{
+		return false;
+	}
+
+	path_head = head;
+	path_tail = tail;
+	number_width = width;
+	number_fill = fill;
+	return start();
+}
+
+#if MOS6502_POSIX
+
+bool Framebuffer::startShared(const std::string &path)
+{
+	if (running.load(std::memory_order_relaxed))
+	{
+		return false;
+	}
+	int fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+	if (fd < 0)
+	{
+		return false;
+	}
+	std::size_t length = sizeof(SharedHeader) + size() * 3;
+	void *mapping = ::ftruncate(fd, off_t(length)) == 0 ? ::mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+	::close(fd);
+	if (mapping == MAP_FAILED)
+	{
+		return false;
+	}
+
+	shared = static_cast<Byte *>(mapping);
+	shared_size = length;
+	auto *header = reinterpret_cast<SharedHeader *>(shared);
+	std::memcpy(header->magic, "MOSF", 4);
+	header->width = columns;
+	header->height = rows;
+	header->frame = 0;
+	std::atomic_ref<std::uint32_t>(header->sequence).store(0, std::memory_order_release);
+	return start();
+}
+
+#else
+
+bool Framebuffer::startShared(const std::string &)
+{
+	return false;
+}
+
+#endif
+
+void Framebuffer::stop()
+{
+	if (!running.load(std::memory_order_relaxed))
+	{
+		return;
+	}
+	emulator.scheduler.cancel(event);
+	frame_number++;
+	present(true);
+	running.store(false, std::memory_order_release);
+	encoder.join();
+
+#if MOS6502_POSIX
+	if (shared != nullptr)
+	{
+		::munmap(shared, shared_size);
+	}
+#endif
+	shared = nullptr;
+	shared_size = 0;
+}
+
+// just the pixels, the output isn't part of the machine
+void Framebuffer::saveState(std::vector<Byte> &out) const
+{
+	out.insert(out.end(), screen.begin(), screen.begin() + size());
+}
+
+bool Framebuffer::loadState(const Byte *data, std::size_t length)
+{
+	if (length != size())
+	{
+		return false;
+	}
+	std::copy(data, data + length, screen.begin());
+	markAll();
+	return true;
+}
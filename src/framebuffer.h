@@ -0,0 +1,116 @@
+#ifndef FRAMEBUFFER_H
+#define FRAMEBUFFER_H
+
+#include "types.h"
+#include "mos6502.h"
+#include "spsc_ring.h"
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+ * Screen memory: width x height pixels of one byte each, a palette index, row after row from
+ * the first mapped address.
+ * Guest reads come straight out of the pixel buffer through the page table; writes go through
+ * write(), which stores the pixel and sets the bit of its 8x8 tile.
+ * Once output is started, a scheduler event at the frame rate (in emulated time) copies the
+ * dirty tiles into a free frame slot and hands it to an encoder thread over an SpscRing. If the
+ * encoder still holds every slot, that frame is skipped and its tiles go with the next one,
+ * so the CPU thread never waits for it. The encoder only converts the tiles that changed:
+ * into a PPM file per changed frame, or in place into a raw RGB buffer in a shared mapping.
+ */
+class Framebuffer : public Device
+{
+public:
+    constexpr static unsigned TILE = 8;
+
+    // the layout of a shared mapping, RGB triplets row after row follow the header
+    struct SharedHeader
+    {
+        char magic[4]; // "MOSF"
+        std::uint32_t width, height;
+        std::uint32_t sequence; // odd while tiles are being written, atomic_ref on both sides
+        std::uint64_t frame;    // the number of the last frame written
+    };
+
+    Framebuffer(Emulator &emulator, unsigned width, unsigned height, double frame_rate = 60);
+    ~Framebuffer() override;
+
+    Framebuffer(const Framebuffer &) = delete;
+    Framebuffer &operator=(const Framebuffer &) = delete;
+
+    // reads go to the pixels, writes through write(). Pages past the screen read 0 and drop writes
+    void map(Byte first_page);
+
+    Byte read(Word address) override;
+    void write(Word address, Byte value) override;
+
+    void saveState(std::vector<Byte> &out) const override;
+    bool loadState(const Byte *data, std::size_t size) override;
+
+    /* output on a thread of its own, from the next frame on; one at a time */
+    bool startPpm(const std::string &pattern); // one %u or %d for the frame number, maybe %0Nu: "frames/%06u.ppm"
+    bool startShared(const std::string &path); // a SharedHeader and the RGB image in a file mapping
+    void stop();                               // hands over the last frame, waits for the encoder to finish
+
+    unsigned width() const { return columns; }
+    unsigned height() const { return rows; }
+    std::size_t size() const { return std::size_t(columns) * rows; }
+    const Byte *pixels() const { return screen.data(); }
+
+    std::size_t tileCount() const { return tiles_x * tiles_y; }
+    bool isTileDirty(std::size_t tile) const { return (dirty[tile >> 6] >> (tile & 63)) & 1; }
+
+    std::array<std::uint32_t, 256> palette; // 0xRRGGBB, RGB 3-3-2 by default. Fixed once output runs
+
+    std::uint64_t frames_presented = 0; // handed to the encoder
+    std::uint64_t frames_skipped = 0;   // had changes, but no slot was free
+    std::atomic<std::uint64_t> frames_encoded{0};
+
+private:
+    struct Frame
+    {
+        std::uint64_t number = 0;
+        std::vector<std::uint32_t> tiles; // the tiles that changed
+        std::vector<Byte> pixels;         // a whole screen, only those tiles are current
+    };
+    constexpr static std::size_t SLOTS = 3;
+    using FrameRing = SpscRing<Frame *, 4>;
+
+    bool start();
+    void present(bool wait); // the dirty tiles into a free slot, if there is one
+    void encode();           // the encoder thread
+    void convert(const Frame &frame, Byte *rgb) const; // the frame's tiles, palette to RGB
+    bool writePpm(const Frame &frame, const std::vector<Byte> &rgb) const;
+    void markAll();
+
+    Emulator &emulator;
+    Scheduler::Event event;
+    std::uint64_t frame_cycles;
+    std::uint64_t frame_number = 0;
+
+    unsigned columns, rows;
+    std::size_t tiles_x, tiles_y;
+    Word base = 0;
+    std::vector<Byte> screen;         // whole pages, the tail past size() stays 0
+    std::vector<std::uint64_t> dirty; // a bit per tile, set by write()
+
+    // slots cycle CPU thread -> ready -> encoder -> spare -> CPU thread
+    std::array<Frame, SLOTS> slots;
+    FrameRing ready, spare;
+    std::thread encoder;
+    std::atomic<bool> running{false};
+
+    // the PPM path pattern split around its frame number, which is padded to number_width
+    std::string path_head, path_tail;
+    unsigned number_width = 0;
+    char number_fill = ' ';
+    Byte *shared = nullptr; // the mapping, nullptr for PPM output
+    std::size_t shared_size = 0;
+};
+
+#endif // FRAMEBUFFER_H
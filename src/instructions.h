@@ -0,0 +1,241 @@
+#ifndef INSTRUCTIONS_H
+#define INSTRUCTIONS_H
+
+#include "types.h"
+#include "opcodes.h"
+#include <array>
+#include <type_traits>
+
+// decode metadata for one opcode, the handler itself lives in ops::HANDLERS
+struct Instruction
+{
+  const char *name;
+  Byte opcode;
+  Byte args_count;
+  Byte cycles;
+  AddressMode addressing_mode;
+  Byte flags = 0;
+
+  /* Bit fields for flags */
+  constexpr static Byte HALT = 0b00000001; // stop execution (DONE and unknown opcodes)
+  constexpr static Byte TRAP = 0b00000010; // BRK, stops execution outside of the test suite
+};
+
+static_assert(std::is_trivially_copyable_v<Instruction>, "the decode table must stay cheap to read");
+
+constexpr std::array<Instruction, 0x100> makeInstructionTable()
+{
+  std::array<Instruction, 0x100> t{};
+  for (auto &i : t)
+  {
+    i = {"DONE", 0x02, 1, 1, AddressMode::IMPLICIT, Instruction::HALT}; // unknown opcodes terminate the program
+  }
+
+  t[0x70] = {"BVS", 0x70, 2, 2, AddressMode::RELATIVE};
+  t[0x00] = {"BRK", 0x00, 1, 7, AddressMode::IMPLICIT, Instruction::TRAP};
+  t[0xC9] = {"CMP", 0xC9, 2, 2, AddressMode::IMMEDIATE};
+  t[0xC5] = {"CMP", 0xC5, 2, 3, AddressMode::ZERO_PAGE};
+  t[0xD5] = {"CMP", 0xD5, 2, 4, AddressMode::ZERO_PAGE_AND_X};
+  t[0xCD] = {"CMP", 0xCD, 3, 4, AddressMode::ABSOLUTE};
+  t[0xDD] = {"CMP", 0xDD, 3, 4, AddressMode::ABSOLUTE_AND_X};
+  t[0xD9] = {"CMP", 0xD9, 3, 4, AddressMode::ABSOLUTE_AND_Y};
+  t[0xC1] = {"CMP", 0xC1, 2, 6, AddressMode::INDEXED_INDIRECT};
+  t[0xD1] = {"CMP", 0xD1, 2, 5, AddressMode::INDIRECT_INDEXED};
+  t[0xE0] = {"CPX", 0xE0, 2, 2, AddressMode::IMMEDIATE};
+  t[0xE4] = {"CPX", 0xE4, 2, 3, AddressMode::ZERO_PAGE};
+  t[0xEC] = {"CPX", 0xEC, 3, 4, AddressMode::ABSOLUTE};
+  t[0xC0] = {"CPY", 0xC0, 2, 2, AddressMode::IMMEDIATE};
+  t[0xC4] = {"CPY", 0xC4, 2, 3, AddressMode::ZERO_PAGE};
+  t[0xCC] = {"CPY", 0xCC, 3, 4, AddressMode::ABSOLUTE};
+  t[0xCA] = {"DEX", 0xCA, 1, 2, AddressMode::IMPLICIT};
+  t[0x88] = {"DEY", 0x88, 1, 2, AddressMode::IMPLICIT};
+  t[0x49] = {"EOR", 0x49, 2, 2, AddressMode::IMMEDIATE};
+  t[0x45] = {"EOR", 0x45, 2, 3, AddressMode::ZERO_PAGE};
+  t[0x55] = {"EOR", 0x55, 2, 4, AddressMode::ZERO_PAGE_AND_X};
+  t[0x4D] = {"EOR", 0x4D, 3, 4, AddressMode::ABSOLUTE};
+  t[0x5D] = {"EOR", 0x5D, 3, 4, AddressMode::ABSOLUTE_AND_X};
+  t[0x59] = {"EOR", 0x59, 3, 4, AddressMode::ABSOLUTE_AND_Y};
+  t[0x41] = {"EOR", 0x41, 2, 6, AddressMode::INDEXED_INDIRECT};
+  t[0x51] = {"EOR", 0x51, 2, 5, AddressMode::INDIRECT_INDEXED};
+  t[0xE8] = {"INX", 0xE8, 1, 2, AddressMode::IMPLICIT};
+  t[0xC8] = {"INY", 0xC8, 1, 2, AddressMode::IMPLICIT};
+  t[0x4C] = {"JMP", 0x4C, 3, 3, AddressMode::ABSOLUTE};
+  t[0x6C] = {"JMP", 0x6C, 3, 5, AddressMode::INDIRECT};
+  t[0x20] = {"JSR", 0x20, 3, 6, AddressMode::ABSOLUTE};
+  t[0xA9] = {"LDA", 0xA9, 2, 2, AddressMode::IMMEDIATE};
+  t[0xA5] = {"LDA", 0xA5, 2, 3, AddressMode::ZERO_PAGE};
+  t[0xB5] = {"LDA", 0xB5, 2, 4, AddressMode::ZERO_PAGE_AND_X};
+  t[0xAD] = {"LDA", 0xAD, 3, 4, AddressMode::ABSOLUTE};
+  t[0xBD] = {"LDA", 0xBD, 3, 4, AddressMode::ABSOLUTE_AND_X};
+  t[0xB9] = {"LDA", 0xB9, 3, 4, AddressMode::ABSOLUTE_AND_Y};
+  t[0xA1] = {"LDA", 0xA1, 2, 6, AddressMode::INDEXED_INDIRECT};
+  t[0xB1] = {"LDA", 0xB1, 2, 5, AddressMode::INDIRECT_INDEXED};
+  t[0xA2] = {"LDX", 0xA2, 2, 2, AddressMode::IMMEDIATE};
+  t[0xA6] = {"LDX", 0xA6, 2, 3, AddressMode::ZERO_PAGE};
+  t[0xB6] = {"LDX", 0xB6, 2, 4, AddressMode::ZERO_PAGE_AND_Y};
+  t[0xAE] = {"LDX", 0xAE, 3, 4, AddressMode::ABSOLUTE};
+  t[0xBE] = {"LDX", 0xBE, 3, 4, AddressMode::ABSOLUTE_AND_Y};
+  t[0xA0] = {"LDY", 0xA0, 2, 2, AddressMode::IMMEDIATE};
+  t[0xA4] = {"LDY", 0xA4, 2, 3, AddressMode::ZERO_PAGE};
+  t[0xB4] = {"LDY", 0xB4, 2, 4, AddressMode::ZERO_PAGE_AND_X};
+  t[0xAC] = {"LDY", 0xAC, 3, 4, AddressMode::ABSOLUTE};
+  t[0xBC] = {"LDY", 0xBC, 3, 4, AddressMode::ABSOLUTE_AND_X};
+  t[0x4A] = {"LSR", 0x4A, 1, 2, AddressMode::ACCUMULATOR};
+  t[0x46] = {"LSR", 0x46, 2, 5, AddressMode::ZERO_PAGE};
+  t[0x56] = {"LSR", 0x56, 2, 6, AddressMode::ZERO_PAGE_AND_X};
+  t[0x4E] = {"LSR", 0x4E, 3, 6, AddressMode::ABSOLUTE};
+  t[0x5E] = {"LSR", 0x5E, 3, 7, AddressMode::ABSOLUTE_AND_X};
+  t[0xEA] = {"NOP", 0xEA, 1, 2, AddressMode::IMPLICIT};
+  t[0x09] = {"ORA", 0x09, 2, 2, AddressMode::IMMEDIATE};
+  t[0x05] = {"ORA", 0x05, 2, 3, AddressMode::ZERO_PAGE};
+  t[0x15] = {"ORA", 0x15, 2, 4, AddressMode::ZERO_PAGE_AND_X};
+  t[0x0D] = {"ORA", 0x0D, 3, 4, AddressMode::ABSOLUTE};
+  t[0x1D] = {"ORA", 0x1D, 3, 4, AddressMode::ABSOLUTE_AND_X};
+  t[0x19] = {"ORA", 0x19, 3, 4, AddressMode::ABSOLUTE_AND_Y};
+  t[0x01] = {"ORA", 0x01, 2, 6, AddressMode::INDEXED_INDIRECT};
+  t[0x11] = {"ORA", 0x11, 2, 5, AddressMode::INDIRECT_INDEXED};
+  // STA - Store Accumulator
+  t[0x85] = {"STA", 0x85, 2, 3, AddressMode::ZERO_PAGE};
+  t[0x95] = {"STA", 0x95, 2, 4, AddressMode::ZERO_PAGE_AND_X};
+  t[0x8D] = {"STA", 0x8D, 3, 4, AddressMode::ABSOLUTE};
+  t[0x9D] = {"STA", 0x9D, 3, 5, AddressMode::ABSOLUTE_AND_X};
+  t[0x99] = {"STA", 0x99, 3, 5, AddressMode::ABSOLUTE_AND_Y};
+  t[0x81] = {"STA", 0x81, 2, 6, AddressMode::INDEXED_INDIRECT}; // (Indirect,X)
+  t[0x91] = {"STA", 0x91, 2, 6, AddressMode::INDIRECT_INDEXED}; // (Indirect),Y
+  // ADC - Add with Carry
+  t[0x69] = {"ADC", 0x69, 2, 2, AddressMode::IMMEDIATE};
+  t[0x65] = {"ADC", 0x65, 2, 3, AddressMode::ZERO_PAGE};
+  t[0x75] = {"ADC", 0x75, 2, 4, AddressMode::ZERO_PAGE_AND_X};
+  t[0x6D] = {"ADC", 0x6D, 3, 4, AddressMode::ABSOLUTE};
+  t[0x7D] = {"ADC", 0x7D, 3, 4, AddressMode::ABSOLUTE_AND_X};
+  t[0x79] = {"ADC", 0x79, 3, 4, AddressMode::ABSOLUTE_AND_Y};
+  t[0x61] = {"ADC", 0x61, 2, 6, AddressMode::INDEXED_INDIRECT};
+  t[0x71] = {"ADC", 0x71, 2, 5, AddressMode::INDIRECT_INDEXED};
+
+  // SBC - Subtract with Carry
+  t[0xE9] = {"SBC", 0xE9, 2, 2, AddressMode::IMMEDIATE};
+  t[0xE5] = {"SBC", 0xE5, 2, 3, AddressMode::ZERO_PAGE};
+  t[0xF5] = {"SBC", 0xF5, 2, 4, AddressMode::ZERO_PAGE_AND_X};
+  t[0xED] = {"SBC", 0xED, 3, 4, AddressMode::ABSOLUTE};
+  t[0xFD] = {"SBC", 0xFD, 3, 4, AddressMode::ABSOLUTE_AND_X};
+  t[0xF9] = {"SBC", 0xF9, 3, 4, AddressMode::ABSOLUTE_AND_Y};
+  t[0xE1] = {"SBC", 0xE1, 2, 6, AddressMode::INDEXED_INDIRECT};
+  t[0xF1] = {"SBC", 0xF1, 2, 5, AddressMode::INDIRECT_INDEXED};
+  t[0xAA] = {"TAX", 0xAA, 1, 2, AddressMode::IMPLICIT};
+  t[0x8A] = {"TXA", 0x8A, 1, 2, AddressMode::IMPLICIT};
+  t[0xA8] = {"TAY", 0xA8, 1, 2, AddressMode::IMPLICIT};
+  t[0x98] = {"TYA", 0x98, 1, 2, AddressMode::IMPLICIT};
+  t[0x0A] = {"ASL", 0x0A, 1, 2, AddressMode::ACCUMULATOR};
+  t[0x06] = {"ASL", 0x06, 2, 5, AddressMode::ZERO_PAGE};
+  t[0x16] = {"ASL", 0x16, 2, 6, AddressMode::ZERO_PAGE_AND_X};
+  t[0x0E] = {"ASL", 0x0E, 3, 6, AddressMode::ABSOLUTE};
+  t[0x1E] = {"ASL", 0x1E, 3, 7, AddressMode::ABSOLUTE_AND_X};
+  t[0x2A] = {"ROL", 0x2A, 1, 2, AddressMode::ACCUMULATOR};
+  t[0x26] = {"ROL", 0x26, 2, 5, AddressMode::ZERO_PAGE};
+  t[0x36] = {"ROL", 0x36, 2, 6, AddressMode::ZERO_PAGE_AND_X};
+  t[0x2E] = {"ROL", 0x2E, 3, 6, AddressMode::ABSOLUTE};
+  t[0x3E] = {"ROL", 0x3E, 3, 7, AddressMode::ABSOLUTE_AND_X};
+  t[0x6A] = {"ROR", 0x6A, 1, 2, AddressMode::ACCUMULATOR};
+  t[0x66] = {"ROR", 0x66, 2, 5, AddressMode::ZERO_PAGE};
+  t[0x76] = {"ROR", 0x76, 2, 6, AddressMode::ZERO_PAGE_AND_X};
+  t[0x6E] = {"ROR", 0x6E, 3, 6, AddressMode::ABSOLUTE};
+  t[0x7E] = {"ROR", 0x7E, 3, 7, AddressMode::ABSOLUTE_AND_X};
+  t[0x18] = {"CLC", 0x18, 1, 2, AddressMode::IMPLICIT};
+  t[0xD8] = {"CLD", 0xD8, 1, 2, AddressMode::IMPLICIT};
+  t[0x58] = {"CLI", 0x58, 1, 2, AddressMode::IMPLICIT};
+  t[0xB8] = {"CLV", 0xB8, 1, 2, AddressMode::IMPLICIT};
+  ;
+  t[0x38] = {"SEC", 0x38, 1, 2, AddressMode::IMPLICIT};
+  t[0xF8] = {"SED", 0xF8, 1, 2, AddressMode::IMPLICIT};
+  t[0x29] = {"AND", 0x29, 2, 2, AddressMode::IMMEDIATE};
+  t[0x25] = {"AND", 0x25, 2, 3, AddressMode::ZERO_PAGE};
+  t[0x35] = {"AND", 0x35, 2, 4, AddressMode::ZERO_PAGE_AND_X};
+  t[0x2D] = {"AND", 0x2D, 3, 4, AddressMode::ABSOLUTE};
+  t[0x3D] = {"AND", 0x3D, 3, 4, AddressMode::ABSOLUTE_AND_X};
+  t[0x39] = {"AND", 0x39, 3, 4, AddressMode::ABSOLUTE_AND_Y};
+  t[0x21] = {"AND", 0x21, 2, 6, AddressMode::INDEXED_INDIRECT};
+  t[0x31] = {"AND", 0x31, 2, 5, AddressMode::INDIRECT_INDEXED};
+
+  // BIT
+  t[0x24] = {"BIT", 0x24, 2, 3, AddressMode::ZERO_PAGE};
+  t[0x2C] = {"BIT", 0x2C, 3, 4, AddressMode::ABSOLUTE};
+
+  // Branches
+  t[0x90] = {"BCC", 0x90, 2, 2, AddressMode::RELATIVE};
+  t[0xB0] = {"BCS", 0xB0, 2, 2, AddressMode::RELATIVE};
+  t[0xF0] = {"BEQ", 0xF0, 2, 2, AddressMode::RELATIVE};
+  t[0x30] = {"BMI", 0x30, 2, 2, AddressMode::RELATIVE};
+  t[0xD0] = {"BNE", 0xD0, 2, 2, AddressMode::RELATIVE};
+  t[0x10] = {"BPL", 0x10, 2, 2, AddressMode::RELATIVE};
+  t[0x50] = {"BVC", 0x50, 2, 2, AddressMode::RELATIVE};
+
+  // DEC
+  t[0xC6] = {"DEC", 0xC6, 2, 5, AddressMode::ZERO_PAGE};
+  t[0xD6] = {"DEC", 0xD6, 2, 6, AddressMode::ZERO_PAGE_AND_X};
+  t[0xCE] = {"DEC", 0xCE, 3, 6, AddressMode::ABSOLUTE};
+  t[0xDE] = {"DEC", 0xDE, 3, 7, AddressMode::ABSOLUTE_AND_X};
+
+  // INC
+  t[0xE6] = {"INC", 0xE6, 2, 5, AddressMode::ZERO_PAGE};
+  t[0xF6] = {"INC", 0xF6, 2, 6, AddressMode::ZERO_PAGE_AND_X};
+  t[0xEE] = {"INC", 0xEE, 3, 6, AddressMode::ABSOLUTE};
+  t[0xFE] = {"INC", 0xFE, 3, 7, AddressMode::ABSOLUTE_AND_X};
+
+  // RTI & RTS
+  t[0x40] = {"RTI", 0x40, 1, 6, AddressMode::IMPLICIT};
+  t[0x60] = {"RTS", 0x60, 1, 6, AddressMode::IMPLICIT};
+
+  // STX
+  t[0x86] = {"STX", 0x86, 2, 3, AddressMode::ZERO_PAGE};
+  t[0x96] = {"STX", 0x96, 2, 4, AddressMode::ZERO_PAGE_AND_Y};
+  t[0x8E] = {"STX", 0x8E, 3, 4, AddressMode::ABSOLUTE};
+
+  // STY
+  t[0x84] = {"STY", 0x84, 2, 3, AddressMode::ZERO_PAGE};
+  t[0x94] = {"STY", 0x94, 2, 4, AddressMode::ZERO_PAGE_AND_X};
+  t[0x8C] = {"STY", 0x8C, 3, 4, AddressMode::ABSOLUTE};
+
+  // TSX / TXS
+  t[0xBA] = {"TSX", 0xBA, 1, 2, AddressMode::IMPLICIT};
+  t[0x9A] = {"TXS", 0x9A, 1, 2, AddressMode::IMPLICIT};
+  t[0x48] = {"PHA", 0x48, 1, 3, AddressMode::IMPLICIT};
+  t[0x08] = {"PHP", 0x08, 1, 3, AddressMode::IMPLICIT};
+  t[0x68] = {"PLA", 0x68, 1, 4, AddressMode::IMPLICIT};
+  t[0x28] = {"PLP", 0x28, 1, 4, AddressMode::IMPLICIT};
+  t[0x78] = {"SEI", 0x78, 1, 2, AddressMode::IMPLICIT};
+
+  // Custom end-of-program instruction
+  t[0x02] = {"DONE", 0x02, 1, 1, AddressMode::IMPLICIT, Instruction::HALT};
+  return t;
+}
+
+/* One table for every Emulator, the interpreters, the block cache, the JIT and the recompiler */
+inline constexpr std::array<Instruction, 0x100> INSTRUCTIONS = makeInstructionTable();
+
+// every official opcode decodes to the addressing mode and length its handler was instantiated with,
+// and every opcode that doesn't halt has a handler
+constexpr bool matchesOfficialOpcodes()
+{
+  int handlers = 0;
+#define X(code, op, mode)                                                          \
+  if (INSTRUCTIONS[code].opcode != code || (INSTRUCTIONS[code].flags & Instruction::HALT) || \
+      INSTRUCTIONS[code].addressing_mode != AddressMode::mode ||                  \
+      INSTRUCTIONS[code].args_count != 1 + ops::OPERAND_BYTES<AddressMode::mode>) \
+  {                                                                                \
+    return false;                                                                  \
+  }                                                                                \
+  handlers++;
+  OFFICIAL_OPCODES(X)
+#undef X
+
+  int decoded = 0;
+  for (const Instruction &instruction : INSTRUCTIONS)
+  {
+    decoded += !(instruction.flags & Instruction::HALT);
+  }
+  return handlers == decoded;
+}
+
+static_assert(matchesOfficialOpcodes(), "INSTRUCTIONS and OFFICIAL_OPCODES disagree");
+
+#endif // INSTRUCTIONS_H
@@ -0,0 +1,56 @@
+#ifndef INTERRUPTS_H
+#define INTERRUPTS_H
+
+#include "types.h"
+#include <atomic>
+#include <cstdint>
+#include <thread>
+
+/*
+ * The IRQ, NMI and RESET inputs of the CPU, safe to drive from any thread without a lock.
+ * All three live in one atomic word, so the core sees "nothing pending" with a single load.
+ * IRQ is level triggered and wired-OR: every source holds its own bit until it releases it,
+ * and the CPU keeps taking the interrupt while any bit is set and P_INT_DISABLE is clear.
+ * NMI is edge triggered, each nmi() is taken once. reset() goes through the RESET vector
+ * and drops a pending NMI.
+ * The core only looks at the lines between engine runs and batch slices, see Emulator::interrupt_poll_cycles.
+ * A line raised on the emulating thread itself, by a device the guest just accessed, also ends
+ * the running engine or batch slice at its next boundary, so it is taken without waiting for a poll.
+ */
+class InterruptLines
+{
+public:
+    constexpr static std::uint32_t NMI = 1u << 31;
+    constexpr static std::uint32_t RESET = 1u << 30;
+    constexpr static std::uint32_t IRQ_SOURCES = RESET - 1; // source n is bit n
+
+    void assertIrq(unsigned source = 0) { raise(1u << source); }
+    void releaseIrq(unsigned source = 0) { lines.fetch_and(~(1u << source), std::memory_order_release); }
+    void nmi() { raise(NMI); }
+    void reset() { raise(RESET); }
+
+    std::uint32_t pending() const { return lines.load(std::memory_order_acquire); }
+    bool irq() const { return pending() & IRQ_SOURCES; }
+
+    // clears the edge triggered lines it returns, the IRQ level stays as the sources left it
+    std::uint32_t take(std::uint32_t edges) { return lines.fetch_and(~edges, std::memory_order_acq_rel) & edges; }
+
+    // lowered to 0 when a line goes up on the emulating thread, like Scheduler::horizon
+    std::uint64_t *horizon = nullptr;
+    std::atomic<std::thread::id> emulating; // set by the core whenever it starts running
+
+private:
+    std::atomic<std::uint32_t> lines{0};
+
+    void raise(std::uint32_t line)
+    {
+        // other threads leave the horizon alone, the core is reading it without a lock
+        if (!(lines.fetch_or(line, std::memory_order_release) & line) && horizon != nullptr &&
+            emulating.load(std::memory_order_relaxed) == std::this_thread::get_id())
+        {
+            *horizon = 0;
+        }
+    }
+};
+
+#endif // INTERRUPTS_H
@@ -0,0 +1,967 @@
+#include "jit.h"
+#include "mos6502.h"
+#include "opcodes.h"
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+#if MOS6502_JIT
+#include <sys/mman.h>
+
+namespace
+{
+	enum Reg : Byte
+	{
+		RAX = 0,
+		RCX = 1,
+		RDX = 2,
+		RBX = 3,
+		RSP = 4,
+		RBP = 5,
+		RSI = 6,
+		RDI = 7,
+		R12 = 12,
+		R13 = 13,
+		R14 = 14,
+		R15 = 15,
+		NO_REG = 0xFF, // the guest stack pointer, it stays in MOS_6502
+	};
+
+	// everything that lives in a host register across a block is callee-saved
+	constexpr Reg REG_CPU = RBX;
+	constexpr Reg REG_MEM = RBP;
+	constexpr Reg REG_A = R12;
+	constexpr Reg REG_X = R13;
+	constexpr Reg REG_Y = R14;
+	constexpr Reg REG_P = R15;
+
+	enum Condition : Byte
+	{
+		CC_O = 0x0,
+		CC_B = 0x2,
+		CC_AE = 0x3,
+		CC_E = 0x4,
+		CC_NE = 0x5,
+	};
+
+	// the /digit of the 0x80 group, times 8 it is also the opcode of the register form
+	enum Alu : Byte
+	{
+		ADD = 0,
+		OR = 1,
+		ADC = 2,
+		SBB = 3,
+		AND = 4,
+		SUB = 5,
+		XOR = 6,
+		CMP = 7,
+	};
+
+	// the /digit of the 0xD0 group, single bit shifts and rotates
+	enum Shift : Byte
+	{
+		RCL = 2,
+		RCR = 3,
+		SHL = 4,
+		SHR = 5,
+	};
+
+	constexpr std::int32_t PC_OFFSET = offsetof(MOS_6502, program_counter);
+	constexpr std::int32_t S_OFFSET = offsetof(MOS_6502, S);
+	constexpr std::int32_t MEMORY_OFFSET = offsetof(Memory, memory);
+	constexpr std::int32_t GENERATION_OFFSET = offsetof(Memory, page_generation);
+	constexpr std::int32_t BARE_WRITE_OFFSET = offsetof(Memory, bare_write);
+	constexpr std::int32_t STACK_OFFSET = MEMORY_OFFSET + Memory::STACK_BASE;
+
+	constexpr std::int32_t REGISTER_OFFSETS[] = {
+		offsetof(MOS_6502, accumulator),
+		offsetof(MOS_6502, X),
+		offsetof(MOS_6502, Y),
+	};
+	constexpr Reg GUEST_REGISTERS[] = {REG_A, REG_X, REG_Y};
+
+	// translated code keeps P packed, MOS_6502 keeps the lazy flags
+	constexpr std::int32_t STATUS_OFFSET = offsetof(MOS_6502, status);
+	constexpr std::int32_t NEGATIVE_OFFSET = offsetof(MOS_6502, negative_result);
+	constexpr std::int32_t ZERO_OFFSET = offsetof(MOS_6502, zero_result);
+	constexpr std::int32_t CARRY_OFFSET = offsetof(MOS_6502, carry_result);
+	constexpr std::int32_t OVERFLOW_OFFSET = offsetof(MOS_6502, overflow_result);
+	constexpr Byte LAZY_FLAGS = MOS_6502::P_NEGATIVE | MOS_6502::P_OVERFLOW | MOS_6502::P_ZERO | MOS_6502::P_CARRY;
+
+	constexpr Reg hostRegister(Byte MOS_6502::*reg)
+	{
+		return reg == &MOS_6502::accumulator ? REG_A
+			   : reg == &MOS_6502::X		 ? REG_X
+			   : reg == &MOS_6502::Y		 ? REG_Y
+											 : NO_REG;
+	}
+
+	/*
+	 * Just enough of an x86-64 encoder for the translator.
+	 * Memory operands are always [base + disp32] with base RBX/RBP, or [RBP + RAX * scale + disp32].
+	 * Byte registers are limited to AL/CL/DL and R12B-R15B, so no REX is ever needed just for them.
+	 */
+	class Assembler
+	{
+	public:
+		explicit Assembler(Byte *code) : start(code), out(code) {}
+
+		Byte *position() const { return out; }
+		std::size_t size() const { return out - start; }
+
+		void loadByte(Reg dst, Reg base, std::int32_t disp) { rex(false, dst, base); emit(0x0F); emit(0xB6); memory(dst, base, disp); }
+		void loadByteIndexed(Reg dst, std::int32_t disp) { rex(false, dst, RAX); emit(0x0F); emit(0xB6); indexed(dst, 0, disp); }
+		void storeByte(Reg base, std::int32_t disp, Reg src) { rex(false, src, base); emit(0x88); memory(src, base, disp); }
+		void storeByteIndexed(std::int32_t disp, Reg src) { rex(false, src, RAX); emit(0x88); indexed(src, 0, disp); }
+		void storeWord(Reg base, std::int32_t disp, Word value) { emit(0x66); rex(false, RAX, base); emit(0xC7); memory(RAX, base, disp); emit16(value); }
+		void storeWord(Reg base, std::int32_t disp, Reg src) { emit(0x66); rex(false, src, base); emit(0x89); memory(src, base, disp); }
+		void storeImm(Reg base, std::int32_t disp, Byte value) { rex(false, RAX, base); emit(0xC6); memory(RAX, base, disp); emit(value); }
+		void storeImmIndexed(std::int32_t disp, Byte value) { emit(0xC6); indexed(RAX, 0, disp); emit(value); }
+		void stepByte(Reg base, std::int32_t disp, bool decrement) { rex(false, RAX, base); emit(0xFE); memory(Reg(decrement), base, disp); }
+		void stepByteIndexed(std::int32_t disp, bool decrement) { emit(0xFE); indexed(Reg(decrement), 0, disp); }
+		void cmpByte(Reg base, std::int32_t disp, Byte value) { rex(false, RAX, base); emit(0x80); memory(Reg(CMP), base, disp); emit(value); }
+		void cmpByteIndexed(std::int32_t disp, Byte value) { emit(0x80); indexed(Reg(CMP), 0, disp); emit(value); }
+		void cmpDword(Reg base, std::int32_t disp, std::uint32_t value) { rex(false, RAX, base); emit(0x81); memory(Reg(CMP), base, disp); emit32(value); }
+
+		void movImm(Reg dst, std::uint32_t value) { rex(false, RAX, dst); emit(0xB8 + (dst & 7)); emit32(value); }
+		void movImm64(Reg dst, std::uint64_t value) { rex(true, RAX, dst); emit(0xB8 + (dst & 7)); emit32(std::uint32_t(value)); emit32(std::uint32_t(value >> 32)); }
+		void mov64(Reg dst, Reg src) { rex(true, src, dst); emit(0x89); direct(src, dst); }
+		void movzxByte(Reg dst, Reg src) { rex(false, dst, src); emit(0x0F); emit(0xB6); direct(dst, src); }
+		void movzxWord(Reg dst, Reg src) { rex(false, dst, src); emit(0x0F); emit(0xB7); direct(dst, src); }
+
+		void alu(Alu op, Reg dst, Reg src) { rex(false, src, dst); emit(op * 8); direct(src, dst); }
+		void aluImm(Alu op, Reg dst, Byte value) { rex(false, RAX, dst); emit(0x80); direct(Reg(op), dst); emit(value); }
+		void addImm32(Reg dst, std::uint32_t value) { rex(false, RAX, dst); emit(0x81); direct(RAX, dst); emit32(value); }
+		void or32(Reg dst, Reg src) { rex(false, src, dst); emit(0x09); direct(src, dst); }
+		void inc32(Reg dst) { rex(false, RAX, dst); emit(0xFF); direct(RAX, dst); }
+		void shlImm32(Reg dst, Byte count) { rex(false, RAX, dst); emit(0xC1); direct(Reg(AND), dst); emit(count); }
+		void shrImm32(Reg dst, Byte count) { rex(false, RAX, dst); emit(0xC1); direct(Reg(SUB), dst); emit(count); }
+		void shlImm(Reg dst, Byte count) { rex(false, RAX, dst); emit(0xC0); direct(Reg(AND), dst); emit(count); }
+		void shift(Shift op, Reg dst) { rex(false, RAX, dst); emit(0xD0); direct(Reg(op), dst); }
+		void step(Reg dst, bool decrement) { rex(false, RAX, dst); emit(0xFE); direct(Reg(decrement), dst); }
+		void testImm(Reg dst, Byte value) { rex(false, RAX, dst); emit(0xF6); direct(RAX, dst); emit(value); }
+		void test(Reg dst, Reg src) { rex(false, src, dst); emit(0x84); direct(src, dst); }
+		void setcc(Condition cc, Reg dst) { rex(false, RAX, dst); emit(0x0F); emit(0x90 | cc); direct(RAX, dst); }
+		void bt(Reg dst, Byte bit) { rex(false, RAX, dst); emit(0x0F); emit(0xBA); direct(Reg(AND), dst); emit(bit); }
+		void cmc() { emit(0xF5); }
+
+		// the dword at [rsp], translated code counts its cycles there
+		void storeStack(std::uint32_t value) { emit(0xC7); stack(RAX); emit32(value); }
+		void addStack(std::uint32_t value) { emit(0x81); stack(Reg(ADD)); emit32(value); }
+		void addStack(Reg src) { rex(false, src, RAX); emit(0x01); stack(src); }
+		void adcStack(Byte value) { emit(0x83); stack(Reg(ADC)); emit(value); }
+		void loadStack(Reg dst) { rex(false, dst, RAX); emit(0x8B); stack(dst); }
+
+		void push(Reg reg) { rex(false, RAX, reg); emit(0x50 + (reg & 7)); }
+		void pop(Reg reg) { rex(false, RAX, reg); emit(0x58 + (reg & 7)); }
+		void adjustStack(std::int8_t delta) { rex(true, RAX, RSP); emit(0x83); direct(Reg(delta < 0 ? SUB : ADD), RSP); emit(Byte(delta < 0 ? -delta : delta)); }
+		void call(Reg reg) { rex(false, RAX, reg); emit(0xFF); direct(Reg(2), reg); }
+		void ret() { emit(0xC3); }
+
+		// both return the end of the rel32, for bind()
+		Byte *jcc(Condition cc) { emit(0x0F); emit(0x80 | cc); emit32(0); return out; }
+		Byte *jmp() { emit(0xE9); emit32(0); return out; }
+
+		void bind(Byte *jump, Byte *target)
+		{
+			std::int32_t rel = std::int32_t(target - jump);
+			std::memcpy(jump - 4, &rel, sizeof(rel));
+		}
+
+	private:
+		void emit(Byte value) { *out++ = value; }
+		void emit16(Word value) { std::memcpy(out, &value, sizeof(value)); out += sizeof(value); }
+		void emit32(std::uint32_t value) { std::memcpy(out, &value, sizeof(value)); out += sizeof(value); }
+
+		void rex(bool wide, Reg reg, Reg base)
+		{
+			Byte prefix = 0x40 | (wide << 3) | ((reg >> 3) << 2) | (base >> 3);
+			if (prefix != 0x40)
+			{
+				emit(prefix);
+			}
+		}
+
+		void direct(Reg reg, Reg rm) { emit(0xC0 | ((reg & 7) << 3) | (rm & 7)); }
+
+		void memory(Reg reg, Reg base, std::int32_t disp)
+		{
+			emit(0x80 | ((reg & 7) << 3) | (base & 7));
+			emit32(std::uint32_t(disp));
+		}
+
+		// [RSP]
+		void stack(Reg reg)
+		{
+			emit(0x04 | ((reg & 7) << 3));
+			emit(0x24);
+		}
+
+		// [RBP + RAX << scale + disp]
+		void indexed(Reg reg, Byte scale, std::int32_t disp)
+		{
+			emit(0x84 | ((reg & 7) << 3));
+			emit((scale << 6) | (RAX << 3) | RBP);
+			emit32(std::uint32_t(disp));
+		}
+
+		Byte *start;
+		Byte *out;
+	};
+
+	/* Pattern matching on the operation templates from opcodes.h */
+	template <typename Op>
+	struct LoadOf
+	{
+		constexpr static bool value = false;
+	};
+	template <Byte MOS_6502::*Register>
+	struct LoadOf<ops::Load<Register>>
+	{
+		constexpr static bool value = true;
+		constexpr static Reg reg = hostRegister(Register);
+	};
+
+	template <typename Op>
+	struct StoreOf
+	{
+		constexpr static bool value = false;
+	};
+	template <Byte MOS_6502::*Register>
+	struct StoreOf<ops::Store<Register>>
+	{
+		constexpr static bool value = true;
+		constexpr static Reg reg = hostRegister(Register);
+	};
+
+	template <typename Op>
+	struct TransferOf
+	{
+		constexpr static bool value = false;
+	};
+	template <Byte MOS_6502::*From, Byte MOS_6502::*To, bool FLAGS>
+	struct TransferOf<ops::Transfer<From, To, FLAGS>>
+	{
+		constexpr static bool value = true;
+		constexpr static Reg from = hostRegister(From);
+		constexpr static Reg to = hostRegister(To);
+		constexpr static bool flags = FLAGS;
+	};
+
+	template <typename Op>
+	struct StepOf
+	{
+		constexpr static bool value = false;
+	};
+	template <Byte MOS_6502::*Register, int Delta>
+	struct StepOf<ops::Step<Register, Delta>>
+	{
+		constexpr static bool value = true;
+		constexpr static Reg reg = hostRegister(Register);
+		constexpr static bool decrement = Delta < 0;
+	};
+
+	template <typename Op>
+	struct CompareOf
+	{
+		constexpr static bool value = false;
+	};
+	template <Byte MOS_6502::*Register>
+	struct CompareOf<ops::Compare<Register>>
+	{
+		constexpr static bool value = true;
+		constexpr static Reg reg = hostRegister(Register);
+	};
+
+	template <typename Op>
+	struct FlagOf
+	{
+		constexpr static bool value = false;
+	};
+	template <Byte Flag, bool Set>
+	struct FlagOf<ops::SetFlag<Flag, Set>>
+	{
+		constexpr static bool value = true;
+		constexpr static Byte flag = Flag;
+		constexpr static bool set = Set;
+	};
+
+	template <typename Op>
+	struct BranchOf
+	{
+		constexpr static bool value = false;
+	};
+	template <Byte Flag, bool IfSet>
+	struct BranchOf<ops::Branch<Flag, IfSet>>
+	{
+		constexpr static bool value = true;
+		constexpr static Byte flag = Flag;
+		constexpr static bool if_set = IfSet;
+	};
+
+	template <AddressMode Mode>
+	constexpr bool CONSTANT_ADDRESS = Mode == AddressMode::ZERO_PAGE || Mode == AddressMode::ABSOLUTE;
+
+	template <AddressMode Mode>
+	constexpr bool INDEXED_ADDRESS = Mode == AddressMode::ZERO_PAGE_AND_X || Mode == AddressMode::ZERO_PAGE_AND_Y ||
+									 Mode == AddressMode::ABSOLUTE_AND_X || Mode == AddressMode::ABSOLUTE_AND_Y;
+
+	class Translator
+	{
+	public:
+		Translator(Byte *code, const Block &block, const Memory &mem) : as(code), block(block), mem(mem) {}
+
+		void prologue()
+		{
+			for (Reg reg : {RBX, RBP, R12, R13, R14, R15})
+			{
+				as.push(reg);
+			}
+			as.adjustStack(-8); // six pushes leave the stack 8 bytes off the call alignment, the slot counts cycles
+			as.storeStack(0);
+			as.mov64(REG_CPU, RDI);
+			as.mov64(REG_MEM, RSI);
+			reload();
+		}
+
+		// one instruction, the last one of the block also leaves it
+		void instruction(Byte opcode, Word operand, Word pc, Word next, Byte cycles, bool last)
+		{
+			elapsed += cycles;
+			bool wrote = false;
+			bool inlined = false;
+			switch (opcode)
+			{
+#define X(code, op, mode)                                                                    \
+	case code:                                                                               \
+		inlined = translate<ops::op, AddressMode::mode>(code, operand, pc, next, wrote);    \
+		break;
+				OFFICIAL_OPCODES(X)
+#undef X
+			}
+
+			if (!inlined)
+			{
+				callHandler(opcode, operand, pc);
+				wrote = true; // assume the worst, the handler leaves the pc in cpu
+				if (last)
+				{
+					leave(elapsed);
+					return;
+				}
+			}
+
+			if (last)
+			{
+				if (!ops::ENDS_BLOCK[opcode])
+				{
+					exitTo(next, elapsed);
+				}
+				return;
+			}
+
+			if (wrote)
+			{
+				checkCode(next);
+			}
+		}
+
+		void epilogue()
+		{
+			// Memory::noteWrites() for the stores that hit a watched page, then back to the block
+			for (const SlowWrite &write : slow_writes)
+			{
+				as.bind(write.jump, as.position());
+				as.mov64(RDI, REG_MEM);
+				if (!write.indexed)
+				{
+					as.movImm(RSI, write.address);
+				}
+				as.movImm(RDX, write.length);
+				as.movImm64(RAX, reinterpret_cast<std::uint64_t>(&noteWrites));
+				as.call(RAX);
+				as.bind(as.jmp(), write.resume);
+			}
+
+			for (auto &[jump, pc, cycles] : stale_exits)
+			{
+				as.bind(jump, as.position());
+				exitTo(pc, cycles);
+			}
+
+			Byte *epilogue = as.position();
+			for (Byte *jump : exits)
+			{
+				as.bind(jump, epilogue);
+			}
+
+			spill();
+			as.loadStack(RAX);
+			as.adjustStack(8);
+			for (Reg reg : {R15, R14, R13, R12, RBP, RBX})
+			{
+				as.pop(reg);
+			}
+			as.ret();
+		}
+
+		std::size_t size() const { return as.size(); }
+
+	private:
+		template <typename Op, AddressMode Mode>
+		bool translate(Byte opcode, Word operand, Word pc, Word next, bool &wrote)
+		{
+			if constexpr (LoadOf<Op>::value)
+			{
+				if constexpr (Mode == AddressMode::IMMEDIATE)
+				{
+					as.movImm(LoadOf<Op>::reg, Byte(operand));
+					setNZ(Byte(operand));
+					return true;
+				}
+				else
+				{
+					if (!load<Mode>(LoadOf<Op>::reg, operand))
+					{
+						return false;
+					}
+					setNZ(LoadOf<Op>::reg);
+					return true;
+				}
+			}
+			else if constexpr (StoreOf<Op>::value)
+			{
+				return wrote = store<Mode>(StoreOf<Op>::reg, operand);
+			}
+			else if constexpr (TransferOf<Op>::value)
+			{
+				constexpr Reg from = TransferOf<Op>::from;
+				constexpr Reg to = TransferOf<Op>::to;
+				if constexpr (from == NO_REG)
+				{
+					as.loadByte(to, REG_CPU, S_OFFSET);
+				}
+				else if constexpr (to == NO_REG)
+				{
+					as.storeByte(REG_CPU, S_OFFSET, from);
+				}
+				else
+				{
+					as.movzxByte(to, from);
+				}
+
+				if constexpr (TransferOf<Op>::flags)
+				{
+					setNZ(to);
+				}
+				return true;
+			}
+			else if constexpr (StepOf<Op>::value)
+			{
+				as.step(StepOf<Op>::reg, StepOf<Op>::decrement);
+				setNZ(StepOf<Op>::reg);
+				return true;
+			}
+			else if constexpr (std::is_same_v<Op, ops::INC> || std::is_same_v<Op, ops::DEC>)
+			{
+				constexpr bool decrement = std::is_same_v<Op, ops::DEC>;
+				if (!plain<Mode>(operand))
+				{
+					return false;
+				}
+				if constexpr (CONSTANT_ADDRESS<Mode>)
+				{
+					as.stepByte(REG_MEM, MEMORY_OFFSET + operand, decrement);
+					as.loadByte(RDX, REG_MEM, MEMORY_OFFSET + operand);
+					setNZ(RDX);
+					noteWrite(operand);
+				}
+				else if constexpr (INDEXED_ADDRESS<Mode>)
+				{
+					indexAddress<Mode>(operand);
+					as.stepByteIndexed(MEMORY_OFFSET, decrement);
+					as.loadByteIndexed(RDX, MEMORY_OFFSET);
+					setNZ(RDX);
+					noteIndexedWrite();
+				}
+				else
+				{
+					return false;
+				}
+				return wrote = true;
+			}
+			else if constexpr ((std::is_same_v<Op, ops::ASL> || std::is_same_v<Op, ops::LSR> ||
+								std::is_same_v<Op, ops::ROL> || std::is_same_v<Op, ops::ROR>) &&
+							   Mode == AddressMode::ACCUMULATOR)
+			{
+				// the bit shifted out lands in the host carry, the rotates shift the 6502 carry in
+				constexpr Shift shift = std::is_same_v<Op, ops::ASL>   ? SHL
+										: std::is_same_v<Op, ops::LSR> ? SHR
+										: std::is_same_v<Op, ops::ROL> ? RCL
+																	   : RCR;
+				if constexpr (shift == RCL || shift == RCR)
+				{
+					as.bt(REG_P, 0);
+				}
+				as.shift(shift, REG_A);
+				as.setcc(CC_B, RAX);
+				as.aluImm(AND, REG_P, Byte(~MOS_6502::P_CARRY));
+				as.alu(OR, REG_P, RAX);
+				setNZ(REG_A);
+				return true;
+			}
+			else if constexpr (FlagOf<Op>::value)
+			{
+				if constexpr (FlagOf<Op>::set)
+				{
+					as.aluImm(OR, REG_P, FlagOf<Op>::flag);
+				}
+				else
+				{
+					as.aluImm(AND, REG_P, Byte(~FlagOf<Op>::flag));
+				}
+				return true;
+			}
+			else if constexpr (std::is_same_v<Op, ops::NOP>)
+			{
+				return true;
+			}
+			else if constexpr (CompareOf<Op>::value)
+			{
+				if (!load<Mode>(RCX, operand))
+				{
+					return false;
+				}
+				as.aluImm(AND, REG_P, Byte(~MOS_6502::P_CARRY));
+				as.alu(CMP, CompareOf<Op>::reg, RCX);
+				as.setcc(CC_AE, RAX);
+				as.alu(OR, REG_P, RAX);
+				as.movzxByte(RAX, CompareOf<Op>::reg);
+				as.alu(SUB, RAX, RCX);
+				setNZ(RAX);
+				return true;
+			}
+			else if constexpr (std::is_same_v<Op, ops::AND> || std::is_same_v<Op, ops::ORA> || std::is_same_v<Op, ops::EOR>)
+			{
+				if (!load<Mode>(RCX, operand))
+				{
+					return false;
+				}
+				as.alu(std::is_same_v<Op, ops::AND> ? AND : std::is_same_v<Op, ops::ORA> ? OR : XOR, REG_A, RCX);
+				setNZ(REG_A);
+				return true;
+			}
+			else if constexpr (std::is_same_v<Op, ops::ADC> || std::is_same_v<Op, ops::SBC>)
+			{
+				constexpr bool subtract = std::is_same_v<Op, ops::SBC>;
+				if (!load<Mode>(RCX, operand))
+				{
+					return false;
+				}
+
+				// decimal mode goes through the handler
+				as.testImm(REG_P, MOS_6502::P_DECIMAL);
+				Byte *decimal = as.jcc(CC_NE);
+
+				// the host carry and overflow flags match the 6502 ones, SBC borrows with an inverted carry
+				as.bt(REG_P, 0);
+				if constexpr (subtract)
+				{
+					as.cmc();
+				}
+				as.alu(subtract ? SBB : ADC, REG_A, RCX);
+				as.setcc(subtract ? CC_AE : CC_B, RAX);
+				as.setcc(CC_O, RDX);
+				as.aluImm(AND, REG_P, Byte(~(MOS_6502::P_CARRY | MOS_6502::P_OVERFLOW)));
+				as.alu(OR, REG_P, RAX);
+				as.shlImm(RDX, 6);
+				as.alu(OR, REG_P, RDX);
+				setNZ(REG_A);
+
+				Byte *done = as.jmp();
+				as.bind(decimal, as.position());
+				callHandler(opcode, operand, pc, false); // the load above already paid for crossing a page
+				as.bind(done, as.position());
+				return true;
+			}
+			else if constexpr (BranchOf<Op>::value)
+			{
+				// one more cycle when taken, two when it lands on another page
+				Word target = Word(next + (SignedByte)operand);
+				as.testImm(REG_P, BranchOf<Op>::flag);
+				Byte *taken = as.jcc(BranchOf<Op>::if_set ? CC_NE : CC_E);
+				exitTo(next, elapsed);
+				as.bind(taken, as.position());
+				exitTo(target, elapsed + 1 + ((next ^ target) > 0xFF));
+				return true;
+			}
+			else if constexpr (std::is_same_v<Op, ops::JMP> && Mode == AddressMode::ABSOLUTE)
+			{
+				exitTo(operand, elapsed);
+				return true;
+			}
+			else if constexpr (std::is_same_v<Op, ops::JSR>)
+			{
+				// pushes the address of its own last byte, like Memory::stackPushWord()
+				if (!mem.isPlain(Memory::STACK_BASE >> 8))
+				{
+					return false;
+				}
+				Word return_address = next - 1;
+				as.loadByte(RAX, REG_CPU, S_OFFSET);
+				as.storeImmIndexed(STACK_OFFSET, Byte(return_address >> 8));
+				as.step(RAX, true);
+				as.storeImmIndexed(STACK_OFFSET, Byte(return_address));
+				as.step(RAX, true);
+				as.storeByte(REG_CPU, S_OFFSET, RAX);
+				noteWrite(Memory::STACK_BASE, 0x100);
+				exitTo(operand, elapsed);
+				return true;
+			}
+			else if constexpr (std::is_same_v<Op, ops::RTS>)
+			{
+				if (!mem.isPlain(Memory::STACK_BASE >> 8))
+				{
+					return false;
+				}
+				as.loadByte(RAX, REG_CPU, S_OFFSET);
+				as.step(RAX, false);
+				as.loadByteIndexed(RCX, STACK_OFFSET);
+				as.step(RAX, false);
+				as.loadByteIndexed(RDX, STACK_OFFSET);
+				as.storeByte(REG_CPU, S_OFFSET, RAX);
+				as.shlImm32(RDX, 8);
+				as.or32(RCX, RDX);
+				as.inc32(RCX);
+				as.storeWord(REG_CPU, PC_OFFSET, RCX);
+				leave(elapsed);
+				return true;
+			}
+			else
+			{
+				return false;
+			}
+		}
+
+		// leaves the effective address in eax
+		template <AddressMode Mode>
+		void indexAddress(Word operand)
+		{
+			constexpr bool by_x = Mode == AddressMode::ZERO_PAGE_AND_X || Mode == AddressMode::ABSOLUTE_AND_X;
+			as.movzxByte(RAX, by_x ? REG_X : REG_Y);
+			if constexpr (Mode == AddressMode::ZERO_PAGE_AND_X || Mode == AddressMode::ZERO_PAGE_AND_Y)
+			{
+				as.aluImm(ADD, RAX, Byte(operand)); // wraps inside the zero page
+			}
+			else
+			{
+				as.addImm32(RAX, operand);
+				as.movzxWord(RAX, RAX);
+			}
+		}
+
+		// every page the access can touch goes straight to memory[]
+		template <AddressMode Mode>
+		bool plain(Word operand) const
+		{
+			if constexpr (Mode == AddressMode::ABSOLUTE)
+			{
+				return mem.isPlain(operand >> 8);
+			}
+			else if constexpr (Mode == AddressMode::ABSOLUTE_AND_X || Mode == AddressMode::ABSOLUTE_AND_Y)
+			{
+				return mem.isPlain(operand >> 8) && mem.isPlain(Byte((operand >> 8) + 1));
+			}
+			else if constexpr (CONSTANT_ADDRESS<Mode> || INDEXED_ADDRESS<Mode>)
+			{
+				return mem.isPlain(0);
+			}
+			else
+			{
+				return true;
+			}
+		}
+
+		template <AddressMode Mode>
+		bool load(Reg dst, Word operand)
+		{
+			if (!plain<Mode>(operand))
+			{
+				return false;
+			}
+
+			if constexpr (Mode == AddressMode::IMMEDIATE)
+			{
+				as.movImm(dst, Byte(operand));
+			}
+			else if constexpr (CONSTANT_ADDRESS<Mode>)
+			{
+				as.loadByte(dst, REG_MEM, MEMORY_OFFSET + operand);
+			}
+			else if constexpr (INDEXED_ADDRESS<Mode>)
+			{
+				// every operation loading through here has PAGE_PENALTY, the carry out of the low byte is the extra cycle
+				if constexpr (Mode == AddressMode::ABSOLUTE_AND_X || Mode == AddressMode::ABSOLUTE_AND_Y)
+				{
+					as.movzxByte(RDX, Mode == AddressMode::ABSOLUTE_AND_X ? REG_X : REG_Y);
+					as.aluImm(ADD, RDX, Byte(operand));
+					as.adcStack(0);
+				}
+				indexAddress<Mode>(operand);
+				as.loadByteIndexed(dst, MEMORY_OFFSET);
+			}
+			else
+			{
+				return false;
+			}
+			return true;
+		}
+
+		// a store to [address, address + length) is all there is on bare pages, anything else calls out
+		// to Memory::noteWrites(). Which pages are bare changes at run time, so it is looked up every time
+		void noteWrite(Word address, std::size_t length = 1)
+		{
+			as.cmpByte(REG_MEM, BARE_WRITE_OFFSET + (address >> 8), 0);
+			Byte *jump = as.jcc(CC_E);
+			slow_writes.push_back({jump, as.position(), address, std::uint32_t(length), false});
+		}
+
+		// the same for the address in RAX, clobbers rax and rsi
+		void noteIndexedWrite()
+		{
+			as.mov64(RSI, RAX);
+			as.shrImm32(RAX, 8);
+			as.cmpByteIndexed(BARE_WRITE_OFFSET, 0);
+			Byte *jump = as.jcc(CC_E);
+			slow_writes.push_back({jump, as.position(), 0, 1, true});
+		}
+
+		static void noteWrites(Memory *mem, std::uint32_t address, std::uint32_t length)
+		{
+			mem->noteWrites(Word(address), length);
+		}
+
+		// same bookkeeping as Memory::noteWrite()
+		template <AddressMode Mode>
+		bool store(Reg src, Word operand)
+		{
+			if (!plain<Mode>(operand))
+			{
+				return false;
+			}
+
+			if constexpr (CONSTANT_ADDRESS<Mode>)
+			{
+				as.storeByte(REG_MEM, MEMORY_OFFSET + operand, src);
+				noteWrite(operand);
+			}
+			else if constexpr (INDEXED_ADDRESS<Mode>)
+			{
+				indexAddress<Mode>(operand);
+				as.storeByteIndexed(MEMORY_OFFSET, src);
+				noteIndexedWrite();
+			}
+			else
+			{
+				return false;
+			}
+			return true;
+		}
+
+		// handleArithmeticFlagChanges(), clobbers ecx
+		void setNZ(Reg value)
+		{
+			as.aluImm(AND, REG_P, Byte(~(MOS_6502::P_ZERO | MOS_6502::P_NEGATIVE)));
+			as.test(value, value);
+			as.setcc(CC_E, RCX);
+			as.alu(ADD, RCX, RCX); // Z is bit 1
+			as.alu(OR, REG_P, RCX);
+			as.movzxByte(RCX, value);
+			as.aluImm(AND, RCX, MOS_6502::P_NEGATIVE);
+			as.alu(OR, REG_P, RCX);
+		}
+
+		void setNZ(Byte value)
+		{
+			as.aluImm(AND, REG_P, Byte(~(MOS_6502::P_ZERO | MOS_6502::P_NEGATIVE)));
+			Byte flags = (value == 0 ? MOS_6502::P_ZERO : 0) | (value & MOS_6502::P_NEGATIVE);
+			if (flags != 0)
+			{
+				as.aluImm(OR, REG_P, flags);
+			}
+		}
+
+		void callHandler(Byte opcode, Word operand, Word pc, bool count_extra_cycles = true)
+		{
+			spill();
+			as.storeWord(REG_CPU, PC_OFFSET, pc);
+			as.mov64(RDI, REG_CPU);
+			as.mov64(RSI, REG_MEM);
+			as.movImm(RDX, operand);
+			as.movImm64(RAX, reinterpret_cast<std::uint64_t>(ops::DECODED_HANDLERS[opcode]));
+			as.call(RAX);
+			if (count_extra_cycles)
+			{
+				as.movzxByte(RAX, RAX);
+				as.addStack(RAX);
+			}
+			reload();
+		}
+
+		// leaves the block at next if the guest just wrote to the pages holding it
+		void checkCode(Word next)
+		{
+			as.cmpDword(REG_MEM, GENERATION_OFFSET + block.first_page * 4, block.first_generation);
+			stale_exits.push_back({as.jcc(CC_NE), next, elapsed});
+			if (block.last_page != block.first_page)
+			{
+				as.cmpDword(REG_MEM, GENERATION_OFFSET + block.last_page * 4, block.last_generation);
+				stale_exits.push_back({as.jcc(CC_NE), next, elapsed});
+			}
+		}
+
+		void exitTo(Word pc, std::uint32_t cycles)
+		{
+			as.storeWord(REG_CPU, PC_OFFSET, pc);
+			leave(cycles);
+		}
+
+		// cycles is everything known at translation time, the slot already holds the rest
+		void leave(std::uint32_t cycles)
+		{
+			as.addStack(cycles);
+			exits.push_back(as.jmp());
+		}
+
+		// clobbers eax
+		void spill()
+		{
+			for (int i = 0; i < 3; ++i)
+			{
+				as.storeByte(REG_CPU, REGISTER_OFFSETS[i], GUEST_REGISTERS[i]);
+			}
+
+			// MOS_6502::setP()
+			as.storeByte(REG_CPU, NEGATIVE_OFFSET, REG_P);
+			as.movzxByte(RAX, REG_P);
+			as.aluImm(AND, RAX, Byte(~LAZY_FLAGS));
+			as.storeByte(REG_CPU, STATUS_OFFSET, RAX);
+			as.movzxByte(RAX, REG_P);
+			as.shlImm(RAX, 1);
+			as.storeByte(REG_CPU, OVERFLOW_OFFSET, RAX);
+			as.movzxByte(RAX, REG_P);
+			as.aluImm(AND, RAX, MOS_6502::P_ZERO);
+			as.aluImm(XOR, RAX, MOS_6502::P_ZERO);
+			as.storeByte(REG_CPU, ZERO_OFFSET, RAX);
+			as.movzxByte(RAX, REG_P);
+			as.aluImm(AND, RAX, MOS_6502::P_CARRY);
+			as.storeByte(REG_CPU, CARRY_OFFSET, RAX);
+		}
+
+		// clobbers eax
+		void reload()
+		{
+			for (int i = 0; i < 3; ++i)
+			{
+				as.loadByte(GUEST_REGISTERS[i], REG_CPU, REGISTER_OFFSETS[i]);
+			}
+
+			// MOS_6502::P()
+			as.loadByte(REG_P, REG_CPU, STATUS_OFFSET);
+			as.loadByte(RAX, REG_CPU, NEGATIVE_OFFSET);
+			as.aluImm(AND, RAX, MOS_6502::P_NEGATIVE);
+			as.alu(OR, REG_P, RAX);
+			as.loadByte(RAX, REG_CPU, OVERFLOW_OFFSET);
+			as.shrImm32(RAX, 1);
+			as.aluImm(AND, RAX, MOS_6502::P_OVERFLOW);
+			as.alu(OR, REG_P, RAX);
+			as.loadByte(RAX, REG_CPU, ZERO_OFFSET);
+			as.test(RAX, RAX);
+			as.setcc(CC_E, RAX);
+			as.alu(ADD, RAX, RAX); // Z is bit 1
+			as.alu(OR, REG_P, RAX);
+			as.loadByte(RAX, REG_CPU, CARRY_OFFSET);
+			as.alu(OR, REG_P, RAX);
+		}
+
+		struct SlowWrite
+		{
+			Byte *jump;
+			Byte *resume;
+			Word address; // in rsi when indexed
+			std::uint32_t length;
+			bool indexed;
+		};
+
+		struct StaleExit
+		{
+			Byte *jump;
+			Word pc;
+			std::uint32_t cycles;
+		};
+
+		Assembler as;
+		const Block &block;
+		const Memory &mem;
+		std::vector<Byte *> exits; // jumps to the epilogue
+		std::vector<StaleExit> stale_exits;
+		std::vector<SlowWrite> slow_writes;
+		std::uint32_t elapsed = 0; // base cycles of the instructions translated so far
+	};
+}
+
+Jit::~Jit()
+{
+	if (arena != nullptr)
+	{
+		munmap(arena, ARENA_SIZE);
+	}
+}
+
+NativeBlock Jit::compile(const Block &block, Word pc, const BlockCache &cache, const Instruction *instruction_map,
+						 const Memory &mem)
+{
+	if (unavailable || block.length > BlockCache::MAX_BLOCK_LENGTH || full())
+	{
+		return nullptr;
+	}
+
+	if (arena == nullptr)
+	{
+		void *memory = mmap(nullptr, ARENA_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (memory == MAP_FAILED)
+		{
+			unavailable = true; // e.g. W^X enforced, keep interpreting
+			return nullptr;
+		}
+		arena = static_cast<Byte *>(memory);
+	}
+
+	Byte *code = arena + used;
+	Translator translator(code, block, mem);
+	translator.prologue();
+
+	Word address = pc;
+	for (std::size_t i = 0; i < block.length; ++i)
+	{
+		const DecodedInstruction &decoded = cache.instructions[block.first + i];
+		Word next = address + instruction_map[decoded.opcode].args_count;
+		translator.instruction(decoded.opcode, decoded.operand, address, next, decoded.cycles, i + 1 == block.length);
+		address = next;
+	}
+
+	translator.epilogue();
+	used += translator.size();
+	return reinterpret_cast<NativeBlock>(code);
+}
+
+#else
+
+Jit::~Jit() {}
+
+NativeBlock Jit::compile(const Block &, Word, const BlockCache &, const Instruction *, const Memory &)
+{
+	return nullptr;
+}
+
+#endif
@@ -0,0 +1,62 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include "types.h"
+#include "block_cache.h"
+#include <cstddef>
+#include <cstdint>
+
+// native code generation is only implemented for x86-64 Linux, everywhere else Engine::JIT interprets
+#if defined(__x86_64__) && defined(__linux__)
+#define MOS6502_JIT 1
+#else
+#define MOS6502_JIT 0
+#endif
+
+struct Instruction;
+
+/*
+ * Translates hot basic blocks into x86-64 code, used by Engine::JIT.
+ * Inside a block the guest A/X/Y and P, packed from the lazy flags, live in host registers.
+ * Simple loads, stores, transfers, flag operations, arithmetic and branches are emitted inline,
+ * every other instruction calls its ops:: handler with the registers spilled around the call.
+ * Only accesses to plain pages (Memory::isPlain()) are inlined, so translations are only valid
+ * for the bus layout they were compiled against.
+ * Translated code checks the write generations of its own pages after every write and
+ * leaves the block as soon as they change, so self-modifying code stays correct.
+ */
+class Jit
+{
+public:
+    Jit() = default;
+    ~Jit();
+    Jit(const Jit &) = delete;
+    Jit &operator=(const Jit &) = delete;
+
+    // nullptr if the block can't be translated on this host
+    NativeBlock compile(const Block &block, Word pc, const BlockCache &cache, const Instruction *instruction_map,
+                        const Memory &mem);
+
+    // true once the arena can't be trusted to fit another block
+    bool full() const { return used + MAX_CODE_PER_BLOCK > ARENA_SIZE; }
+
+    // forgets every translation, blocks still pointing into the arena have to be dropped first
+    void clear() { used = 0; }
+
+    std::size_t codeSize() const { return used; }
+
+    std::uint32_t hot_threshold = HOT_THRESHOLD;
+    std::uint32_t layout_generation = 0; // Memory::layout_generation the translations were compiled against
+
+    constexpr static std::uint32_t HOT_THRESHOLD = 16; // executions before a block gets translated
+    constexpr static Byte MAX_INVALIDATIONS = 4;       // code modified more often than this stays interpreted
+    constexpr static std::size_t ARENA_SIZE = 8 << 20;
+    constexpr static std::size_t MAX_CODE_PER_BLOCK = 256 + 320 * BlockCache::MAX_BLOCK_LENGTH;
+
+private:
+    Byte *arena = nullptr; // mapped on the first compile
+    std::size_t used = 0;
+    bool unavailable = !MOS6502_JIT;
+};
+
+#endif // JIT_H
@@ -1,35 +1,291 @@
 #include "mos6502.h"
-#include <fstream> 
-#include <iostream> 
+#include "audio.h"
+#include "block_device.h"
+#include "framebuffer.h"
+#include "rom_image.h"
+#include "serial_port.h"
+#include <cstdlib>
+#include <iostream>
+#include <optional>
+#include <string>
 
-int main(int argc, char* argv[]) 
+/*
+ * Runs one ROM image and prints the final cpu state.
+ *
+ * usage: mos_6502_emulator <rom.bin> [--load ADDR] [--entry ADDR] [--clock HZ] [--cycles N] [--engine NAME]
+ *                          [--acia ADDR] [--serial stdio|pty|FILE]
+ *                          [--screen ADDR] [--screen-size WxH] [--frames PATTERN] [--frames-shared FILE]
+ *                          [--audio ADDR] [--wav FILE] [--disk ADDR] [--disk-image FILE]
+ *
+ * The image is mapped read-only at --load ($8000 by default) without being copied, execution
+ * starts at --entry (the load address by default). Running off the end of the image stops the
+ * run: a DONE is placed after it when that byte is RAM, and the rest of its last page reads as
+ * BRK, which stops the run too. --clock 0 runs as fast as the host allows, --cycles stops the
+ * run at the first block boundary past that many cycles.
+ * Engines: table, threaded, blocks, jit, aot. aot runs the image recompiled by mos6502_add_aot()
+ * into this executable, if one matches the ROM, and interprets everything else.
+ * --acia maps a 6551 at ADDR (its page) wired to IRQ, talking to stdin and stdout unless --serial
+ * says otherwise: a new pseudo terminal, whose name goes to stderr, or output into FILE.
+ * --screen maps a framebuffer (128x64 unless --screen-size) at ADDR. Its changed frames go to
+ * PPM files named by --frames, a pattern with one frame number like "out/%06u.ppm", or into a
+ * shared RGB mapping.
+ * --audio maps the sound registers at ADDR, --wav records them at 44.1 kHz.
+ * --disk maps a block storage controller at ADDR wired to IRQ, on the image --disk-image names.
+ * Devices are only created when their option is given.
+ */
+static void usage()
 {
-    Emulator emulator;
+    std::cerr << "usage: mos_6502_emulator <rom.bin> [--load ADDR] [--entry ADDR] [--clock HZ] [--cycles N] "
+                 "[--engine table|threaded|blocks|jit|aot] [--acia ADDR] [--serial stdio|pty|FILE] "
+                 "[--screen ADDR] [--screen-size WxH] [--frames PATTERN] [--frames-shared FILE] "
+                 "[--audio ADDR] [--wav FILE] [--disk ADDR] [--disk-image FILE]"
+              << std::endl;
+}
+
+static bool parseEngine(const std::string &name, Engine &engine)
+{
+    if (name == "table")
+    {
+        engine = Engine::TABLE;
+    }
+    else if (name == "threaded")
+    {
+        engine = Engine::THREADED;
+    }
+    else if (name == "blocks")
+    {
+        engine = Engine::BLOCK_CACHE;
+    }
+    else if (name == "jit")
+    {
+        engine = Engine::JIT;
+    }
+    else if (name == "aot")
+    {
+        engine = Engine::AOT;
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        usage();
+        return 1;
+    }
+
+    std::string input = argv[1];
+    Word load = Memory::ROM_START;
+    long entry = -1;
+    double clock_hz = CLOCK_HZ;
+    std::uint64_t budget = std::numeric_limits<std::uint64_t>::max();
+    Engine engine = Engine::TABLE;
+    long acia_address = -1;
+    std::string serial = "stdio";
+    long screen_address = -1;
+    unsigned screen_width = 128, screen_height = 64;
+    std::string frames, frames_shared;
+    long audio_address = -1;
+    std::string wav;
+    long disk_address = -1;
+    std::string disk_image;
+
+    for (int i = 2; i < argc; ++i)
+    {
+        std::string option = argv[i];
+        if (i + 1 >= argc)
+        {
+            usage();
+            return 1;
+        }
+
+        std::string value = argv[++i];
+        if (option == "--load")
+        {
+            load = (Word)std::strtoul(value.c_str(), nullptr, 0);
+        }
+        else if (option == "--entry")
+        {
+            entry = (Word)std::strtoul(value.c_str(), nullptr, 0);
+        }
+        else if (option == "--clock")
+        {
+            clock_hz = std::strtod(value.c_str(), nullptr);
+        }
+        else if (option == "--cycles")
+        {
+            budget = std::strtoull(value.c_str(), nullptr, 0);
+        }
+        else if (option == "--acia")
+        {
+            acia_address = (Word)std::strtoul(value.c_str(), nullptr, 0);
+        }
+        else if (option == "--serial")
+        {
+            serial = value;
+        }
+        else if (option == "--screen")
+        {
+            screen_address = (Word)std::strtoul(value.c_str(), nullptr, 0);
+        }
+        else if (option == "--screen-size")
+        {
+            char *height = nullptr;
+            screen_width = unsigned(std::strtoul(value.c_str(), &height, 10));
+            screen_height = *height == 'x' ? unsigned(std::strtoul(height + 1, nullptr, 10)) : 0;
+        }
+        else if (option == "--frames")
+        {
+            frames = value;
+        }
+        else if (option == "--frames-shared")
+        {
+            frames_shared = value;
+        }
+        else if (option == "--audio")
+        {
+            audio_address = (Word)std::strtoul(value.c_str(), nullptr, 0);
+        }
+        else if (option == "--wav")
+        {
+            wav = value;
+        }
+        else if (option == "--disk")
+        {
+            disk_address = (Word)std::strtoul(value.c_str(), nullptr, 0);
+        }
+        else if (option == "--disk-image")
+        {
+            disk_image = value;
+        }
+        else if (option != "--engine" || !parseEngine(value, engine))
+        {
+            usage();
+            return 1;
+        }
+    }
+
+    RomImage image;
+    if (!image.open(input))
+    {
+        std::cerr << "Cannot open " << input << std::endl;
+        return 1;
+    }
+
+    Emulator emulator(engine);
     Emulator::testing = false;
-    
-    std::string inputFile;
-    std::cout << "Enter binary file: "; 
-    std::cin >> inputFile; 
+    if (!emulator.mapROM(image.data(), image.size(), load))
+    {
+        return 1;
+    }
+
+    // like the DONE the loader used to append, dropped by the bus when that byte is ROM
+    if (std::size_t(load) + image.size() <= WORD_MAX)
+    {
+        emulator.mem.writeByte(Word(load + image.size()), 0x02);
+    }
+
+    if (engine == Engine::AOT)
+    {
+        const AotImage *aot = findAotImage(image.data(), image.size(), load);
+        if (aot != nullptr)
+        {
+            emulator.aot.attach(*aot);
+        }
+        else
+        {
+            std::cerr << "No ahead-of-time image of " << input << " is linked in, interpreting it" << std::endl;
+        }
+    }
+
+    emulator.cpu.program_counter = entry >= 0 ? Word(entry) : load;
+    emulator.pacer.clock_hz = clock_hz > 0 ? clock_hz : CLOCK_HZ;
+    emulator.pacer.turbo = clock_hz <= 0;
+
+    std::optional<Acia> acia;
+    std::optional<SerialPort> port;
+    if (acia_address >= 0)
+    {
+        acia.emplace(emulator);
+        port.emplace(*acia);
+        emulator.mem.mapDevice(Byte(acia_address >> 8), 1, *acia);
+        bool started = serial == "stdio" ? port->startStdio() : serial == "pty" ? port->startPty() : port->startFile(serial);
+        if (!started)
+        {
+            std::cerr << "Cannot open serial port " << serial << std::endl;
+            return 1;
+        }
+        if (serial == "pty")
+        {
+            std::cerr << "serial: " << port->name() << std::endl;
+        }
+    }
 
-    /* Create the program*/
-    std::ifstream infile(inputFile, std::ios_base::binary);
-    if (!infile.is_open())
+    std::optional<Framebuffer> screen;
+    if (screen_address >= 0)
     {
-        std::cout << "Invalid file entered!" << std::endl; 
-        return 1; 
+        screen.emplace(emulator, screen_width, screen_height);
+        if (screen->size() == 0 || screen->size() > 0x10000 - std::size_t(screen_address & 0xFF00))
+        {
+            usage();
+            return 1;
+        }
+        screen->map(Byte(screen_address >> 8));
+        bool started = !frames.empty() ? screen->startPpm(frames) : frames_shared.empty() || screen->startShared(frames_shared);
+        if (!started)
+        {
+            std::cerr << "Cannot open " << (frames.empty() ? frames_shared : frames) << std::endl;
+            return 1;
+        }
     }
 
-    std::vector<char> cbuf{std::istreambuf_iterator<char>(infile),
-                            std::istreambuf_iterator<char>()};
-    std::vector<Byte> buf(begin(cbuf), end(cbuf));
-    buf.push_back(0x02); // EOP
+    std::optional<Audio> audio;
+    if (audio_address >= 0)
+    {
+        audio.emplace(emulator);
+        emulator.mem.mapDevice(Byte(audio_address >> 8), 1, *audio);
+        if (!wav.empty() && !audio->openWav(wav))
+        {
+            std::cerr << "Cannot open " << wav << std::endl;
+            return 1;
+        }
+    }
 
-    std::cout << "=====INITIAL=====\n";
-    std::cout << emulator.cpu.to_string() << std::endl;
-    emulator.loadROM(buf);
-    emulator.run();
+    std::optional<BlockDevice> disk;
+    if (disk_address >= 0)
+    {
+        disk.emplace(emulator);
+        emulator.mem.mapDevice(Byte(disk_address >> 8), 1, *disk);
+        if (!disk_image.empty() && !disk->open(disk_image))
+        {
+            std::cerr << "Cannot open " << disk_image << std::endl;
+            return 1;
+        }
+    }
+
+    emulator.run(budget);
+    if (port)
+    {
+        port->stop();
+    }
+    if (screen)
+    {
+        screen->stop();
+    }
+    if (audio)
+    {
+        audio->closeWav();
+    }
+    if (disk)
+    {
+        disk->close();
+    }
 
-    std::cout << "====FINAL=====\n";
-    std::cout << emulator.cpu.to_string() << std::endl;
-    return 0;    
-}
\ No newline at end of file
+    std::cout << emulator.cpu.to_string() << "  cycles: " << std::dec << emulator.cycles << std::endl;
+    return 0;
+}
@@ -0,0 +1,87 @@
+#include "mapper.h"
+
+std::size_t Mapper::addWindow(Byte first_page, std::size_t pages, std::size_t bank)
+{
+	windows.push_back({first_page, pages, 0});
+	switchBank(windows.size() - 1, bank);
+	return windows.size() - 1;
+}
+
+void Mapper::switchBank(std::size_t window, std::size_t bank)
+{
+	Window &target = windows[window];
+	if (banks(window) == 0)
+	{
+		return; // the image doesn't even fill one bank
+	}
+
+	target.bank = bank % banks(window);
+	const Byte *base = image + target.bank * (target.pages << 8);
+	for (std::size_t page = 0; page < target.pages && target.first_page + page < 0x100; ++page)
+	{
+		Byte mapped = Byte(target.first_page + page);
+		mem.setPage(mapped, base + (page << 8), nullptr, register_pages[mapped] ? this : nullptr);
+	}
+	switches++;
+}
+
+void Mapper::mapRegisters(Word first, Word last)
+{
+	registers_first = first;
+	registers_last = last;
+	for (unsigned page = first >> 8; page <= unsigned(last >> 8); ++page)
+	{
+		if (!register_pages[page])
+		{
+			register_pages[page] = true;
+			passthrough[page] = mem.write_pages[page];
+			mem.setPage(Byte(page), mem.read_pages[page], nullptr, this);
+		}
+	}
+}
+
+// only called for register pages that had nothing to read, the data bus floats
+Byte Mapper::read(Word)
+{
+	return 0;
+}
+
+void Mapper::write(Word address, Byte value)
+{
+	if (address >= registers_first && address <= registers_last)
+	{
+		registerWrite(address, value);
+		return;
+	}
+
+	Byte *page = passthrough[address >> 8];
+	if (page != nullptr)
+	{
+		page[address & 0xFF] = value;
+		mem.noteWrite(address);
+	}
+}
+
+void Mapper::saveState(std::vector<Byte> &out) const
+{
+	std::size_t at = out.size();
+	out.resize(at + windows.size() * 4);
+	for (std::size_t window = 0; window < windows.size(); ++window)
+	{
+		putLittleEndian(&out[at + window * 4], windows[window].bank, 4);
+	}
+}
+
+bool Mapper::loadState(const Byte *data, std::size_t size)
+{
+	if (size != windows.size() * 4)
+	{
+		return false;
+	}
+
+	for (std::size_t window = 0; window < windows.size(); ++window)
+	{
+		switchBank(window, std::size_t(getLittleEndian(data + window * 4, 4)));
+	}
+	return true;
+}
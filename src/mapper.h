@@ -0,0 +1,76 @@
+#ifndef MAPPER_H
+#define MAPPER_H
+
+#include "types.h"
+#include "components.h"
+#include <cstddef>
+#include <vector>
+
+/*
+ * Bank switching for ROM images bigger than the address space.
+ * A window is a run of pages that shows one bank of the image. The image is never copied,
+ * switching a bank points the window's pages at another part of it, so a switch costs one
+ * page table update per page no matter how big the image is.
+ * Writes to the register range reach registerWrite(), that is where a concrete mapper decides
+ * what to switch. The image and the mapper have to stay alive while they are mapped.
+ */
+class Mapper : public Device
+{
+public:
+    Mapper(Memory &mem, const Byte *image, std::size_t size) : mem(mem), image(image), size(size) {}
+
+    // banks are as big as the window, returns the index switchBank() takes
+    std::size_t addWindow(Byte first_page, std::size_t pages, std::size_t bank = 0);
+    void switchBank(std::size_t window, std::size_t bank); // wraps around like the unconnected high bits on a cartridge
+
+    std::size_t bank(std::size_t window) const { return windows[window].bank; }
+    std::size_t banks(std::size_t window) const { return size / (windows[window].pages << 8); }
+
+    // the pages keep reading whatever is mapped on them, writes outside of [first, last] still land where they did
+    void mapRegisters(Word first, Word last);
+
+    Byte read(Word address) override;
+    void write(Word address, Byte value) override;
+
+    // the bank of every window, the windows themselves are set up by whoever maps the mapper
+    void saveState(std::vector<Byte> &out) const override;
+    bool loadState(const Byte *data, std::size_t size) override;
+
+    std::size_t switches = 0;
+
+protected:
+    virtual void registerWrite(Word address, Byte value) = 0;
+
+private:
+    struct Window
+    {
+        Byte first_page;
+        std::size_t pages;
+        std::size_t bank;
+    };
+
+    Memory &mem;
+    const Byte *image;
+    std::size_t size;
+    std::vector<Window> windows;
+
+    Word registers_first = 1;
+    Word registers_last = 0;
+    bool register_pages[0x100] = {};
+    Byte *passthrough[0x100] = {}; // write pointers the register pages had before
+};
+
+/* Discrete logic boards like UxROM, every write to the registers selects the bank of one window */
+class LatchMapper : public Mapper
+{
+public:
+    using Mapper::Mapper;
+
+    std::size_t window = 0;
+    Byte mask = 0xFF;
+
+protected:
+    void registerWrite(Word, Byte value) override { switchBank(window, value & mask); }
+};
+
+#endif // MAPPER_H
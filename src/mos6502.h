@@ -2,40 +2,50 @@
 #define MOS_6502_H
 
 #include "types.h"
-#include <string>
-#include <functional>
+#include <cstdint>
+#include <limits>
+#include <memory>
 #include <vector>
+#include <type_traits>
 
 #define CHECK_REGISTER(reg, val) ((reg & val) == val)
 
 #include "components.h"
+#include "opcodes.h"
+#include "instructions.h"
+#include "block_cache.h"
+#include "jit.h"
+#include "aot.h"
+#include "pacer.h"
+#include "scheduler.h"
+#include "interrupts.h"
+
+// how run() executes instructions, cycle() always steps through the handler table
+enum class Engine
+{
+  TABLE,       // one indirect call per instruction through ops::HANDLERS
+  THREADED,    // direct-threaded loop, registers stay in locals until it exits
+  BLOCK_CACHE, // runs predecoded basic blocks, invalidated when their code pages are written
+  JIT,         // BLOCK_CACHE, with hot blocks translated to x86-64 code where supported
+  AOT,         // blocks of the attached AotImage, everything else through cycle()
+};
 
-// instructions have different address modes
-enum class AddressMode
+// why runFor(), runUntil() or runInstructions() returned
+enum class StopReason
 {
-  IMPLICIT,
-  ACCUMULATOR,
-  IMMEDIATE,
-  ZERO_PAGE,
-  ZERO_PAGE_AND_X,
-  ZERO_PAGE_AND_Y,
-  RELATIVE,
-  ABSOLUTE,
-  ABSOLUTE_AND_X,
-  ABSOLUTE_AND_Y,
-  INDIRECT,         // pointer to pointer
-  INDEXED_INDIRECT, // pointer to pointer (8 bit) + x,
-  INDIRECT_INDEXED, // pointer to pointer(16 bit) + y
+  HALTED,             // DONE or an unknown opcode
+  TRAPPED,            // BRK outside of the test suite
+  CYCLE_BUDGET,       // runFor() spent its cycles
+  INSTRUCTION_BUDGET, // runInstructions() ran its instructions
+  REACHED_PC,         // runUntil() got to its address
 };
 
-struct Instruction
+/* A checkpoint of the registers, the cycle counter and memory[], the pages are shared copy-on-write */
+struct Snapshot
 {
-  std::string name;
-  Byte opcode;
-  std::size_t args_count;
-  std::size_t cycles;
-  AddressMode addressing_mode;
-  std::function<void(int)> implementation;
+  MOS_6502 cpu;
+  std::uint64_t cycles = 0;
+  std::array<SharedPage, 0x100> pages;
 };
 
 class Emulator
@@ -44,125 +54,79 @@ public:
   static bool testing;
   struct MOS_6502 cpu;
   struct Memory mem;
-  Instruction instruction_map[0xFF];
-
-  explicit Emulator()
+  constexpr static const Instruction *instruction_map = INSTRUCTIONS.data(); // shared, nothing to build per instance
+  Engine engine;
+  BlockCache block_cache;
+  Jit jit;
+  AotRuntime aot;
+  std::uint64_t cycles = 0; // every cycle run so far, page crossing and taken branch penalties included
+  Scheduler scheduler{cycles}; // timed device events, due ones run between instructions on every engine
+  InterruptLines interrupts;   // may be driven from other threads
+  std::uint64_t interrupt_poll_cycles = 10'000; // the longest run() or batch goes without looking at the interrupt lines
+  Pacer pacer;              // keeps run() at pacer.clock_hz outside of the test suite
+
+  explicit Emulator(Engine engine = Engine::TABLE) : engine(engine)
   {
-    initInstructionMap();
+    scheduler.horizon = &run_limit;
+    interrupts.horizon = &run_limit;
   }
 
 public:
-  void loadROM(const std::vector<Byte> &program);
-  void run();
+  // at ROM_START, write_protect drops guest writes to its pages. Bigger images go through a Mapper
+  bool loadROM(const std::vector<Byte> &program, bool write_protect = false);
+  // read-only pages straight on image (a RomImage), which has to outlive them. Copied if address isn't on a page boundary
+  bool mapROM(const Byte *image, std::size_t size, Word address = Memory::ROM_START);
+
+  // as fast as possible in the test suite, paced one slice at a time otherwise.
+  // Stops at the first block boundary past the budget, false once the program stops
+  bool run(std::uint64_t cycle_budget = std::numeric_limits<std::uint64_t>::max());
   bool cycle(); 
+  bool runBlock(); // one basic block for BLOCK_CACHE and JIT, false once the program stops
+
+  /*
+   * Batch execution with a hard budget, never throttled.
+   * These step through the handler table in a loop of their own whatever the engine,
+   * so the budget holds to the instruction; runFor() may overshoot by the last one.
+   */
+  StopReason runFor(std::uint64_t cycle_budget);
+  StopReason runUntil(Word pc); // stops the next time pc is reached, after at least one instruction
+  StopReason runInstructions(std::uint64_t count);
+
+  /*
+   * Checkpoints. A snapshot only copies the pages written since the last one, restore() and
+   * fork() share its pages until the machine writes to them.
+   * Device state, mappings, scheduled events, the engine caches and the pacer are not part of it.
+   */
+  Snapshot snapshot();
+  void restore(const Snapshot &snapshot);
+  std::unique_ptr<Emulator> fork(); // a new machine on the same engine, from a snapshot of this one
 
 private:
-  void handleArithmeticFlagChanges(Byte value);
-
-  /* Addressing modes*/
-  Byte *handleAddressing(int opcode);
-  Byte *accumulator();
-  Byte *immediate();
-  Byte *zeroPage();
-  Byte *zeroPageX();
-  Byte *zeroPageY();
-  Byte *relative();
-  Byte *absolute();
-  Byte *absoluteX();
-  Byte *absoluteY();
-  Byte *indirect();
-  Byte *indexedIndirect();
-  Byte *indirectIndexed();
-
-  void initInstructionMap();
-  /* No operation */
-  void NOP(int opcode);
-
-  /* OR with accumulator */
-  void ORA(int opcode);
-
-  /* Load into registers */
-  void LDA(int opcode);
-  void LDX(int opcode);
-  void LDY(int opcode);
-
-  /* Transfer instructions */
-  void TAX(int opcode); // Transfer accumulator to X
-  void TXA(int opcode); // Transfer X to accumulator
-  void TAY(int opcode); // Transfer accumulator to Y
-  void TSX(int opcode); // Transfer stack pointer to X
-  void TXS(int opcode); // Transfer X to stack pointer
-  void TYA(int opcode); // Transfer Y to accumulator
-
-  /* Increment and decrement */
-  void INX(int opcode);
-  void INY(int opcode);
-  void DEX(int opcode);
-  void DEY(int opcode);
-  void INC(int opcode);
-  void DEC(int opcode);
-
-  /* Break (interrupt) */
-  void BRK(int opcode);
-
-  /* Store registers to memory */
-  void STA(int opcode);
-  void STX(int opcode);
-  void STY(int opcode);
-
-  /* Jump and subroutine */
-  void JMP(int opcode);
-  void JSR(int opcode);
-  void RTS(int opcode);
-
-  /* Stack operations */
-  void PHA(int opcode);
-  void PLA(int opcode);
-  void PHP(int opcode);
-  void PLP(int opcode);
-
-  /* Logical operations */
-  void AND(int opcode);
-  void EOR(int opcode);
-
-  /* Arithmetic */
-  void ADC(int opcode);
-  void SBC(int opcode);
-
-  /* Shift and rotate */
-  void ASL(int opcode);
-  void LSR(int opcode);
-  void ROL(int opcode);
-  void ROR(int opcode);
-
-  /* Comparison */
-  void CMP(int opcode);
-  void CPX(int opcode);
-  void CPY(int opcode);
-
-  /* Branching */
-  void branchIf(bool condition, Byte* to);
-  void BCC(int opcode);
-  void BCS(int opcode);
-  void BEQ(int opcode);
-  void BMI(int opcode);
-  void BNE(int opcode);
-  void BPL(int opcode);
-  void BVC(int opcode);
-  void BVS(int opcode);
-  void BIT(int opcode);
-
-  /* Status flag control */
-  void CLC(int opcode);
-  void CLD(int opcode);
-  void CLI(int opcode);
-  void CLV(int opcode);
-  void SEC(int opcode);
-  void SED(int opcode);
-  void SEI(int opcode);
-
-  /* System */
-  void RTI(int opcode);
+  std::uint64_t run_limit = 0; // where the running engine or batch stops
+
+  // at most one interrupt sequence, 7 cycles, if a line wants one
+  void serviceInterrupts()
+  {
+    if (interrupts.pending() != 0)
+    {
+      takeInterrupt();
+    }
+  }
+  void takeInterrupt();
+
+  template <StopReason Budget>
+  StopReason runBatch(std::uint64_t limit);
+
+  // runs the engine from one scheduled event to the next, false once the program stops
+  bool runEvents(std::uint64_t cycle_limit);
+
+  // the engines stop at the first block boundary past cycle_limit, false once the program stops.
+  // They are handed run_limit, which an event scheduled in the middle of a run can still pull in
+  bool runEngine(const std::uint64_t &cycle_limit);
+  bool runTable(const std::uint64_t &cycle_limit);
+  bool runThreaded(const std::uint64_t &cycle_limit);
+  bool runBlocks(const std::uint64_t &cycle_limit);
+  bool runAot(const std::uint64_t &cycle_limit);
 };
 
 // 256 insturction set architecture
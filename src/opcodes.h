@@ -0,0 +1,866 @@
+#ifndef OPCODES_H
+#define OPCODES_H
+
+#include "types.h"
+#include "components.h"
+#include <array>
+
+// instructions have different address modes
+enum class AddressMode
+{
+  IMPLICIT,
+  ACCUMULATOR,
+  IMMEDIATE,
+  ZERO_PAGE,
+  ZERO_PAGE_AND_X,
+  ZERO_PAGE_AND_Y,
+  RELATIVE,
+  ABSOLUTE,
+  ABSOLUTE_AND_X,
+  ABSOLUTE_AND_Y,
+  INDIRECT,         // pointer to pointer
+  INDEXED_INDIRECT, // pointer to pointer (8 bit) + x,
+  INDIRECT_INDEXED, // pointer to pointer(16 bit) + y
+};
+
+/* (opcode, operation, addressing mode) for all 151 official opcodes */
+#define OFFICIAL_OPCODES(X) \
+  X(0x69, ADC, IMMEDIATE)        \
+  X(0x65, ADC, ZERO_PAGE)        \
+  X(0x75, ADC, ZERO_PAGE_AND_X)  \
+  X(0x6D, ADC, ABSOLUTE)         \
+  X(0x7D, ADC, ABSOLUTE_AND_X)   \
+  X(0x79, ADC, ABSOLUTE_AND_Y)   \
+  X(0x61, ADC, INDEXED_INDIRECT) \
+  X(0x71, ADC, INDIRECT_INDEXED) \
+  X(0x29, AND, IMMEDIATE)        \
+  X(0x25, AND, ZERO_PAGE)        \
+  X(0x35, AND, ZERO_PAGE_AND_X)  \
+  X(0x2D, AND, ABSOLUTE)         \
+  X(0x3D, AND, ABSOLUTE_AND_X)   \
+  X(0x39, AND, ABSOLUTE_AND_Y)   \
+  X(0x21, AND, INDEXED_INDIRECT) \
+  X(0x31, AND, INDIRECT_INDEXED) \
+  X(0x0A, ASL, ACCUMULATOR)      \
+  X(0x06, ASL, ZERO_PAGE)        \
+  X(0x16, ASL, ZERO_PAGE_AND_X)  \
+  X(0x0E, ASL, ABSOLUTE)         \
+  X(0x1E, ASL, ABSOLUTE_AND_X)   \
+  X(0x90, BCC, RELATIVE)         \
+  X(0xB0, BCS, RELATIVE)         \
+  X(0xF0, BEQ, RELATIVE)         \
+  X(0x30, BMI, RELATIVE)         \
+  X(0xD0, BNE, RELATIVE)         \
+  X(0x10, BPL, RELATIVE)         \
+  X(0x50, BVC, RELATIVE)         \
+  X(0x70, BVS, RELATIVE)         \
+  X(0x24, BIT, ZERO_PAGE)        \
+  X(0x2C, BIT, ABSOLUTE)         \
+  X(0x00, BRK, IMPLICIT)         \
+  X(0x18, CLC, IMPLICIT)         \
+  X(0xD8, CLD, IMPLICIT)         \
+  X(0x58, CLI, IMPLICIT)         \
+  X(0xB8, CLV, IMPLICIT)         \
+  X(0x38, SEC, IMPLICIT)         \
+  X(0xF8, SED, IMPLICIT)         \
+  X(0x78, SEI, IMPLICIT)         \
+  X(0xC9, CMP, IMMEDIATE)        \
+  X(0xC5, CMP, ZERO_PAGE)        \
+  X(0xD5, CMP, ZERO_PAGE_AND_X)  \
+  X(0xCD, CMP, ABSOLUTE)         \
+  X(0xDD, CMP, ABSOLUTE_AND_X)   \
+  X(0xD9, CMP, ABSOLUTE_AND_Y)   \
+  X(0xC1, CMP, INDEXED_INDIRECT) \
+  X(0xD1, CMP, INDIRECT_INDEXED) \
+  X(0xE0, CPX, IMMEDIATE)        \
+  X(0xE4, CPX, ZERO_PAGE)        \
+  X(0xEC, CPX, ABSOLUTE)         \
+  X(0xC0, CPY, IMMEDIATE)        \
+  X(0xC4, CPY, ZERO_PAGE)        \
+  X(0xCC, CPY, ABSOLUTE)         \
+  X(0xC6, DEC, ZERO_PAGE)        \
+  X(0xD6, DEC, ZERO_PAGE_AND_X)  \
+  X(0xCE, DEC, ABSOLUTE)         \
+  X(0xDE, DEC, ABSOLUTE_AND_X)   \
+  X(0xCA, DEX, IMPLICIT)         \
+  X(0x88, DEY, IMPLICIT)         \
+  X(0x49, EOR, IMMEDIATE)        \
+  X(0x45, EOR, ZERO_PAGE)        \
+  X(0x55, EOR, ZERO_PAGE_AND_X)  \
+  X(0x4D, EOR, ABSOLUTE)         \
+  X(0x5D, EOR, ABSOLUTE_AND_X)   \
+  X(0x59, EOR, ABSOLUTE_AND_Y)   \
+  X(0x41, EOR, INDEXED_INDIRECT) \
+  X(0x51, EOR, INDIRECT_INDEXED) \
+  X(0xE6, INC, ZERO_PAGE)        \
+  X(0xF6, INC, ZERO_PAGE_AND_X)  \
+  X(0xEE, INC, ABSOLUTE)         \
+  X(0xFE, INC, ABSOLUTE_AND_X)   \
+  X(0xE8, INX, IMPLICIT)         \
+  X(0xC8, INY, IMPLICIT)         \
+  X(0x4C, JMP, ABSOLUTE)         \
+  X(0x6C, JMP, INDIRECT)         \
+  X(0x20, JSR, ABSOLUTE)         \
+  X(0xA9, LDA, IMMEDIATE)        \
+  X(0xA5, LDA, ZERO_PAGE)        \
+  X(0xB5, LDA, ZERO_PAGE_AND_X)  \
+  X(0xAD, LDA, ABSOLUTE)         \
+  X(0xBD, LDA, ABSOLUTE_AND_X)   \
+  X(0xB9, LDA, ABSOLUTE_AND_Y)   \
+  X(0xA1, LDA, INDEXED_INDIRECT) \
+  X(0xB1, LDA, INDIRECT_INDEXED) \
+  X(0xA2, LDX, IMMEDIATE)        \
+  X(0xA6, LDX, ZERO_PAGE)        \
+  X(0xB6, LDX, ZERO_PAGE_AND_Y)  \
+  X(0xAE, LDX, ABSOLUTE)         \
+  X(0xBE, LDX, ABSOLUTE_AND_Y)   \
+  X(0xA0, LDY, IMMEDIATE)        \
+  X(0xA4, LDY, ZERO_PAGE)        \
+  X(0xB4, LDY, ZERO_PAGE_AND_X)  \
+  X(0xAC, LDY, ABSOLUTE)         \
+  X(0xBC, LDY, ABSOLUTE_AND_X)   \
+  X(0x4A, LSR, ACCUMULATOR)      \
+  X(0x46, LSR, ZERO_PAGE)        \
+  X(0x56, LSR, ZERO_PAGE_AND_X)  \
+  X(0x4E, LSR, ABSOLUTE)         \
+  X(0x5E, LSR, ABSOLUTE_AND_X)   \
+  X(0xEA, NOP, IMPLICIT)         \
+  X(0x09, ORA, IMMEDIATE)        \
+  X(0x05, ORA, ZERO_PAGE)        \
+  X(0x15, ORA, ZERO_PAGE_AND_X)  \
+  X(0x0D, ORA, ABSOLUTE)         \
+  X(0x1D, ORA, ABSOLUTE_AND_X)   \
+  X(0x19, ORA, ABSOLUTE_AND_Y)   \
+  X(0x01, ORA, INDEXED_INDIRECT) \
+  X(0x11, ORA, INDIRECT_INDEXED) \
+  X(0x48, PHA, IMPLICIT)         \
+  X(0x08, PHP, IMPLICIT)         \
+  X(0x68, PLA, IMPLICIT)         \
+  X(0x28, PLP, IMPLICIT)         \
+  X(0x2A, ROL, ACCUMULATOR)      \
+  X(0x26, ROL, ZERO_PAGE)        \
+  X(0x36, ROL, ZERO_PAGE_AND_X)  \
+  X(0x2E, ROL, ABSOLUTE)         \
+  X(0x3E, ROL, ABSOLUTE_AND_X)   \
+  X(0x6A, ROR, ACCUMULATOR)      \
+  X(0x66, ROR, ZERO_PAGE)        \
+  X(0x76, ROR, ZERO_PAGE_AND_X)  \
+  X(0x6E, ROR, ABSOLUTE)         \
+  X(0x7E, ROR, ABSOLUTE_AND_X)   \
+  X(0x40, RTI, IMPLICIT)         \
+  X(0x60, RTS, IMPLICIT)         \
+  X(0xE9, SBC, IMMEDIATE)        \
+  X(0xE5, SBC, ZERO_PAGE)        \
+  X(0xF5, SBC, ZERO_PAGE_AND_X)  \
+  X(0xED, SBC, ABSOLUTE)         \
+  X(0xFD, SBC, ABSOLUTE_AND_X)   \
+  X(0xF9, SBC, ABSOLUTE_AND_Y)   \
+  X(0xE1, SBC, INDEXED_INDIRECT) \
+  X(0xF1, SBC, INDIRECT_INDEXED) \
+  X(0x85, STA, ZERO_PAGE)        \
+  X(0x95, STA, ZERO_PAGE_AND_X)  \
+  X(0x8D, STA, ABSOLUTE)         \
+  X(0x9D, STA, ABSOLUTE_AND_X)   \
+  X(0x99, STA, ABSOLUTE_AND_Y)   \
+  X(0x81, STA, INDEXED_INDIRECT) \
+  X(0x91, STA, INDIRECT_INDEXED) \
+  X(0x86, STX, ZERO_PAGE)        \
+  X(0x96, STX, ZERO_PAGE_AND_Y)  \
+  X(0x8E, STX, ABSOLUTE)         \
+  X(0x84, STY, ZERO_PAGE)        \
+  X(0x94, STY, ZERO_PAGE_AND_X)  \
+  X(0x8C, STY, ABSOLUTE)         \
+  X(0xAA, TAX, IMPLICIT)         \
+  X(0xA8, TAY, IMPLICIT)         \
+  X(0xBA, TSX, IMPLICIT)         \
+  X(0x8A, TXA, IMPLICIT)         \
+  X(0x9A, TXS, IMPLICIT)         \
+  X(0x98, TYA, IMPLICIT)
+
+/*
+ * Every official opcode is a pairing of an operation with an addressing mode.
+ * Both are template parameters, so each of the 151 handlers is compiled on its own
+ * with the operand fetch inlined and no runtime switch on the addressing mode.
+ */
+namespace ops
+{
+  // returns the number of extra cycles taken (page crossing, taken branches)
+  using Handler = Byte (*)(MOS_6502 &cpu, Memory &mem);
+  using DecodedHandler = Byte (*)(MOS_6502 &cpu, Memory &mem, Word operand);
+
+  // N and Z both come from the result, they are only put together when P is read
+  inline void handleArithmeticFlagChanges(MOS_6502 &cpu, Byte value)
+  {
+    cpu.negative_result = value;
+    cpu.zero_result = value;
+  }
+
+  // C, V and the flags no instruction computes (I, D)
+  template <Byte Flag>
+  inline void setFlag(MOS_6502 &cpu, bool on)
+  {
+    if constexpr (Flag == MOS_6502::P_CARRY)
+    {
+      cpu.carry_result = on;
+    }
+    else if constexpr (Flag == MOS_6502::P_OVERFLOW)
+    {
+      cpu.overflow_result = on ? 0x80 : 0;
+    }
+    else if (on)
+    {
+      cpu.status |= Flag;
+    }
+    else
+    {
+      cpu.status &= ~Flag;
+    }
+  }
+
+  // one flag of P() without building the rest
+  template <Byte Flag>
+  inline bool testFlag(const MOS_6502 &cpu)
+  {
+    if constexpr (Flag == MOS_6502::P_NEGATIVE)
+    {
+      return cpu.negative_result & 0x80;
+    }
+    else if constexpr (Flag == MOS_6502::P_ZERO)
+    {
+      return cpu.zero_result == 0;
+    }
+    else if constexpr (Flag == MOS_6502::P_CARRY)
+    {
+      return cpu.carry_result;
+    }
+    else if constexpr (Flag == MOS_6502::P_OVERFLOW)
+    {
+      return cpu.overflow_result & 0x80;
+    }
+    else
+    {
+      return cpu.status & Flag;
+    }
+  }
+
+  /*
+   * ADC and SBC. Binary mode is plain arithmetic into the lazy flags, SBC is ADC of the inverted
+   * operand with the carry as an inverted borrow. Decimal mode works one digit at a time and
+   * follows the NMOS behaviour, including the results for invalid BCD digits: ADC takes N and V
+   * from the intermediate sum before the high digit is adjusted and Z from the binary sum, SBC
+   * keeps all of its binary flags.
+   */
+  inline void binaryAdd(MOS_6502 &cpu, Byte operand)
+  {
+    Byte a = cpu.accumulator;
+    unsigned sum = a + operand + cpu.carry_result;
+    Byte value = Byte(sum);
+    cpu.overflow_result = ~(a ^ operand) & (a ^ value); // both operands share a sign the result doesn't have
+    cpu.carry_result = Byte(sum >> 8);
+    cpu.accumulator = value;
+    handleArithmeticFlagChanges(cpu, value);
+  }
+
+  inline void decimalAdd(MOS_6502 &cpu, Byte operand)
+  {
+    Byte a = cpu.accumulator;
+    int carry = cpu.carry_result;
+    int low = (a & 0x0F) + (operand & 0x0F) + carry;
+    if (low >= 0x0A)
+    {
+      low = ((low + 0x06) & 0x0F) + 0x10;
+    }
+    int sum = (a & 0xF0) + (operand & 0xF0) + low;
+    int signed_sum = (SignedByte)(a & 0xF0) + (SignedByte)(operand & 0xF0) + low;
+    cpu.negative_result = Byte(sum);
+    cpu.overflow_result = signed_sum < -128 || signed_sum > 127 ? 0x80 : 0;
+    cpu.zero_result = Byte(a + operand + carry);
+    if (sum >= 0xA0)
+    {
+      sum += 0x60;
+    }
+    cpu.carry_result = sum > 0xFF;
+    cpu.accumulator = Byte(sum);
+  }
+
+  inline void decimalSubtract(MOS_6502 &cpu, Byte operand)
+  {
+    Byte a = cpu.accumulator;
+    int low = (a & 0x0F) - (operand & 0x0F) + cpu.carry_result - 1;
+    if (low < 0)
+    {
+      low = ((low - 0x06) & 0x0F) - 0x10;
+    }
+    int difference = (a & 0xF0) - (operand & 0xF0) + low;
+    if (difference < 0)
+    {
+      difference -= 0x60;
+    }
+    binaryAdd(cpu, Byte(~operand));
+    cpu.accumulator = Byte(difference);
+  }
+
+  FORCE_INLINE Word readWord(Memory &mem, Word low_address, Word high_address)
+  {
+    return (Word)mem.readByte(low_address) | ((Word)mem.readByte(high_address) << 8);
+  }
+
+  /* Number of operand bytes following the opcode */
+  template <AddressMode Mode>
+  constexpr Byte OPERAND_BYTES =
+      Mode == AddressMode::IMPLICIT || Mode == AddressMode::ACCUMULATOR ? 0
+      : Mode == AddressMode::ABSOLUTE || Mode == AddressMode::ABSOLUTE_AND_X ||
+              Mode == AddressMode::ABSOLUTE_AND_Y || Mode == AddressMode::INDIRECT
+          ? 2
+          : 1;
+
+  /* Reads the raw operand bytes, leaving the program counter on the last byte of the instruction */
+  template <AddressMode Mode>
+  FORCE_INLINE Word fetchOperand(MOS_6502 &cpu, Memory &mem)
+  {
+    if constexpr (OPERAND_BYTES<Mode> == 2)
+    {
+      Word low = ++cpu.program_counter;
+      Word high = ++cpu.program_counter;
+      return (Word)mem.fetchByte(low) | ((Word)mem.fetchByte(high) << 8);
+    }
+    else if constexpr (OPERAND_BYTES<Mode> == 1)
+    {
+      return mem.fetchByte(++cpu.program_counter);
+    }
+    else
+    {
+      return 0;
+    }
+  }
+
+  /* Where an operation finds its operand, the accumulator or an address on the bus */
+  template <AddressMode Mode>
+  struct Location
+  {
+    MOS_6502 &cpu;
+    Memory &mem;
+    Word address;
+
+    FORCE_INLINE Byte read() const
+    {
+      if constexpr (Mode == AddressMode::ACCUMULATOR)
+      {
+        return cpu.accumulator;
+      }
+      else if constexpr (Mode == AddressMode::IMMEDIATE)
+      {
+        return Byte(address); // the operand byte itself, fetched once with the instruction
+      }
+      else
+      {
+        return mem.readByte(address);
+      }
+    }
+
+    FORCE_INLINE void write(Byte value) const { mem.writeByte(address, value); }
+
+    // the write of a read-modify-write instruction, old_value is what read() returned
+    FORCE_INLINE void modify(Byte old_value, Byte value) const
+    {
+      if constexpr (Mode == AddressMode::ACCUMULATOR)
+      {
+        cpu.accumulator = value;
+      }
+      else
+      {
+        mem.modifyByte(address, old_value, value);
+      }
+    }
+  };
+
+  /* Addressing modes, turns the raw operand into the location the operation works on */
+  template <AddressMode Mode>
+  FORCE_INLINE Word resolveAddress(MOS_6502 &cpu, Memory &mem, Word operand, bool &page_crossed)
+  {
+    if constexpr (Mode == AddressMode::IMPLICIT || Mode == AddressMode::ACCUMULATOR)
+    {
+      return 0;
+    }
+    else if constexpr (Mode == AddressMode::IMMEDIATE)
+    {
+      return operand;
+    }
+    else if constexpr (Mode == AddressMode::ZERO_PAGE)
+    {
+      return Byte(operand);
+    }
+    else if constexpr (Mode == AddressMode::ZERO_PAGE_AND_X)
+    {
+      return Byte(operand + cpu.X); // simulate zpg round behavior
+    }
+    else if constexpr (Mode == AddressMode::ZERO_PAGE_AND_Y)
+    {
+      return Byte(operand + cpu.Y);
+    }
+    else if constexpr (Mode == AddressMode::RELATIVE)
+    {
+      return Word(cpu.program_counter + (SignedByte)operand);
+    }
+    else if constexpr (Mode == AddressMode::ABSOLUTE)
+    {
+      return operand;
+    }
+    else if constexpr (Mode == AddressMode::ABSOLUTE_AND_X || Mode == AddressMode::ABSOLUTE_AND_Y)
+    {
+      Byte offset = Mode == AddressMode::ABSOLUTE_AND_X ? cpu.X : cpu.Y;
+      page_crossed = (operand & 0xFF00) != ((operand + offset) & 0xFF00);
+      return Word(operand + offset);
+    }
+    else if constexpr (Mode == AddressMode::INDIRECT)
+    {
+      // simulate jump bug, the high byte never leaves the page
+      return readWord(mem, operand, (operand & 0xFF00) | Byte(operand + 1));
+    }
+    else if constexpr (Mode == AddressMode::INDEXED_INDIRECT)
+    {
+      // (zp + x), stays in the zero page
+      Byte zp_address = operand + cpu.X;
+      return readWord(mem, zp_address, Byte(zp_address + 1));
+    }
+    else if constexpr (Mode == AddressMode::INDIRECT_INDEXED)
+    {
+      // (zp) + y, the pointer wraps around in the zero page
+      Word target_address = readWord(mem, Byte(operand), Byte(operand + 1));
+      page_crossed = (target_address & 0xFF00) != ((target_address + cpu.Y) & 0xFF00);
+      return Word(target_address + cpu.Y);
+    }
+  }
+
+  /* Traits every operation inherits and overrides where needed */
+  struct Operation
+  {
+    constexpr static bool PAGE_PENALTY = false; // reads take an extra cycle when indexing crosses a page
+    constexpr static bool WRITES = false;       // writes its operand back to memory
+    constexpr static bool ENDS_BLOCK = false;   // may move the program counter anywhere
+    constexpr static bool BRANCH = false;       // conditional, taking it costs extra cycles
+  };
+
+  /* Operations, apply() gets the Location its addressing mode resolved to */
+  struct NOP : Operation
+  {
+    static void apply(MOS_6502 &, Memory &, auto) {}
+  };
+
+  template <Byte MOS_6502::*Register>
+  struct Load : Operation
+  {
+    constexpr static bool PAGE_PENALTY = true;
+    static void apply(MOS_6502 &cpu, Memory &, auto operand)
+    {
+      cpu.*Register = operand.read();
+      handleArithmeticFlagChanges(cpu, cpu.*Register);
+    }
+  };
+  using LDA = Load<&MOS_6502::accumulator>;
+  using LDX = Load<&MOS_6502::X>;
+  using LDY = Load<&MOS_6502::Y>;
+
+  template <Byte MOS_6502::*Register>
+  struct Store : Operation
+  {
+    constexpr static bool WRITES = true;
+    static void apply(MOS_6502 &cpu, Memory &, auto operand) { operand.write(cpu.*Register); }
+  };
+  using STA = Store<&MOS_6502::accumulator>;
+  using STX = Store<&MOS_6502::X>;
+  using STY = Store<&MOS_6502::Y>;
+
+  template <Byte MOS_6502::*From, Byte MOS_6502::*To, bool FLAGS = true>
+  struct Transfer : Operation
+  {
+    static void apply(MOS_6502 &cpu, Memory &, auto)
+    {
+      cpu.*To = cpu.*From;
+      if constexpr (FLAGS)
+      {
+        handleArithmeticFlagChanges(cpu, cpu.*To);
+      }
+    }
+  };
+  using TAX = Transfer<&MOS_6502::accumulator, &MOS_6502::X>;
+  using TXA = Transfer<&MOS_6502::X, &MOS_6502::accumulator>;
+  using TAY = Transfer<&MOS_6502::accumulator, &MOS_6502::Y>;
+  using TYA = Transfer<&MOS_6502::Y, &MOS_6502::accumulator>;
+  using TSX = Transfer<&MOS_6502::S, &MOS_6502::X>;
+  using TXS = Transfer<&MOS_6502::X, &MOS_6502::S, false>; // the only transfer that leaves the flags alone
+
+  template <Byte MOS_6502::*Register, int Delta>
+  struct Step : Operation
+  {
+    static void apply(MOS_6502 &cpu, Memory &, auto)
+    {
+      cpu.*Register += Delta;
+      handleArithmeticFlagChanges(cpu, cpu.*Register);
+    }
+  };
+  using INX = Step<&MOS_6502::X, 1>;
+  using INY = Step<&MOS_6502::Y, 1>;
+  using DEX = Step<&MOS_6502::X, -1>;
+  using DEY = Step<&MOS_6502::Y, -1>;
+
+  template <int Delta>
+  struct StepMemory : Operation
+  {
+    constexpr static bool WRITES = true;
+    static void apply(MOS_6502 &cpu, Memory &, auto operand)
+    {
+      Byte value = operand.read();
+      Byte result = value + Delta;
+      operand.modify(value, result);
+      handleArithmeticFlagChanges(cpu, result);
+    }
+  };
+  using INC = StepMemory<1>;
+  using DEC = StepMemory<-1>;
+
+  struct ORA : Operation
+  {
+    constexpr static bool PAGE_PENALTY = true;
+    static void apply(MOS_6502 &cpu, Memory &, auto operand)
+    {
+      cpu.accumulator |= operand.read();
+      handleArithmeticFlagChanges(cpu, cpu.accumulator);
+    }
+  };
+
+  struct AND : Operation
+  {
+    constexpr static bool PAGE_PENALTY = true;
+    static void apply(MOS_6502 &cpu, Memory &, auto operand)
+    {
+      cpu.accumulator &= operand.read();
+      handleArithmeticFlagChanges(cpu, cpu.accumulator);
+    }
+  };
+
+  struct EOR : Operation
+  {
+    constexpr static bool PAGE_PENALTY = true;
+    static void apply(MOS_6502 &cpu, Memory &, auto operand)
+    {
+      cpu.accumulator ^= operand.read();
+      handleArithmeticFlagChanges(cpu, cpu.accumulator);
+    }
+  };
+
+  struct ADC : Operation
+  {
+    constexpr static bool PAGE_PENALTY = true;
+    static void apply(MOS_6502 &cpu, Memory &, auto operand)
+    {
+      Byte value = operand.read();
+      if (cpu.status & MOS_6502::P_DECIMAL) [[unlikely]]
+      {
+        decimalAdd(cpu, value);
+      }
+      else
+      {
+        binaryAdd(cpu, value);
+      }
+    }
+  };
+
+  struct SBC : Operation
+  {
+    constexpr static bool PAGE_PENALTY = true;
+    static void apply(MOS_6502 &cpu, Memory &, auto operand)
+    {
+      Byte value = operand.read();
+      if (cpu.status & MOS_6502::P_DECIMAL) [[unlikely]]
+      {
+        decimalSubtract(cpu, value);
+      }
+      else
+      {
+        binaryAdd(cpu, Byte(~value));
+      }
+    }
+  };
+
+  template <Byte MOS_6502::*Register>
+  struct Compare : Operation
+  {
+    constexpr static bool PAGE_PENALTY = true;
+    static void apply(MOS_6502 &cpu, Memory &, auto operand)
+    {
+      Byte value = operand.read();
+      cpu.carry_result = cpu.*Register >= value;
+      handleArithmeticFlagChanges(cpu, Byte(cpu.*Register - value));
+    }
+  };
+  using CMP = Compare<&MOS_6502::accumulator>;
+  using CPX = Compare<&MOS_6502::X>;
+  using CPY = Compare<&MOS_6502::Y>;
+
+  struct BIT : Operation
+  {
+    static void apply(MOS_6502 &cpu, Memory &, auto operand)
+    {
+      Byte value = operand.read();
+      // N and V are copied straight from bits 7 and 6 of memory
+      cpu.negative_result = value;
+      cpu.overflow_result = value << 1;
+      cpu.zero_result = cpu.accumulator & value;
+    }
+  };
+
+  struct ASL : Operation
+  {
+    constexpr static bool WRITES = true;
+    static void apply(MOS_6502 &cpu, Memory &, auto operand)
+    {
+      Byte value = operand.read();
+      Byte result = value << 1;
+      cpu.carry_result = value >> 7;
+      operand.modify(value, result);
+      handleArithmeticFlagChanges(cpu, result);
+    }
+  };
+
+  struct LSR : Operation
+  {
+    constexpr static bool WRITES = true;
+    static void apply(MOS_6502 &cpu, Memory &, auto operand)
+    {
+      Byte value = operand.read();
+      Byte result = value >> 1;
+      cpu.carry_result = value & 0x01;
+      operand.modify(value, result);
+      handleArithmeticFlagChanges(cpu, result);
+    }
+  };
+
+  struct ROL : Operation
+  {
+    constexpr static bool WRITES = true;
+    static void apply(MOS_6502 &cpu, Memory &, auto operand)
+    {
+      Byte value = operand.read();
+      Byte result = (value << 1) | cpu.carry_result;
+      cpu.carry_result = value >> 7;
+      operand.modify(value, result);
+      handleArithmeticFlagChanges(cpu, result);
+    }
+  };
+
+  struct ROR : Operation
+  {
+    constexpr static bool WRITES = true;
+    static void apply(MOS_6502 &cpu, Memory &, auto operand)
+    {
+      Byte value = operand.read();
+      Byte result = (value >> 1) | (cpu.carry_result << 7); // 7th bit
+      cpu.carry_result = value & 0x01;
+      operand.modify(value, result);
+      handleArithmeticFlagChanges(cpu, result);
+    }
+  };
+
+  template <Byte Flag, bool IfSet>
+  struct Branch : Operation
+  {
+    constexpr static bool ENDS_BLOCK = true;
+    constexpr static bool BRANCH = true;
+    static bool taken(const MOS_6502 &cpu) { return testFlag<Flag>(cpu) == IfSet; }
+    static void apply(MOS_6502 &cpu, Memory &, auto target)
+    {
+      if (taken(cpu))
+      {
+        cpu.program_counter = target.address;
+      }
+    }
+  };
+  using BCC = Branch<MOS_6502::P_CARRY, false>;
+  using BCS = Branch<MOS_6502::P_CARRY, true>;
+  using BNE = Branch<MOS_6502::P_ZERO, false>;
+  using BEQ = Branch<MOS_6502::P_ZERO, true>;
+  using BPL = Branch<MOS_6502::P_NEGATIVE, false>;
+  using BMI = Branch<MOS_6502::P_NEGATIVE, true>;
+  using BVC = Branch<MOS_6502::P_OVERFLOW, false>;
+  using BVS = Branch<MOS_6502::P_OVERFLOW, true>;
+
+  template <Byte Flag, bool Set>
+  struct SetFlag : Operation
+  {
+    static void apply(MOS_6502 &cpu, Memory &, auto) { setFlag<Flag>(cpu, Set); }
+  };
+  using CLC = SetFlag<MOS_6502::P_CARRY, false>;
+  using CLD = SetFlag<MOS_6502::P_DECIMAL, false>;
+  using CLI = SetFlag<MOS_6502::P_INT_DISABLE, false>;
+  using CLV = SetFlag<MOS_6502::P_OVERFLOW, false>;
+  using SEC = SetFlag<MOS_6502::P_CARRY, true>;
+  using SED = SetFlag<MOS_6502::P_DECIMAL, true>;
+  using SEI = SetFlag<MOS_6502::P_INT_DISABLE, true>;
+
+  struct JMP : Operation
+  {
+    constexpr static bool ENDS_BLOCK = true;
+    static void apply(MOS_6502 &cpu, Memory &, auto location)
+    {
+      cpu.program_counter = location.address - 1; // the dispatcher adds the 1 back
+    }
+  };
+
+  struct JSR : Operation
+  {
+    constexpr static bool ENDS_BLOCK = true;
+    static void apply(MOS_6502 &cpu, Memory &mem, auto location)
+    {
+      mem.stackPushWord(cpu.S, cpu.program_counter); // the return address - 1, pc sits on the last operand byte
+      cpu.program_counter = location.address - 1;
+    }
+  };
+
+  struct RTS : Operation
+  {
+    constexpr static bool ENDS_BLOCK = true;
+    static void apply(MOS_6502 &cpu, Memory &mem, auto) { cpu.program_counter = mem.stackPullWord(cpu.S); }
+  };
+
+  struct BRK : Operation
+  {
+    constexpr static bool ENDS_BLOCK = true;
+    static void apply(MOS_6502 &cpu, Memory &mem, auto)
+    {
+      // simulate pad byte
+      cpu.program_counter++;
+      mem.stackPushWord(cpu.S, cpu.program_counter + 1);
+      mem.stackPushByte(cpu.S, cpu.P() | MOS_6502::P_BREAK | MOS_6502::P_UNUSED);
+
+      // disable interrupts (we are one)
+      cpu.status |= MOS_6502::P_INT_DISABLE;
+      cpu.program_counter = readWord(mem, Memory::BRK_INT, Memory::BRK_INT_HI) - 1;
+    }
+  };
+
+  struct RTI : Operation
+  {
+    constexpr static bool ENDS_BLOCK = true;
+    static void apply(MOS_6502 &cpu, Memory &mem, auto)
+    {
+      // B only exists on the stack, the unused bit always reads as 1
+      cpu.setP((mem.stackPullByte(cpu.S) & ~MOS_6502::P_BREAK) | MOS_6502::P_UNUSED);
+      cpu.program_counter = mem.stackPullWord(cpu.S) - 1;
+    }
+  };
+
+  struct PHA : Operation
+  {
+    static void apply(MOS_6502 &cpu, Memory &mem, auto) { mem.stackPushByte(cpu.S, cpu.accumulator); }
+  };
+
+  struct PLA : Operation
+  {
+    static void apply(MOS_6502 &cpu, Memory &mem, auto)
+    {
+      cpu.accumulator = mem.stackPullByte(cpu.S);
+      handleArithmeticFlagChanges(cpu, cpu.accumulator);
+    }
+  };
+
+  struct PHP : Operation
+  {
+    static void apply(MOS_6502 &cpu, Memory &mem, auto)
+    {
+      mem.stackPushByte(cpu.S, cpu.P() | MOS_6502::P_BREAK | MOS_6502::P_UNUSED); // must always be set
+    }
+  };
+
+  struct PLP : Operation
+  {
+    static void apply(MOS_6502 &cpu, Memory &mem, auto)
+    {
+      cpu.setP((mem.stackPullByte(cpu.S) & ~MOS_6502::P_BREAK) | MOS_6502::P_UNUSED);
+    }
+  };
+
+  /* Runs an operation once its operand bytes are known and the program counter sits on the last one */
+  template <typename Op, AddressMode Mode>
+  FORCE_INLINE Byte step(MOS_6502 &cpu, Memory &mem, Word operand)
+  {
+    bool page_crossed = false;
+    Location<Mode> target{cpu, mem, resolveAddress<Mode>(cpu, mem, operand, page_crossed)};
+    if constexpr (Op::BRANCH)
+    {
+      // one more cycle when taken, two when it lands on another page
+      Word next = cpu.program_counter + 1;
+      Word destination = Word(next + (SignedByte)operand);
+      bool taken = Op::taken(cpu);
+      Op::apply(cpu, mem, target);
+      cpu.program_counter++;
+      return taken ? 1 + ((next ^ destination) > 0xFF) : 0;
+    }
+
+    Op::apply(cpu, mem, target);
+    cpu.program_counter++;
+    return Op::PAGE_PENALTY && page_crossed;
+  }
+
+  /* One fully specialized handler per (operation, addressing mode) pair */
+  template <typename Op, AddressMode Mode>
+  FORCE_INLINE Byte execute(MOS_6502 &cpu, Memory &mem)
+  {
+    Word operand = fetchOperand<Mode>(cpu, mem);
+    return step<Op, Mode>(cpu, mem, operand);
+  }
+
+  /* Same handler for an instruction decoded ahead of time, the operand bytes are not read again */
+  template <typename Op, AddressMode Mode>
+  Byte executeDecoded(MOS_6502 &cpu, Memory &mem, Word operand)
+  {
+    cpu.program_counter += OPERAND_BYTES<Mode>;
+    return step<Op, Mode>(cpu, mem, operand);
+  }
+
+  constexpr std::array<Handler, 0x100> makeHandlerTable()
+  {
+    std::array<Handler, 0x100> t{};
+    for (auto &handler : t)
+    {
+      handler = &execute<NOP, AddressMode::IMPLICIT>; // never called, unknown opcodes halt before dispatch
+    }
+
+#define X(code, op, mode) t[code] = &execute<op, AddressMode::mode>;
+    OFFICIAL_OPCODES(X)
+#undef X
+    return t;
+  }
+
+  inline constexpr std::array<Handler, 0x100> HANDLERS = makeHandlerTable();
+
+  constexpr std::array<DecodedHandler, 0x100> makeDecodedHandlerTable()
+  {
+    std::array<DecodedHandler, 0x100> t{};
+    for (auto &handler : t)
+    {
+      handler = &executeDecoded<NOP, AddressMode::IMPLICIT>;
+    }
+
+#define X(code, op, mode) t[code] = &executeDecoded<op, AddressMode::mode>;
+    OFFICIAL_OPCODES(X)
+#undef X
+    return t;
+  }
+
+  inline constexpr std::array<DecodedHandler, 0x100> DECODED_HANDLERS = makeDecodedHandlerTable();
+
+  constexpr std::array<bool, 0x100> makeEndsBlockTable()
+  {
+    std::array<bool, 0x100> t{};
+#define X(code, op, mode) t[code] = op::ENDS_BLOCK;
+    OFFICIAL_OPCODES(X)
+#undef X
+    return t;
+  }
+
+  // branches, jumps, subroutine calls/returns and interrupts
+  inline constexpr std::array<bool, 0x100> ENDS_BLOCK = makeEndsBlockTable();
+}
+
+#endif // OPCODES_H
@@ -0,0 +1,77 @@
+#include "pacer.h"
+#include <algorithm>
+#include <thread>
+
+void Pacer::start(std::uint64_t cycles)
+{
+	origin = std::chrono::steady_clock::now();
+	origin_cycles = cycles;
+	statistics = {};
+}
+
+void Pacer::wait(std::uint64_t cycles)
+{
+	statistics.slices++;
+	auto now = std::chrono::steady_clock::now();
+	if (turbo)
+	{
+		// turning turbo off later starts counting from that point
+		origin = now;
+		origin_cycles = cycles;
+		return;
+	}
+
+	auto target = origin + emulatedTime(cycles);
+	statistics.drift = now - target;
+	if (statistics.drift > statistics.max_drift)
+	{
+		statistics.max_drift = statistics.drift;
+	}
+
+	if (now >= target)
+	{
+		statistics.late_slices++;
+		if (now - target > max_lag)
+		{
+			// catching up would mean running flat out for a while, start over from here instead
+			statistics.resyncs++;
+			origin = now;
+			origin_cycles = cycles;
+		}
+		return;
+	}
+
+	auto wake = target - std::min(margin, spin);
+	auto woke = now;
+	if (wake > now)
+	{
+		std::this_thread::sleep_until(wake);
+		woke = std::chrono::steady_clock::now();
+		// the worst recent overshoot, fading so one slow wakeup doesn't keep every later wait spinning
+		margin = std::min(std::max<Duration>(woke - wake, margin - margin / 8), spin);
+	}
+	auto done = woke;
+	while (done < target)
+	{
+		done = std::chrono::steady_clock::now();
+	}
+	statistics.spun += done - woke;
+	statistics.slept += done - now;
+}
+
+std::uint64_t Pacer::sliceCycles() const
+{
+	auto cycles = static_cast<std::uint64_t>(clock_hz * std::chrono::duration<double>(slice).count());
+	return cycles == 0 ? 1 : cycles;
+}
+
+double Pacer::effectiveHz(std::uint64_t cycles) const
+{
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - origin).count();
+	return seconds > 0 ? (cycles - origin_cycles) / seconds : 0;
+}
+
+Pacer::Duration Pacer::emulatedTime(std::uint64_t cycles) const
+{
+	return std::chrono::duration_cast<Duration>(std::chrono::duration<double>((cycles - origin_cycles) / clock_hz));
+}
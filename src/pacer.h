@@ -0,0 +1,53 @@
+#ifndef PACER_H
+#define PACER_H
+
+#include "types.h"
+#include <chrono>
+#include <cstdint>
+
+/*
+ * Keeps emulated time in step with the wall clock for throttled runs.
+ * The emulator runs unthrottled for one slice, then wait() compares the cycles run so far with
+ * std::chrono::steady_clock (CLOCK_MONOTONIC on Linux) and sleeps once to catch up. Sleeps wake
+ * early by the overshoot seen on the previous ones, at most spin, and spin the rest; a host whose
+ * sleeps are on time never spins.
+ */
+class Pacer
+{
+public:
+    using Duration = std::chrono::nanoseconds;
+
+    struct Stats
+    {
+        std::uint64_t slices = 0;
+        std::uint64_t late_slices = 0; // ended behind the wall clock, nothing to wait for
+        std::uint64_t resyncs = 0;     // fell more than max_lag behind, the backlog was dropped
+        Duration drift{0};             // at the end of the last slice, positive when behind the wall clock
+        Duration max_drift{0};         // the furthest behind any slice ended
+        Duration slept{0};             // time spent waiting, sleeping or spinning
+        Duration spun{0};              // the part of slept that was spun
+    };
+
+    double clock_hz = CLOCK_HZ;
+    Duration slice = std::chrono::milliseconds(1);
+    Duration spin = std::chrono::microseconds(50); // the most of each wait spun instead of slept
+    Duration max_lag = std::chrono::milliseconds(100);
+    bool turbo = false; // run as fast as the host allows, slices still end but never wait
+
+    void start(std::uint64_t cycles); // the wall clock and cycles now line up
+    void wait(std::uint64_t cycles);  // blocks until the wall clock catches up with cycles
+
+    std::uint64_t sliceCycles() const;
+    const Stats &stats() const { return statistics; }
+    double effectiveHz(std::uint64_t cycles) const; // since start()
+
+private:
+    Duration emulatedTime(std::uint64_t cycles) const;
+
+    std::chrono::steady_clock::time_point origin;
+    std::uint64_t origin_cycles = 0;
+    Duration margin{0}; // how early the next sleep wakes, learned from how late the last ones did
+    Stats statistics;
+};
+
+#endif // PACER_H
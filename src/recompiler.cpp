@@ -0,0 +1,257 @@
+#include "recompiler.h"
+#include "block_cache.h"
+#include "opcodes.h"
+#include <array>
+#include <iomanip>
+#include <sstream>
+#include <type_traits>
+
+namespace
+{
+	struct OpcodeInfo
+	{
+		const char *op;
+		const char *mode;
+		bool writes; // may write to memory, so translated code checks its own pages afterwards
+	};
+
+	constexpr std::array<OpcodeInfo, 0x100> makeOpcodeInfoTable()
+	{
+		std::array<OpcodeInfo, 0x100> t{};
+#define X(code, op, mode)                                                                                   \
+	t[code] = {#op, #mode,                                                                                  \
+			   (ops::op::WRITES && AddressMode::mode != AddressMode::ACCUMULATOR) ||                         \
+				   std::is_same_v<ops::op, ops::PHA> || std::is_same_v<ops::op, ops::PHP>};
+		OFFICIAL_OPCODES(X)
+#undef X
+		return t;
+	}
+
+	constexpr std::array<OpcodeInfo, 0x100> OPCODE_INFO = makeOpcodeInfoTable();
+
+	std::string hex(unsigned value, int digits)
+	{
+		std::ostringstream oss;
+		oss << "0x" << std::hex << std::uppercase << std::setfill('0') << std::setw(digits) << value;
+		return oss.str();
+	}
+}
+
+Recompiler::Recompiler(const std::vector<Byte> &rom, Word base) : rom(rom), base(base)
+{
+}
+
+bool Recompiler::inImage(Word address, std::size_t length) const
+{
+	return address >= base && (std::size_t)address - base + length <= rom.size();
+}
+
+Word Recompiler::readVector(Word address) const
+{
+	return (Word)rom[address - base] | ((Word)rom[address + 1 - base] << 8);
+}
+
+void Recompiler::addEntry(Word pc)
+{
+	pending.push_back(pc);
+}
+
+void Recompiler::addVectorEntries()
+{
+	for (Word vector : {0xFFFA, 0xFFFC, 0xFFFE})
+	{
+		if (inImage(vector, 2))
+		{
+			addEntry(readVector(vector));
+		}
+	}
+}
+
+void Recompiler::discover()
+{
+	while (!pending.empty())
+	{
+		Word pc = pending.back();
+		pending.pop_back();
+		if (discovered.count(pc) || !inImage(pc))
+		{
+			continue;
+		}
+
+		std::vector<Word> successors;
+		RecompiledBlock block = decode(pc, successors);
+		if (!block.instructions.empty())
+		{
+			discovered.emplace(pc, std::move(block));
+		}
+		pending.insert(pending.end(), successors.begin(), successors.end());
+	}
+}
+
+// the same rules as BlockCache::decode(), so BRK still gets to trap at run time
+RecompiledBlock Recompiler::decode(Word pc, std::vector<Word> &successors) const
+{
+	RecompiledBlock block{pc, pc, {}};
+	Word address = pc;
+	while (block.instructions.size() < BlockCache::MAX_BLOCK_LENGTH)
+	{
+		// straight-line code ran off the end of the image, or wrapped past $FFFF
+		if (!inImage(address))
+		{
+			block.end = address;
+			return block;
+		}
+
+		Byte opcode = rom[address - base];
+		const Instruction &instruction = INSTRUCTIONS[opcode];
+		if ((instruction.flags & Instruction::HALT) || !inImage(address, instruction.args_count))
+		{
+			block.end = address;
+			return block;
+		}
+		if ((instruction.flags & Instruction::TRAP) && !block.instructions.empty())
+		{
+			break;
+		}
+
+		Word operand = 0;
+		if (instruction.args_count > 1)
+		{
+			operand = rom[address + 1 - base];
+		}
+		if (instruction.args_count > 2)
+		{
+			operand |= (Word)rom[address + 2 - base] << 8;
+		}
+
+		block.instructions.push_back({address, opcode, operand});
+		Word next = address + instruction.args_count;
+		address = next;
+
+		if (ops::ENDS_BLOCK[opcode])
+		{
+			block.end = next;
+			if (instruction.addressing_mode == AddressMode::RELATIVE)
+			{
+				successors.push_back(Word(next + (SignedByte)operand));
+				successors.push_back(next);
+			}
+			else if (opcode == 0x4C) // JMP absolute
+			{
+				successors.push_back(operand);
+			}
+			else if (opcode == 0x20) // JSR, the subroutine and the code it returns to
+			{
+				successors.push_back(operand);
+				successors.push_back(next);
+			}
+			else if (opcode == 0x00) // BRK, the handler and the code RTI returns to past the pad byte
+			{
+				if (inImage(Memory::BRK_INT, 2))
+				{
+					successors.push_back(readVector(Memory::BRK_INT));
+				}
+				successors.push_back(Word(next + 1));
+			}
+			return block;
+		}
+	}
+
+	// cut short, the rest becomes a block of its own
+	block.end = address;
+	successors.push_back(address);
+	return block;
+}
+
+std::string Recompiler::generate(const std::string &name) const
+{
+	std::ostringstream out;
+	out << "// Generated by the aot tool, do not edit.\n"
+		<< "#include \"aot.h\"\n\n"
+		<< "namespace\n{\n";
+
+	for (const auto &[pc, block] : discovered)
+	{
+		Byte first_page = block.pc >> 8;
+		Byte last_page = Word(block.end - 1) >> 8;
+
+		out << "\tinline std::uint32_t block_" << hex(pc, 4) << "(MOS_6502 &cpu, Memory &mem)\n\t{\n"
+			<< "\t\t[[maybe_unused]] const std::uint32_t first_generation = mem.page_generation[" << hex(first_page, 2) << "];\n";
+		if (last_page != first_page)
+		{
+			out << "\t\t[[maybe_unused]] const std::uint32_t last_generation = mem.page_generation[" << hex(last_page, 2) << "];\n";
+		}
+		out << "\t\tstd::uint32_t cycles = 0;\n";
+
+		for (std::size_t i = 0; i < block.instructions.size(); ++i)
+		{
+			const RecompiledInstruction &instruction = block.instructions[i];
+			const OpcodeInfo &info = OPCODE_INFO[instruction.opcode];
+			out << "\t\tcycles += " << (int)INSTRUCTIONS[instruction.opcode].cycles
+				<< " + ops::executeDecoded<ops::" << info.op << ", AddressMode::" << info.mode << ">(cpu, mem, "
+				<< hex(instruction.operand, 4) << "); // " << hex(instruction.pc, 4) << "\n";
+
+			// the code under this block was just overwritten, the rest has to be looked up again
+			if (info.writes && i + 1 < block.instructions.size())
+			{
+				out << "\t\tif (mem.page_generation[" << hex(first_page, 2) << "] != first_generation";
+				if (last_page != first_page)
+				{
+					out << " || mem.page_generation[" << hex(last_page, 2) << "] != last_generation";
+				}
+				out << ")\n\t\t{\n\t\t\treturn cycles;\n\t\t}\n";
+			}
+		}
+		out << "\t\treturn cycles;\n\t}\n\n";
+	}
+
+	// chains blocks through a switch on the pc, so the registers stay in host registers between them
+	out << "\tstd::uint32_t run(MOS_6502 &cpu, Memory &mem, AotRuntime &runtime, std::uint32_t budget, [[maybe_unused]] bool trap_brk)\n\t{\n"
+		<< "\t\tMOS_6502 regs = cpu;\n"
+		<< "\t\tstd::uint32_t cycles = 0;\n"
+		<< "\t\twhile (cycles < budget)\n\t\t{\n"
+		<< "\t\t\tswitch (regs.program_counter)\n\t\t\t{\n";
+	for (const auto &[pc, block] : discovered)
+	{
+		Byte first_page = block.pc >> 8;
+		Byte last_page = Word(block.end - 1) >> 8;
+
+		out << "\t\t\tcase " << hex(pc, 4) << ":\n\t\t\t\tif (";
+		if (INSTRUCTIONS[block.instructions.front().opcode].flags & Instruction::TRAP)
+		{
+			out << "trap_brk || ";
+		}
+		out << "!runtime.pageMatches(" << hex(first_page, 2) << ", mem)";
+		if (last_page != first_page)
+		{
+			out << " || !runtime.pageMatches(" << hex(last_page, 2) << ", mem)";
+		}
+		out << ")\n\t\t\t\t{\n\t\t\t\t\tgoto done;\n\t\t\t\t}\n"
+			<< "\t\t\t\tcycles += block_" << hex(pc, 4) << "(regs, mem);\n"
+			<< "\t\t\t\tcontinue;\n";
+	}
+	out << "\t\t\t}\n\t\t\tbreak;\n\t\t}\n\n"
+		<< "\tdone:\n"
+		<< "\t\tcpu = regs;\n"
+		<< "\t\treturn cycles;\n\t}\n\n";
+
+	out << "\tconst Byte ROM[] = {";
+	for (std::size_t i = 0; i < rom.size(); ++i)
+	{
+		out << (i % 16 == 0 ? "\n\t\t" : " ") << hex(rom[i], 2) << ",";
+	}
+	out << "\n\t};\n\n";
+
+	out << "\tconst AotBlock BLOCKS[] = {\n";
+	for (const auto &[pc, block] : discovered)
+	{
+		out << "\t\t{" << hex(pc, 4) << ", " << hex(block.end, 4) << ", &block_" << hex(pc, 4) << "},\n";
+	}
+	out << "\t};\n}\n\n";
+
+	out << "extern const AotImage " << name << ";\n"
+		<< "const AotImage " << name << " = {\"" << name << "\", " << hex(base, 4)
+		<< ", ROM, sizeof(ROM), BLOCKS, sizeof(BLOCKS) / sizeof(BLOCKS[0]), &run};\n\n"
+		<< "namespace\n{\n\t[[maybe_unused]] const bool registered = registerAotImage(" << name << ");\n}\n";
+	return out.str();
+}
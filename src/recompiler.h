@@ -0,0 +1,60 @@
+#ifndef RECOMPILER_H
+#define RECOMPILER_H
+
+#include "types.h"
+#include "components.h"
+#include "instructions.h"
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+/* An instruction found by the recompiler */
+struct RecompiledInstruction
+{
+    Word pc;
+    Byte opcode;
+    Word operand;
+};
+
+/* A basic block found by the recompiler, same shape as the ones in BlockCache */
+struct RecompiledBlock
+{
+    Word pc;
+    Word end; // one past its last byte
+    std::vector<RecompiledInstruction> instructions;
+};
+
+/*
+ * Static recompiler behind the aot tool.
+ * Disassembles a ROM image by recursive descent from its entry points and emits a C++
+ * translation unit with one function per basic block, see AotImage.
+ * Code only reachable through computed jumps (JMP indirect, RTS/RTI to pushed addresses)
+ * is never discovered and stays with the interpreter.
+ */
+class Recompiler
+{
+public:
+    explicit Recompiler(const std::vector<Byte> &rom, Word base = Memory::ROM_START);
+
+    void addEntry(Word pc);
+    void addVectorEntries(); // NMI, RESET and IRQ/BRK, if the image covers $FFFA-$FFFF
+    void discover();
+
+    // the translation unit defining `extern const AotImage <name>`
+    std::string generate(const std::string &name) const;
+
+    const std::map<Word, RecompiledBlock> &blocks() const { return discovered; }
+
+private:
+    bool inImage(Word address, std::size_t length = 1) const;
+    Word readVector(Word address) const;
+    RecompiledBlock decode(Word pc, std::vector<Word> &successors) const;
+
+    std::vector<Byte> rom;
+    Word base;
+    std::vector<Word> pending;
+    std::map<Word, RecompiledBlock> discovered;
+};
+
+#endif // RECOMPILER_H
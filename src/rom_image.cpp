@@ -0,0 +1,95 @@
+#include "rom_image.h"
+#include <fstream>
+#include <iterator>
+
+#if MOS6502_POSIX
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+bool mapFile(const std::string &path, int protection, Byte *&data, std::size_t &size)
+{
+	data = nullptr;
+	size = 0;
+	bool writable = protection & PROT_WRITE;
+	int file = ::open(path.c_str(), writable ? O_RDWR : O_RDONLY);
+	if (file < 0)
+	{
+		return false;
+	}
+
+	struct stat info;
+	if (fstat(file, &info) != 0)
+	{
+		::close(file);
+		return false;
+	}
+
+	if (info.st_size > 0)
+	{
+		void *memory = mmap(nullptr, info.st_size, protection, writable ? MAP_SHARED : MAP_PRIVATE, file, 0);
+		if (memory == MAP_FAILED)
+		{
+			::close(file);
+			return false;
+		}
+		data = static_cast<Byte *>(memory);
+		size = info.st_size;
+	}
+	::close(file);
+	return true;
+}
+#endif
+
+RomImage::~RomImage()
+{
+	close();
+}
+
+void RomImage::close()
+{
+#if MOS6502_POSIX
+	if (mapped != 0)
+	{
+		munmap(const_cast<Byte *>(bytes), mapped);
+	}
+#endif
+	bytes = nullptr;
+	length = 0;
+	mapped = 0;
+	buffer.clear();
+}
+
+bool RomImage::open(const std::string &path)
+{
+	close();
+
+#if MOS6502_POSIX
+	// mmap rounds up to whole host pages and fills them with zeroes, which covers the last 256 byte page too
+	Byte *memory = nullptr;
+	std::size_t size = 0;
+	if (!mapFile(path, PROT_READ, memory, size))
+	{
+		return false;
+	}
+	if (memory != nullptr)
+	{
+		bytes = memory;
+		length = size;
+		mapped = size;
+		return true;
+	}
+#endif
+
+	std::ifstream input(path, std::ios_base::binary);
+	if (!input.is_open())
+	{
+		return false;
+	}
+	buffer.assign(std::istreambuf_iterator<char>(input), std::istreambuf_iterator<char>());
+	length = buffer.size();
+	buffer.resize((length + 0xFF) & ~std::size_t(0xFF));
+	bytes = buffer.data();
+	return true;
+}
@@ -0,0 +1,47 @@
+#ifndef ROM_IMAGE_H
+#define ROM_IMAGE_H
+
+#include "types.h"
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#if MOS6502_POSIX
+/*
+ * Maps all of the file at path with the mmap protection flags protection. A writable mapping is
+ * shared so writes reach the file, a read-only one is private. False if the file can't be opened
+ * or mapped; an empty file can't be mapped either and comes back as nullptr with size 0.
+ */
+bool mapFile(const std::string &path, int protection, Byte *&data, std::size_t &size);
+#endif
+
+/*
+ * A ROM file mapped read-only into the address space, so the bus can point its pages straight
+ * at it (Memory::mapROM, Mapper) and nothing gets copied at startup. The bytes after the end of
+ * the file up to the next 256 byte page read as 0.
+ * Without mmap the file is read into a buffer padded the same way.
+ */
+class RomImage
+{
+public:
+    RomImage() = default;
+    ~RomImage();
+
+    // the pages point into the mapping
+    RomImage(const RomImage &) = delete;
+    RomImage &operator=(const RomImage &) = delete;
+
+    bool open(const std::string &path); // false if the file can't be read, the old image is gone either way
+    void close();
+
+    const Byte *data() const { return bytes; }
+    std::size_t size() const { return length; }
+
+private:
+    const Byte *bytes = nullptr;
+    std::size_t length = 0;
+    std::size_t mapped = 0;   // bytes to munmap, 0 when the image lives in buffer
+    std::vector<Byte> buffer; // empty files and systems without mmap
+};
+
+#endif // ROM_IMAGE_H
@@ -0,0 +1,225 @@
+#include "save_state.h"
+#include <fstream>
+#include <vector>
+
+namespace
+{
+	constexpr std::size_t HEADER_SIZE = 32;
+	constexpr std::size_t CHUNK_SIZE = 12;
+	constexpr std::size_t DIRECTORY_SIZE = 0x100 * CHUNK_SIZE;
+	constexpr std::size_t DEVICE_RECORD_SIZE = 8;
+
+	// (count - 1, value) pairs, empty if that doesn't at least halve the page
+	std::vector<Byte> encodeRle(const Byte *page)
+	{
+		std::vector<Byte> out;
+		for (std::size_t i = 0; i < 0x100;)
+		{
+			std::size_t run = 1;
+			while (i + run < 0x100 && page[i + run] == page[i])
+			{
+				++run;
+			}
+			out.push_back(Byte(run - 1));
+			out.push_back(page[i]);
+			if (out.size() > 0x80)
+			{
+				return {};
+			}
+			i += run;
+		}
+		return out;
+	}
+
+	bool decodeRle(const Byte *in, std::size_t size, Byte *page)
+	{
+		std::size_t length = 0;
+		for (std::size_t i = 0; i + 1 < size; i += 2)
+		{
+			std::size_t run = std::size_t(in[i]) + 1;
+			if (length + run > 0x100)
+			{
+				return false;
+			}
+			std::fill(page + length, page + length + run, in[i + 1]);
+			length += run;
+		}
+		return length == 0x100 && size % 2 == 0;
+	}
+}
+
+bool SaveState::write(Emulator &emulator, const std::string &path, bool compress)
+{
+	Snapshot snapshot = emulator.snapshot();
+
+	std::vector<Byte> devices;
+	for (std::size_t page = 0; page < 0x100; ++page)
+	{
+		const Device *device = emulator.mem.devices[page];
+		if (device == nullptr || (page > 0 && emulator.mem.devices[page - 1] == device))
+		{
+			continue;
+		}
+		std::size_t record = devices.size();
+		devices.resize(record + DEVICE_RECORD_SIZE);
+		device->saveState(devices);
+		devices[record] = Byte(page);
+		putLittleEndian(&devices[record + 4], devices.size() - record - DEVICE_RECORD_SIZE, 4);
+	}
+
+	// RAW pages first, on page boundaries of the file so they can be shared straight out of the mapping
+	std::size_t devices_offset = HEADER_SIZE + DIRECTORY_SIZE;
+	std::size_t raw_offset = (devices_offset + devices.size() + 0xFF) & ~std::size_t(0xFF);
+	std::vector<Byte> out(raw_offset);
+	std::vector<Byte> rle;
+	std::vector<std::size_t> raw_pages;
+
+	for (std::size_t page = 0; page < 0x100; ++page)
+	{
+		std::vector<Byte> encoded = compress ? encodeRle(snapshot.pages[page]->data()) : std::vector<Byte>{};
+		std::size_t chunk = HEADER_SIZE + page * CHUNK_SIZE;
+		out[chunk] = Byte(page);
+		if (encoded.empty())
+		{
+			out[chunk + 1] = Byte(RAW);
+			putLittleEndian(&out[chunk + 4], raw_offset + raw_pages.size() * 0x100, 4);
+			putLittleEndian(&out[chunk + 8], 0x100, 4);
+			raw_pages.push_back(page);
+		}
+		else
+		{
+			out[chunk + 1] = Byte(RLE);
+			putLittleEndian(&out[chunk + 4], rle.size(), 4); // relative to the RLE data until it has a place
+			putLittleEndian(&out[chunk + 8], encoded.size(), 4);
+			rle.insert(rle.end(), encoded.begin(), encoded.end());
+		}
+	}
+
+	std::size_t rle_offset = raw_offset + raw_pages.size() * 0x100;
+	for (std::size_t page = 0; page < 0x100; ++page)
+	{
+		std::size_t chunk = HEADER_SIZE + page * CHUNK_SIZE;
+		if (out[chunk + 1] == RLE)
+		{
+			putLittleEndian(&out[chunk + 4], rle_offset + getLittleEndian(&out[chunk + 4], 4), 4);
+		}
+	}
+
+	out[0] = 'M';
+	out[1] = '6';
+	out[2] = '5';
+	out[3] = 'S';
+	putLittleEndian(&out[4], VERSION, 2);
+	putLittleEndian(&out[6], 0x100, 2);
+	putLittleEndian(&out[8], snapshot.cpu.program_counter, 2);
+	out[10] = snapshot.cpu.accumulator;
+	out[11] = snapshot.cpu.X;
+	out[12] = snapshot.cpu.Y;
+	out[13] = snapshot.cpu.S;
+	out[14] = snapshot.cpu.P();
+	putLittleEndian(&out[16], snapshot.cycles, 8);
+	putLittleEndian(&out[24], devices_offset, 4);
+	putLittleEndian(&out[28], devices.size(), 4);
+	std::copy(devices.begin(), devices.end(), out.begin() + devices_offset);
+
+	std::ofstream file(path, std::ios_base::binary | std::ios_base::trunc);
+	file.write((const char *)out.data(), out.size());
+	for (std::size_t page : raw_pages)
+	{
+		file.write((const char *)snapshot.pages[page]->data(), 0x100);
+	}
+	file.write((const char *)rle.data(), rle.size());
+	return bool(file);
+}
+
+bool SaveState::open(const std::string &path)
+{
+	file = std::make_shared<RomImage>();
+	state = {};
+	devices = nullptr;
+	devices_size = 0;
+
+	if (!file->open(path) || file->size() < HEADER_SIZE + DIRECTORY_SIZE)
+	{
+		return false;
+	}
+
+	const Byte *bytes = file->data();
+	std::size_t size = file->size();
+	if (bytes[0] != 'M' || bytes[1] != '6' || bytes[2] != '5' || bytes[3] != 'S' ||
+		getLittleEndian(bytes + 4, 2) != VERSION || getLittleEndian(bytes + 6, 2) != 0x100)
+	{
+		return false;
+	}
+
+	state.cpu.program_counter = Word(getLittleEndian(bytes + 8, 2));
+	state.cpu.accumulator = bytes[10];
+	state.cpu.X = bytes[11];
+	state.cpu.Y = bytes[12];
+	state.cpu.S = bytes[13];
+	state.cpu.setP(bytes[14]);
+	state.cycles = getLittleEndian(bytes + 16, 8);
+
+	std::size_t devices_offset = getLittleEndian(bytes + 24, 4);
+	devices_size = getLittleEndian(bytes + 28, 4);
+	if (devices_offset > size || devices_size > size - devices_offset)
+	{
+		return false;
+	}
+	devices = bytes + devices_offset;
+
+	std::size_t rle_pages = 0;
+	for (std::size_t chunk = 0; chunk < 0x100; ++chunk)
+	{
+		rle_pages += bytes[HEADER_SIZE + chunk * CHUNK_SIZE + 1] == RLE;
+	}
+	auto decoded = std::make_shared<std::array<Byte, 0x100>[]>(rle_pages);
+	std::size_t next = 0;
+
+	for (std::size_t chunk = 0; chunk < 0x100; ++chunk)
+	{
+		const Byte *entry = bytes + HEADER_SIZE + chunk * CHUNK_SIZE;
+		Byte page = entry[0];
+		std::size_t offset = getLittleEndian(entry + 4, 4);
+		std::size_t length = getLittleEndian(entry + 8, 4);
+		if (state.pages[page] != nullptr || offset > size || length > size - offset)
+		{
+			return false; // every page exactly once, inside the file
+		}
+
+		if (entry[1] == RAW && length == 0x100)
+		{
+			state.pages[page] = SharedPage(file, reinterpret_cast<const std::array<Byte, 0x100> *>(bytes + offset));
+		}
+		else if (entry[1] == RLE && decodeRle(bytes + offset, length, decoded[next].data()))
+		{
+			state.pages[page] = SharedPage(decoded, &decoded[next++]);
+		}
+		else
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+bool SaveState::restore(Emulator &emulator) const
+{
+	emulator.restore(state);
+
+	bool accepted = true;
+	for (std::size_t at = 0; at + DEVICE_RECORD_SIZE <= devices_size;)
+	{
+		Byte page = devices[at];
+		std::size_t length = getLittleEndian(devices + at + 4, 4);
+		if (length > devices_size - at - DEVICE_RECORD_SIZE)
+		{
+			return false;
+		}
+
+		Device *device = emulator.mem.devices[page];
+		accepted &= device != nullptr && device->loadState(devices + at + DEVICE_RECORD_SIZE, length);
+		at += DEVICE_RECORD_SIZE + length;
+	}
+	return accepted;
+}
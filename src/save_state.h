@@ -0,0 +1,57 @@
+#ifndef SAVE_STATE_H
+#define SAVE_STATE_H
+
+#include "types.h"
+#include "mos6502.h"
+#include "rom_image.h"
+#include <cstdint>
+#include <memory>
+#include <string>
+
+/*
+ * Save states on disk, little endian throughout.
+ *
+ *   0  "M65S"                   magic
+ *   4  u16 version              VERSION
+ *   6  u16 chunk count          one chunk per page of memory[], all 256 of them
+ *   8  u16 pc, u8 a, x, y, s, p
+ *  15  u8 reserved
+ *  16  u64 cycles
+ *  24  u32 offset, u32 size     device section
+ *  32  chunk directory          u8 page, u8 encoding, u16 reserved, u32 offset, u32 size
+ *
+ * The device section holds one record per device in page order: u8 first page, u8[3]
+ * reserved, u32 size, then whatever Device::saveState() wrote. Loading hands each record to
+ * the device mapped on that page of the machine it is loaded into.
+ * RAW chunks are a whole page on a 256 byte boundary of the file. Loading maps the file and
+ * shares those pages with the machine copy-on-write, so they are only faulted in once the
+ * machine touches them. RLE chunks are (count - 1, value) pairs and are decoded on load; pages
+ * are only stored that way when it at least halves them.
+ */
+class SaveState
+{
+public:
+    constexpr static std::uint16_t VERSION = 1;
+
+    enum Encoding : Byte
+    {
+        RAW = 0,
+        RLE = 1,
+    };
+
+    static bool write(Emulator &emulator, const std::string &path, bool compress = true);
+
+    // false if the file can't be mapped or isn't a save state of this version
+    bool open(const std::string &path);
+    bool restore(Emulator &emulator) const; // false if a device rejects its state, the rest is restored anyway
+
+    const Snapshot &snapshot() const { return state; }
+
+private:
+    std::shared_ptr<RomImage> file; // the RAW pages point into it
+    Snapshot state;
+    const Byte *devices = nullptr;
+    std::size_t devices_size = 0;
+};
+
+#endif // SAVE_STATE_H
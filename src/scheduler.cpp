@@ -0,0 +1,126 @@
+#include "scheduler.h"
+
+Scheduler::Event Scheduler::add(Callback callback)
+{
+	events.push_back({std::move(callback)});
+	return events.size() - 1;
+}
+
+void Scheduler::scheduleAt(Event event, std::uint64_t deadline)
+{
+	Entry &entry = events[event];
+	std::uint64_t previous = entry.deadline;
+	entry.deadline = deadline;
+	if (horizon != nullptr && deadline < *horizon)
+	{
+		*horizon = deadline;
+	}
+
+	if (entry.position == NOT_PENDING)
+	{
+		heap.push_back(event);
+		entry.position = heap.size() - 1;
+		siftUp(entry.position);
+	}
+	else if (deadline < previous)
+	{
+		siftUp(entry.position);
+	}
+	else
+	{
+		siftDown(entry.position);
+	}
+}
+
+void Scheduler::scheduleIn(Event event, std::uint64_t delay)
+{
+	scheduleAt(event, delay < NEVER - cycles ? cycles + delay : NEVER);
+}
+
+void Scheduler::cancel(Event event)
+{
+	std::size_t position = events[event].position;
+	if (position == NOT_PENDING)
+	{
+		return;
+	}
+
+	events[event].position = NOT_PENDING;
+	Event last = heap.back();
+	heap.pop_back();
+	if (position < heap.size())
+	{
+		// the last event takes the hole and goes whichever way its deadline says
+		place(position, last);
+		siftUp(position);
+		siftDown(events[last].position);
+	}
+}
+
+void Scheduler::dispatch(std::uint64_t now)
+{
+	while (!heap.empty() && events[heap.front()].deadline <= now)
+	{
+		Event event = heap.front();
+		std::uint64_t deadline = events[event].deadline;
+		cancel(event); // the callback may schedule it again
+		dispatched++;
+
+		// held outside of events while it runs, an add() from inside it may reallocate them
+		Callback callback = std::move(events[event].callback);
+		callback(deadline);
+		events[event].callback = std::move(callback);
+	}
+}
+
+// ties go to the event added first, so runs are reproducible
+bool Scheduler::earlier(Event a, Event b) const
+{
+	return events[a].deadline < events[b].deadline || (events[a].deadline == events[b].deadline && a < b);
+}
+
+void Scheduler::siftUp(std::size_t position)
+{
+	Event event = heap[position];
+	while (position > 0)
+	{
+		std::size_t parent = (position - 1) / 2;
+		if (earlier(heap[parent], event))
+		{
+			break;
+		}
+		place(position, heap[parent]);
+		position = parent;
+	}
+	place(position, event);
+}
+
+void Scheduler::siftDown(std::size_t position)
+{
+	Event event = heap[position];
+	for (;;)
+	{
+		std::size_t child = 2 * position + 1;
+		if (child >= heap.size())
+		{
+			break;
+		}
+		if (child + 1 < heap.size() && earlier(heap[child + 1], heap[child]))
+		{
+			child++;
+		}
+		if (!earlier(heap[child], event))
+		{
+			break;
+		}
+		place(position, heap[child]);
+		position = child;
+	}
+	place(position, event);
+}
+
+void Scheduler::place(std::size_t position, Event event)
+{
+	heap[position] = event;
+	events[event].position = position;
+}
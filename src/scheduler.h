@@ -0,0 +1,71 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include "types.h"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <vector>
+
+/*
+ * Timed events on the emulated cycle counter.
+ * Pending events sit in a binary min-heap on their deadline, so the run loops only ever compare
+ * the cycle counter against next() instead of asking every device whether it is due.
+ * An event is registered once with add() and can then be scheduled, moved and cancelled any
+ * number of times; the callback gets the deadline it was scheduled for, which makes periodic
+ * events drift free: scheduleAt(event, deadline + period).
+ * The engines only stop between instructions, and BLOCK_CACHE/JIT only between blocks, so an
+ * event runs at or shortly after its deadline, never before.
+ */
+class Scheduler
+{
+public:
+    using Event = std::size_t;
+    using Callback = std::function<void(std::uint64_t deadline)>;
+
+    constexpr static std::uint64_t NEVER = std::numeric_limits<std::uint64_t>::max();
+
+    explicit Scheduler(const std::uint64_t &cycles) : cycles(cycles) {}
+
+    Event add(Callback callback); // not scheduled yet
+
+    void scheduleAt(Event event, std::uint64_t deadline); // moves it if it is already pending
+    void scheduleIn(Event event, std::uint64_t delay);    // from the current cycle
+    void cancel(Event event);
+
+    bool pending(Event event) const { return events[event].position != NOT_PENDING; }
+    std::uint64_t deadline(Event event) const { return events[event].deadline; }
+
+    // the earliest deadline, NEVER without pending events
+    std::uint64_t next() const { return heap.empty() ? NEVER : events[heap.front()].deadline; }
+
+    // runs every event due by now in deadline order, events they schedule before now run as well
+    void dispatch(std::uint64_t now);
+
+    std::size_t dispatched = 0;
+
+    // lowered to any earlier deadline that gets scheduled, so whatever runs up to it stops in time
+    std::uint64_t *horizon = nullptr;
+
+private:
+    constexpr static std::size_t NOT_PENDING = std::numeric_limits<std::size_t>::max();
+
+    struct Entry
+    {
+        Callback callback;
+        std::uint64_t deadline = NEVER;
+        std::size_t position = NOT_PENDING; // in heap
+    };
+
+    bool earlier(Event a, Event b) const;
+    void siftUp(std::size_t position);
+    void siftDown(std::size_t position);
+    void place(std::size_t position, Event event);
+
+    const std::uint64_t &cycles;
+    std::vector<Entry> events; // by index only, callbacks may add events and move it (nothing allocated until the first add())
+    std::vector<Event> heap;
+};
+
+#endif // SCHEDULER_H
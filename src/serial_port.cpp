@@ -0,0 +1,170 @@
+#include "serial_port.h"
+#include <algorithm>
+#include <chrono>
+
+#if MOS6502_POSIX
+#include <cerrno>
+#include <cstdlib>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+	constexpr std::size_t CHUNK = 4096;
+	constexpr auto IDLE = std::chrono::milliseconds(1);
+}
+
+#if MOS6502_POSIX
+
+bool SerialPort::start(int input_fd, int output_fd)
+{
+	if (running.load(std::memory_order_relaxed))
+	{
+		return false;
+	}
+	in = input_fd;
+	out = output_fd;
+	running.store(true, std::memory_order_release);
+	thread = std::thread(&SerialPort::pump, this);
+	return true;
+}
+
+bool SerialPort::startFile(const std::string &path)
+{
+	if (running.load(std::memory_order_relaxed))
+	{
+		return false;
+	}
+	int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+	{
+		return false;
+	}
+	owned = fd;
+	device = path;
+	return start(-1, fd);
+}
+
+// the slave end stays open here as well, or the master reports a hangup until a terminal attaches
+bool SerialPort::startPty()
+{
+	if (running.load(std::memory_order_relaxed))
+	{
+		return false;
+	}
+	int master = ::posix_openpt(O_RDWR | O_NOCTTY);
+	if (master < 0)
+	{
+		return false;
+	}
+	const char *slave_name = nullptr;
+	int slave = -1;
+	if (::grantpt(master) != 0 || ::unlockpt(master) != 0 || !(slave_name = ::ptsname(master)) ||
+	    (slave = ::open(slave_name, O_RDWR | O_NOCTTY)) < 0)
+	{
+		::close(master);
+		return false;
+	}
+
+	// raw, the guest does its own echo and line editing
+	termios mode;
+	if (::tcgetattr(slave, &mode) == 0)
+	{
+		::cfmakeraw(&mode);
+		::tcsetattr(slave, TCSANOW, &mode);
+	}
+
+	owned = master;
+	owned_slave = slave;
+	device = slave_name;
+	return start(master, master);
+}
+
+void SerialPort::stop()
+{
+	if (!running.exchange(false, std::memory_order_acq_rel))
+	{
+		return;
+	}
+	thread.join();
+
+	for (int *fd : {&owned, &owned_slave})
+	{
+		if (*fd >= 0)
+		{
+			::close(*fd);
+			*fd = -1;
+		}
+	}
+	in = out = -1;
+}
+
+void SerialPort::pump()
+{
+	Byte buffer[CHUNK];
+	int input = in;
+
+	while (running.load(std::memory_order_acquire))
+	{
+		std::size_t space = acia.inputSpace();
+		if (input < 0 || space == 0)
+		{
+			// nothing to read, or the guest hasn't caught up with what it was given
+			std::this_thread::sleep_for(IDLE);
+		}
+		else
+		{
+			pollfd ready{input, POLLIN, 0};
+			if (::poll(&ready, 1, int(IDLE.count())) > 0)
+			{
+				ssize_t count = ::read(input, buffer, std::min(space, CHUNK));
+				if (count > 0)
+				{
+					acia.input(buffer, std::size_t(count));
+				}
+				else if (count == 0 || (errno != EINTR && errno != EAGAIN))
+				{
+					input = -1;
+				}
+			}
+		}
+		drain();
+	}
+	drain();
+}
+
+// without an output the bytes go nowhere, like a line with nothing on the other end
+void SerialPort::drain()
+{
+	Byte buffer[CHUNK];
+	std::size_t count;
+	while ((count = acia.output(buffer, CHUNK)) != 0)
+	{
+		for (std::size_t done = 0; out >= 0 && done < count;)
+		{
+			ssize_t written = ::write(out, buffer + done, count - done);
+			if (written > 0)
+			{
+				done += std::size_t(written);
+			}
+			else if (written < 0 && errno != EINTR && errno != EAGAIN)
+			{
+				break;
+			}
+		}
+	}
+}
+
+#else
+
+bool SerialPort::start(int, int) { return false; }
+bool SerialPort::startFile(const std::string &) { return false; }
+bool SerialPort::startPty() { return false; }
+void SerialPort::stop() {}
+void SerialPort::pump() {}
+void SerialPort::drain() {}
+
+#endif
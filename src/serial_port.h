@@ -0,0 +1,49 @@
+#ifndef SERIAL_PORT_H
+#define SERIAL_PORT_H
+
+#include "types.h"
+#include "acia.h"
+#include <atomic>
+#include <string>
+#include <thread>
+
+/*
+ * The host end of an Acia: a thread that moves bytes between its rings and file descriptors,
+ * so the CPU thread never makes a system call for serial I/O.
+ * It waits in poll() on the input for at most a millisecond, then drains whatever the guest
+ * sent to the output, blocking there if it has to. Input is only read as far as the ring has
+ * room, the rest waits in the kernel. Reaching the end of the input just stops reading.
+ * stop(), and the destructor, drain the output one last time, the Acia has to outlive it.
+ * POSIX only; elsewhere the start functions fail.
+ */
+class SerialPort
+{
+public:
+    explicit SerialPort(Acia &acia) : acia(acia) {}
+    ~SerialPort() { stop(); }
+
+    SerialPort(const SerialPort &) = delete;
+    SerialPort &operator=(const SerialPort &) = delete;
+
+    // -1 for a direction that isn't connected; the descriptors stay open when the port stops
+    bool start(int input_fd, int output_fd);
+    bool startStdio() { return start(0, 1); }
+    bool startFile(const std::string &path); // output only, the file is truncated
+    bool startPty();                         // both ways, through a new pseudo terminal, see name()
+    void stop();
+
+    const std::string &name() const { return device; } // the pty or file it is connected to
+
+private:
+    void pump();
+    void drain();
+
+    Acia &acia;
+    std::thread thread;
+    std::atomic<bool> running{false};
+    int in = -1, out = -1;
+    int owned = -1, owned_slave = -1; // the file or both ends of the pty, closed on stop()
+    std::string device;
+};
+
+#endif // SERIAL_PORT_H
@@ -0,0 +1,86 @@
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include "types.h"
+#include <atomic>
+#include <cstddef>
+
+/*
+ * A bounded lock-free queue between exactly one producer thread and one consumer thread.
+ * Each side owns one index and only reads the other's, so neither ever waits: push() fails
+ * when the ring is full and pop() when it is empty. The indices sit on cache lines of their
+ * own so the two threads don't keep stealing each other's line.
+ * Capacity has to be a power of two, the indices run freely and are masked on access.
+ */
+template <typename T, std::size_t Capacity>
+class SpscRing
+{
+    static_assert(Capacity != 0 && (Capacity & (Capacity - 1)) == 0, "Capacity has to be a power of two");
+
+public:
+    constexpr static std::size_t CAPACITY = Capacity;
+
+    // producer side
+    bool push(const T &value)
+    {
+        std::size_t tail = write_index.load(std::memory_order_relaxed);
+        if (tail - read_index.load(std::memory_order_acquire) == Capacity)
+        {
+            return false;
+        }
+        slots[tail & (Capacity - 1)] = value;
+        write_index.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // as much of data as fits, in one release
+    std::size_t push(const T *data, std::size_t count)
+    {
+        std::size_t tail = write_index.load(std::memory_order_relaxed);
+        std::size_t free = Capacity - (tail - read_index.load(std::memory_order_acquire));
+        count = count < free ? count : free;
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            slots[(tail + i) & (Capacity - 1)] = data[i];
+        }
+        write_index.store(tail + count, std::memory_order_release);
+        return count;
+    }
+
+    // consumer side
+    bool pop(T &value)
+    {
+        std::size_t head = read_index.load(std::memory_order_relaxed);
+        if (head == write_index.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+        value = slots[head & (Capacity - 1)];
+        read_index.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    std::size_t pop(T *data, std::size_t count)
+    {
+        std::size_t head = read_index.load(std::memory_order_relaxed);
+        std::size_t available = write_index.load(std::memory_order_acquire) - head;
+        count = count < available ? count : available;
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            data[i] = slots[(head + i) & (Capacity - 1)];
+        }
+        read_index.store(head + count, std::memory_order_release);
+        return count;
+    }
+
+    // either side, already stale by the time the other one moves
+    std::size_t size() const { return write_index.load(std::memory_order_acquire) - read_index.load(std::memory_order_acquire); }
+    bool empty() const { return size() == 0; }
+
+private:
+    alignas(64) std::atomic<std::size_t> write_index{0};
+    alignas(64) std::atomic<std::size_t> read_index{0};
+    alignas(64) T slots[Capacity];
+};
+
+#endif // SPSC_RING_H
@@ -0,0 +1,169 @@
+#include "mos6502.h"
+#include "opcodes.h"
+#include <type_traits>
+
+/*
+ * Direct-threaded interpreter.
+ * Every opcode gets its own label ending in its own indirect jump to the next opcode,
+ * so the branch predictor sees one dispatch site per handler instead of a single shared one.
+ * The registers and the cycle counter are copied into locals for the whole run and only
+ * written back on exit. The counter is also published before each instruction for devices to
+ * read, only a call out to a device can see it, so the compiler is free to sink that store.
+ * The cycle limit is only checked after instructions that end a block,
+ * any loop has one of those, so straight-line code pays nothing for it.
+ * Opcodes and their operand bytes are read through a local window onto the current code page
+ * while that page is plain memory. Only a write can remap a page, so instructions that write
+ * re-check the layout. Instructions the window doesn't cover go through cycle() one at a time.
+ * Compilers without computed goto (labels as values) fall back to a plain switch.
+ */
+#if defined(__GNUC__) || defined(__clang__)
+#define THREADED_COMPUTED_GOTO 1
+#else
+#define THREADED_COMPUTED_GOTO 0
+#endif
+
+// BRK stops the program outside of the test suite, exactly like cycle()
+#define THREADED_EXECUTE(code, op, mode)                                        \
+	if (std::is_same_v<ops::op, ops::BRK> && !testing)                          \
+	{                                                                           \
+		goto halt;                                                              \
+	}                                                                           \
+	cycles = elapsed;                                                           \
+	{                                                                           \
+		Word operand = THREADED_OPERAND(mode);                                  \
+		regs.program_counter += ops::OPERAND_BYTES<AddressMode::mode>;          \
+		extra_cycles = ops::step<ops::op, AddressMode::mode>(regs, memory, operand); \
+	}                                                                           \
+	elapsed += instruction_map[code].cycles + extra_cycles;                     \
+	if (writesMemory<ops::op>() && memory.layout_generation != layout) [[unlikely]] \
+	{                                                                           \
+		layout = memory.layout_generation;                                      \
+		code_page = CLOSED;                                                     \
+	}                                                                           \
+	if (ops::op::ENDS_BLOCK && elapsed >= cycle_limit)                          \
+	{                                                                           \
+		goto limit;                                                             \
+	}
+
+// the stores and read-modify-writes plus everything that pushes onto the stack
+template<typename Op>
+constexpr bool writesMemory()
+{
+	return Op::WRITES || std::is_same_v<Op, ops::PHA> || std::is_same_v<Op, ops::PHP> ||
+		   std::is_same_v<Op, ops::JSR> || std::is_same_v<Op, ops::BRK>;
+}
+
+// the window is only used when the longest instruction fits on it from pc, one compare covers the
+// opcode and the operand bytes. The window is reopened on the page pc moved to if that is plain
+// memory, anything else takes the slow path.
+#define THREADED_FETCH(opcode)                                                   \
+	if (((regs.program_counter + 2u) >> 8) != code_page) [[unlikely]]           \
+	{                                                                           \
+		unsigned page = regs.program_counter >> 8;                              \
+		if (!memory.direct_read[page] || ((regs.program_counter + 2u) >> 8) != page) \
+		{                                                                       \
+			goto slow;                                                          \
+		}                                                                       \
+		code_page = page;                                                       \
+		code = memory.memory + (page << 8);                                     \
+	}                                                                           \
+	opcode = code[regs.program_counter & 0xFF];
+
+#define THREADED_OPERAND(mode)                                       \
+	(ops::OPERAND_BYTES<AddressMode::mode> == 0 ? Word(0)            \
+	 : ops::OPERAND_BYTES<AddressMode::mode> == 1                    \
+		 ? Word(code[(regs.program_counter & 0xFF) + 1])             \
+		 : Word(code[(regs.program_counter & 0xFF) + 1] | (code[(regs.program_counter & 0xFF) + 2] << 8)))
+
+// one instruction through the bus with cycle(), for code on device pages and the last two bytes of a page
+#define THREADED_SLOW()                       \
+	cpu = regs;                               \
+	cycles = elapsed;                         \
+	if (!cycle())                             \
+	{                                         \
+		return false;                         \
+	}                                         \
+	regs = cpu;                               \
+	elapsed = cycles;                         \
+	layout = memory.layout_generation;        \
+	code_page = CLOSED;                       \
+	if (elapsed >= cycle_limit)               \
+	{                                         \
+		goto limit;                           \
+	}
+
+bool Emulator::runThreaded(const std::uint64_t &cycle_limit)
+{
+	MOS_6502 regs = cpu;
+	Memory &memory = mem;
+	Byte extra_cycles = 0;
+	std::uint64_t elapsed = cycles;
+	constexpr unsigned CLOSED = ~0u;
+	unsigned code_page = CLOSED;
+	const Byte *code = nullptr;
+	Byte opcode = 0;
+	std::uint32_t layout = memory.layout_generation;
+
+#if THREADED_COMPUTED_GOTO
+	void *dispatch[0x100];
+	for (auto &label : dispatch)
+	{
+		label = &&halt;
+	}
+#define X(code, op, mode) dispatch[code] = &&op_##code;
+	OFFICIAL_OPCODES(X)
+#undef X
+
+#define NEXT()             \
+	THREADED_FETCH(opcode) \
+	goto *dispatch[opcode]
+	NEXT();
+
+slow:
+	THREADED_SLOW()
+	NEXT();
+
+#define X(code, op, mode)             \
+	op_##code:                        \
+	{                                 \
+		THREADED_EXECUTE(code, op, mode) \
+		NEXT();                       \
+	}
+	OFFICIAL_OPCODES(X)
+#undef X
+#undef NEXT
+
+#else
+	for (;;)
+	{
+		THREADED_FETCH(opcode)
+		switch (opcode)
+		{
+#define X(code, op, mode)             \
+	case code:                        \
+	{                                 \
+		THREADED_EXECUTE(code, op, mode) \
+		break;                        \
+	}
+			OFFICIAL_OPCODES(X)
+#undef X
+		default:
+			goto halt;
+		}
+		continue;
+
+	slow:
+		THREADED_SLOW()
+	}
+#endif
+
+halt:
+	cpu = regs;
+	cycles = elapsed;
+	return false;
+
+limit:
+	cpu = regs;
+	cycles = elapsed;
+	return true;
+}
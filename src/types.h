@@ -9,6 +9,21 @@ using SignedByte = std::int8_t;
 using Word = std::uint16_t;
 
 constexpr std::size_t WORD_MAX = std::numeric_limits<Word>::max();
-constexpr int CLOCK_uS = 1; // The clock time of the cpu, assuming 1 MHZ model
+
+// for the few hot paths the inliner gives up on in the big interpreter loops
+#if defined(__GNUC__) || defined(__clang__)
+#define FORCE_INLINE inline __attribute__((always_inline))
+#else
+#define FORCE_INLINE inline
+#endif
+
+// mmap, file descriptors and termios for the host side: ROM and disk images, serial ports, shared frames
+#if defined(__unix__) || defined(__APPLE__)
+#define MOS6502_POSIX 1
+#else
+#define MOS6502_POSIX 0
+#endif
+
+constexpr double CLOCK_HZ = 1'000'000; // The clock rate of the cpu, assuming 1 MHZ model
 
 #endif // TYPES_H
\ No newline at end of file
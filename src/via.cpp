@@ -0,0 +1,315 @@
+#include "via.h"
+#include <algorithm>
+
+namespace
+{
+	constexpr std::size_t STATE_SIZE = 23;
+}
+
+Via::Via(Emulator &emulator, unsigned irq_source) : ClockedDevice(emulator), irq_source(irq_source) {}
+
+Via::~Via()
+{
+	if (irq_asserted)
+	{
+		emulator.interrupts.releaseIrq(irq_source);
+	}
+}
+
+void Via::update(std::uint64_t cycle) const
+{
+	if (cycle >= t1_next)
+	{
+		// the counter reloads from the latch on every underflow, one-shot mode only stops interrupting
+		if (t1_armed)
+		{
+			ifr |= IRQ_T1;
+			t1_armed = acr & T1_FREE_RUN;
+		}
+		t1_next += ((cycle - t1_next) / t1Period() + 1) * t1Period();
+	}
+
+	if (t2_armed && !(acr & T2_PULSES) && cycle >= t2_next)
+	{
+		ifr |= IRQ_T2;
+		t2_armed = false;
+	}
+
+	if (sr_busy && cycle >= sr_done)
+	{
+		// CB2 idles high, so shifting in fills the register with ones, shifting out recirculates it
+		ifr |= IRQ_SR;
+		sr_busy = false;
+		if (shiftMode() < 4)
+		{
+			sr = 0xFF;
+		}
+	}
+}
+
+void Via::settle()
+{
+	bool irq = ifr & ier & ~IRQ_ANY;
+	if (irq != irq_asserted)
+	{
+		irq_asserted = irq;
+		if (irq)
+		{
+			emulator.interrupts.assertIrq(irq_source);
+		}
+		else
+		{
+			emulator.interrupts.releaseIrq(irq_source);
+		}
+	}
+
+	// the earliest deadline that can raise an enabled flag, none while they are all idle or masked
+	std::uint64_t wake = Scheduler::NEVER;
+	if (t1_armed && (ier & IRQ_T1))
+	{
+		wake = std::min(wake, t1_next);
+	}
+	if (t2_armed && !(acr & T2_PULSES) && (ier & IRQ_T2))
+	{
+		wake = std::min(wake, t2_next);
+	}
+	if (sr_busy && (ier & IRQ_SR))
+	{
+		wake = std::min(wake, sr_done);
+	}
+
+	if (wake == Scheduler::NEVER)
+	{
+		sleep();
+	}
+	else
+	{
+		wakeAt(wake);
+	}
+}
+
+void Via::signal(Byte flag)
+{
+	sync();
+	ifr |= flag;
+	settle();
+}
+
+// reads 0 on the cycle the counter wraps, $FFFF for the one after, then the latch
+Word Via::t1Counter(std::uint64_t cycle) const
+{
+	std::uint64_t remaining = t1_next - cycle - 1;
+	return remaining > t1_latch ? 0xFFFF : Word(remaining);
+}
+
+// one-shot only, after the interrupt it just keeps counting down through $FFFF
+Word Via::t2Counter(std::uint64_t cycle) const
+{
+	return (acr & T2_PULSES) ? t2_frozen : Word(t2_next - cycle - 1);
+}
+
+// 8 bits at one per T2 timeout pair or one per 2 cycles, the external clock never comes
+void Via::startShift(std::uint64_t cycle)
+{
+	unsigned mode = shiftMode();
+	ifr &= ~IRQ_SR;
+	sr_busy = mode != 0 && mode != 3 && mode != 4 && mode != 7;
+	std::uint64_t bit = (mode == 2 || mode == 6) ? 2 : 2 * (std::uint64_t(t2_latch_low) + 2);
+	sr_done = cycle + 8 * bit;
+}
+
+Byte Via::readRegister(Word address)
+{
+	std::uint64_t cycle = now();
+
+	Byte value = 0;
+	switch (address & 0x0F)
+	{
+	case ORB:
+		value = portB();
+		ifr &= ~(IRQ_CB1 | IRQ_CB2);
+		break;
+	case ORA:
+		value = portA();
+		ifr &= ~(IRQ_CA1 | IRQ_CA2);
+		break;
+	case DDRB:
+		value = ddrb;
+		break;
+	case DDRA:
+		value = ddra;
+		break;
+	case T1C_L:
+		value = Byte(t1Counter(cycle));
+		ifr &= ~IRQ_T1;
+		break;
+	case T1C_H:
+		value = Byte(t1Counter(cycle) >> 8);
+		break;
+	case T1L_L:
+		value = Byte(t1_latch);
+		break;
+	case T1L_H:
+		value = Byte(t1_latch >> 8);
+		break;
+	case T2C_L:
+		value = Byte(t2Counter(cycle));
+		ifr &= ~IRQ_T2;
+		break;
+	case T2C_H:
+		value = Byte(t2Counter(cycle) >> 8);
+		break;
+	case SR:
+		value = sr;
+		startShift(cycle);
+		break;
+	case ACR:
+		value = acr;
+		break;
+	case PCR:
+		value = pcr;
+		break;
+	case IFR:
+		value = ifr | ((ifr & ier & ~IRQ_ANY) ? IRQ_ANY : 0);
+		break;
+	case IER:
+		value = ier | IRQ_ANY;
+		break;
+	case ORA_NO_HANDSHAKE:
+		value = portA();
+		break;
+	}
+
+	settle();
+	return value;
+}
+
+void Via::writeRegister(Word address, Byte value)
+{
+	std::uint64_t cycle = now();
+
+	switch (address & 0x0F)
+	{
+	case ORB:
+		orb = value;
+		ifr &= ~(IRQ_CB1 | IRQ_CB2);
+		break;
+	case ORA:
+		ora = value;
+		ifr &= ~(IRQ_CA1 | IRQ_CA2);
+		break;
+	case DDRB:
+		ddrb = value;
+		break;
+	case DDRA:
+		ddra = value;
+		break;
+	case T1C_L:
+	case T1L_L:
+		t1_latch = (t1_latch & 0xFF00) | value;
+		break;
+	case T1C_H:
+		t1_latch = (t1_latch & 0x00FF) | (value << 8);
+		t1_next = cycle + t1_latch + 1;
+		t1_armed = true;
+		ifr &= ~IRQ_T1;
+		break;
+	case T1L_H:
+		t1_latch = (t1_latch & 0x00FF) | (value << 8);
+		ifr &= ~IRQ_T1;
+		break;
+	case T2C_L:
+		t2_latch_low = value;
+		break;
+	case T2C_H:
+		t2_frozen = Word(t2_latch_low | (value << 8));
+		t2_next = cycle + t2_frozen + 1;
+		t2_armed = true;
+		ifr &= ~IRQ_T2;
+		break;
+	case SR:
+		sr = value;
+		startShift(cycle);
+		break;
+	case ACR:
+		if ((acr ^ value) & T2_PULSES)
+		{
+			// T2 stops where it is, or carries on from there
+			t2_frozen = t2Counter(cycle);
+			t2_next = cycle + t2_frozen + 1;
+		}
+		acr = value;
+		break;
+	case PCR:
+		pcr = value;
+		break;
+	case IFR:
+		ifr &= ~(value & ~IRQ_ANY);
+		break;
+	case IER:
+		ier = (value & IRQ_ANY) ? ier | (value & ~IRQ_ANY) : ier & ~value;
+		break;
+	case ORA_NO_HANDSHAKE:
+		ora = value;
+		break;
+	}
+
+	settle();
+}
+
+// the timers are stored as cycles to go, so they carry on from whatever cycle the state is loaded at
+void Via::saveState(std::vector<Byte> &out) const
+{
+	std::uint64_t cycle = now();
+	update(cycle);
+
+	std::size_t at = out.size();
+	out.resize(at + STATE_SIZE);
+	Byte *state = &out[at];
+	state[0] = ora;
+	state[1] = orb;
+	state[2] = ddra;
+	state[3] = ddrb;
+	putLittleEndian(state + 4, t1_latch, 2);
+	putLittleEndian(state + 6, t1_next - cycle, 4);
+	state[10] = t2_latch_low;
+	putLittleEndian(state + 11, t2Counter(cycle), 2);
+	state[13] = sr;
+	state[14] = acr;
+	state[15] = pcr;
+	state[16] = ifr;
+	state[17] = ier;
+	state[18] = t1_armed | (t2_armed << 1) | (sr_busy << 2);
+	putLittleEndian(state + 19, sr_busy ? sr_done - cycle : 0, 4);
+}
+
+bool Via::loadState(const Byte *data, std::size_t size)
+{
+	if (size != STATE_SIZE)
+	{
+		return false;
+	}
+
+	std::uint64_t cycle = now();
+	ora = data[0];
+	orb = data[1];
+	ddra = data[2];
+	ddrb = data[3];
+	t1_latch = Word(getLittleEndian(data + 4, 2));
+	t1_next = cycle + getLittleEndian(data + 6, 4);
+	t2_latch_low = data[10];
+	t2_frozen = Word(getLittleEndian(data + 11, 2));
+	t2_next = cycle + t2_frozen + 1;
+	sr = data[13];
+	acr = data[14];
+	pcr = data[15];
+	ifr = data[16];
+	ier = data[17];
+	t1_armed = data[18] & 1;
+	t2_armed = data[18] & 2;
+	sr_busy = data[18] & 4;
+	sr_done = cycle + getLittleEndian(data + 19, 4);
+
+	settle();
+	return true;
+}
@@ -0,0 +1,115 @@
+#ifndef VIA_H
+#define VIA_H
+
+#include "types.h"
+#include "clocked_device.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/*
+ * A 6522 VIA: ports A and B, timers T1 and T2 and the shift register, 16 registers mirrored
+ * across the pages it is mapped on.
+ * Nothing ticks. The timers remember the cycle of their next underflow, catching up works the
+ * counters and the interrupt flags out from there in closed form however long it has been.
+ * Only a timer or shift whose interrupt is enabled in IER asks for a deadline, so idle timers
+ * cost nothing at all.
+ * The handshake lines CA2/CB2, latching and PB7 output are not modelled; CA1 and CB1 are edges
+ * the host signals with ca1() and cb1(). Like every device it is only touched from the CPU thread.
+ */
+class Via : public ClockedDevice
+{
+public:
+    // register select, the low 4 bits of the address
+    enum Register : Byte
+    {
+        ORB,
+        ORA,
+        DDRB,
+        DDRA,
+        T1C_L,
+        T1C_H,
+        T1L_L,
+        T1L_H,
+        T2C_L,
+        T2C_H,
+        SR,
+        ACR,
+        PCR,
+        IFR,
+        IER,
+        ORA_NO_HANDSHAKE,
+    };
+
+    /* IFR and IER bits */
+    constexpr static Byte IRQ_CA2 = 0x01;
+    constexpr static Byte IRQ_CA1 = 0x02;
+    constexpr static Byte IRQ_SR  = 0x04;
+    constexpr static Byte IRQ_CB2 = 0x08;
+    constexpr static Byte IRQ_CB1 = 0x10;
+    constexpr static Byte IRQ_T2  = 0x20;
+    constexpr static Byte IRQ_T1  = 0x40;
+    constexpr static Byte IRQ_ANY = 0x80;
+
+    /* ACR bits */
+    constexpr static Byte T1_FREE_RUN = 0x40;
+    constexpr static Byte T2_PULSES   = 0x20; // counts PB6 pulses, which never come, so T2 stands still
+
+    // holds IRQ source irq_source of emulator.interrupts while an enabled flag is set
+    explicit Via(Emulator &emulator, unsigned irq_source = 0);
+    ~Via() override;
+
+    void saveState(std::vector<Byte> &out) const override;
+    bool loadState(const Byte *data, std::size_t size) override;
+
+    // the pins as seen from outside: the output register where DDR is set, the inputs elsewhere
+    Byte portA() const { return (ora & ddra) | (input_a & ~ddra); }
+    Byte portB() const { return (orb & ddrb) | (input_b & ~ddrb); }
+
+    // an active edge on CA1/CB1
+    void ca1() { signal(IRQ_CA1); }
+    void cb1() { signal(IRQ_CB1); }
+
+    Byte input_a = 0xFF; // undriven inputs read high
+    Byte input_b = 0xFF;
+
+protected:
+    Byte readRegister(Word address) override;
+    void writeRegister(Word address, Byte value) override;
+    void catchUp(std::uint64_t, std::uint64_t to) override { update(to); }
+    void deadline(std::uint64_t) override { settle(); }
+
+private:
+    // the counters and the flags as of cycle, mutable so saving the state can catch them up too
+    void update(std::uint64_t cycle) const;
+    void settle(); // the IRQ line and the deadline after anything changed
+    void signal(Byte flag);
+
+    std::uint64_t t1Period() const { return t1_latch + 2; }
+    Word t1Counter(std::uint64_t cycle) const;
+    Word t2Counter(std::uint64_t cycle) const;
+    unsigned shiftMode() const { return (acr >> 2) & 7; }
+    void startShift(std::uint64_t cycle);
+
+    unsigned irq_source;
+    bool irq_asserted = false;
+
+    Byte ora = 0, orb = 0, ddra = 0, ddrb = 0;
+    Byte acr = 0, pcr = 0, ier = 0;
+    mutable Byte ifr = 0;
+
+    Word t1_latch = 0;
+    mutable std::uint64_t t1_next = 0; // the cycle the counter next goes past 0
+    mutable bool t1_armed = false;     // one-shot mode only interrupts once per T1C-H write
+
+    Byte t2_latch_low = 0;
+    std::uint64_t t2_next = 0;
+    Word t2_frozen = 0; // the counter while it counts pulses
+    mutable bool t2_armed = false;
+
+    mutable Byte sr = 0;
+    std::uint64_t sr_done = 0;
+    mutable bool sr_busy = false;
+};
+
+#endif // VIA_H
@@ -0,0 +1,278 @@
+#include "catch2/catch_all.hpp"
+#include "mos6502.h"
+#include "acia.h"
+#include "serial_port.h"
+#include "spsc_ring.h"
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if MOS6502_POSIX
+#include <unistd.h>
+#endif
+
+constexpr Word ACIA = 0x6000;
+
+// runs the guest until done() or a couple of seconds have passed, the host side lives on other threads
+template <typename Done>
+static bool runUntilDone(Emulator &emulator, Done done)
+{
+    auto give_up = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+    while (!done())
+    {
+        if (std::chrono::steady_clock::now() > give_up)
+        {
+            return false;
+        }
+        emulator.run(100'000);
+    }
+    return true;
+}
+
+TEST_CASE("SPSC ring keeps order across threads")
+{
+    SpscRing<std::uint32_t, 64> ring;
+    constexpr std::uint32_t COUNT = 200'000;
+
+    std::thread producer([&]
+    {
+        for (std::uint32_t i = 0; i < COUNT;)
+        {
+            if (ring.push(i))
+            {
+                i++;
+            }
+            else
+            {
+                std::this_thread::yield();
+            }
+        }
+    });
+
+    std::uint32_t expected = 0, value;
+    bool ordered = true;
+    while (expected < COUNT)
+    {
+        if (ring.pop(value))
+        {
+            ordered &= value == expected++;
+        }
+        else
+        {
+            std::this_thread::yield();
+        }
+    }
+    producer.join();
+
+    REQUIRE(ordered);
+    REQUIRE(ring.empty());
+}
+
+TEST_CASE("ACIA registers")
+{
+    Emulator::testing = true;
+    Emulator emulator;
+    Acia acia(emulator);
+    emulator.mem.mapDevice(ACIA >> 8, 1, acia);
+    Byte sent[8];
+
+    SECTION("transmit is paced at the baud rate")
+    {
+        emulator.mem.writeByte(ACIA + Acia::CONTROL, 0x0F); // 19200, 8N1
+        emulator.mem.writeByte(ACIA + Acia::COMMAND, Acia::DTR | Acia::RX_IRQ_DISABLE);
+        std::uint64_t character = acia.charCycles();
+        REQUIRE(character == 521); // 10 bits at 1 MHz
+
+        emulator.mem.writeByte(ACIA + Acia::DATA, 'A'); // straight into the shift register
+        REQUIRE(emulator.mem.readByte(ACIA + Acia::STATUS) & Acia::TDRE);
+        emulator.mem.writeByte(ACIA + Acia::DATA, 'B');
+        REQUIRE_FALSE(emulator.mem.readByte(ACIA + Acia::STATUS) & Acia::TDRE);
+        REQUIRE(emulator.scheduler.next() == emulator.cycles + character);
+
+        emulator.cycles += character - 1;
+        REQUIRE_FALSE(emulator.mem.readByte(ACIA + 4 + Acia::STATUS) & Acia::TDRE); // mirrored every 4 bytes
+        emulator.cycles += 1;
+        REQUIRE(emulator.mem.readByte(ACIA + Acia::STATUS) & Acia::TDRE);
+        REQUIRE(emulator.scheduler.next() == Scheduler::NEVER);
+
+        REQUIRE(acia.output(sent, sizeof(sent)) == 2);
+        REQUIRE(std::string(sent, sent + 2) == "AB");
+    }
+
+    SECTION("a full output ring holds the guest back")
+    {
+        emulator.mem.writeByte(ACIA + Acia::COMMAND, Acia::DTR);
+        for (std::size_t i = 0; i < Acia::Ring::CAPACITY + 1; ++i)
+        {
+            emulator.mem.writeByte(ACIA + Acia::DATA, Byte(i));
+        }
+        REQUIRE_FALSE(emulator.mem.readByte(ACIA + Acia::STATUS) & Acia::TDRE);
+
+        REQUIRE(acia.output(sent, sizeof(sent)) == sizeof(sent));
+        emulator.cycles += 100;
+        emulator.scheduler.dispatch(emulator.cycles);
+        REQUIRE(emulator.mem.readByte(ACIA + Acia::STATUS) & Acia::TDRE);
+    }
+
+    SECTION("receive")
+    {
+        const Byte text[] = {'h', 'i'};
+        REQUIRE(acia.input(text, 2) == 2);
+        REQUIRE_FALSE(emulator.mem.readByte(ACIA + Acia::STATUS) & Acia::RDRF); // DTR off, the receiver is too
+
+        emulator.mem.writeByte(ACIA + Acia::COMMAND, Acia::DTR); // receive interrupts on
+        REQUIRE(emulator.interrupts.irq());
+        REQUIRE(emulator.mem.readByte(ACIA + Acia::STATUS) == (Acia::IRQ | Acia::RDRF | Acia::TDRE));
+        REQUIRE_FALSE(emulator.interrupts.irq());
+        REQUIRE(emulator.mem.readByte(ACIA + Acia::DATA) == 'h');
+        REQUIRE(emulator.interrupts.irq()); // the next one is there already
+        REQUIRE(emulator.mem.readByte(ACIA + Acia::STATUS) == (Acia::IRQ | Acia::RDRF | Acia::TDRE));
+        REQUIRE(emulator.mem.readByte(ACIA + Acia::DATA) == 'i');
+        REQUIRE_FALSE(emulator.interrupts.irq());
+
+        // the host raises IRQ with its input, the receiver picks the byte up on the next access
+        acia.input(text, 1);
+        REQUIRE(emulator.interrupts.irq());
+        emulator.mem.writeByte(ACIA + Acia::STATUS, 0); // programmed reset, DTR off
+        REQUIRE_FALSE(emulator.interrupts.irq());
+        REQUIRE((int)emulator.mem.readByte(ACIA + Acia::COMMAND) == 0);
+    }
+}
+
+TEST_CASE("ACIA state carries over to another machine")
+{
+    Emulator::testing = true;
+    Emulator saved;
+    Acia saved_acia(saved);
+    saved.mem.mapDevice(ACIA >> 8, 1, saved_acia);
+    saved.mem.writeByte(ACIA + Acia::CONTROL, 0x0E);
+    saved.mem.writeByte(ACIA + Acia::COMMAND, Acia::DTR | Acia::RX_IRQ_DISABLE);
+    saved.mem.writeByte(ACIA + Acia::DATA, 'x');
+    saved.mem.writeByte(ACIA + Acia::DATA, 'y');
+
+    std::vector<Byte> state;
+    saved_acia.saveState(state);
+
+    Emulator loaded;
+    loaded.cycles = 12345;
+    Acia loaded_acia(loaded);
+    loaded.mem.mapDevice(ACIA >> 8, 1, loaded_acia);
+    REQUIRE(loaded_acia.loadState(state.data(), state.size()));
+    REQUIRE_FALSE(loaded_acia.loadState(state.data(), state.size() - 1));
+
+    for (Word reg : {Acia::STATUS, Acia::COMMAND, Acia::CONTROL})
+    {
+        REQUIRE(loaded.mem.readByte(ACIA + reg) == saved.mem.readByte(ACIA + reg));
+    }
+    loaded.cycles += loaded_acia.charCycles();
+    Byte sent;
+    REQUIRE(loaded_acia.output(&sent, 1) == 0);
+    REQUIRE(loaded.mem.readByte(ACIA + Acia::STATUS) & Acia::TDRE); // 'y' went out on time
+    REQUIRE(loaded_acia.output(&sent, 1) == 1);
+    REQUIRE(sent == 'y');
+}
+
+TEST_CASE("ACIA input from another thread interrupts the guest on every engine")
+{
+    // the handler stores every received byte at $0300,X
+    std::vector<Byte> rom(0x8000, 0xEA);
+    auto put = [&](Word address, std::vector<Byte> bytes) { std::copy(bytes.begin(), bytes.end(), rom.begin() + (address - 0x8000)); };
+    put(0x8000, {
+        0xA9, 0x09, 0x8D, 0x02, 0x60, // LDA #DTR|TX_CONTROL, STA COMMAND
+        0xA2, 0x00,                   // LDX #0
+        0x58,                         // CLI
+        0x4C, 0x08, 0x80,             // JMP $8008
+    });
+    put(0x9000, {
+        0x48,                         // PHA
+        0xAD, 0x01, 0x60,             // LDA STATUS
+        0x29, 0x08,                   // AND #RDRF
+        0xF0, 0x07,                   // BEQ $900F
+        0xAD, 0x00, 0x60,             // LDA DATA
+        0x9D, 0x00, 0x03,             // STA $0300,X
+        0xE8,                         // INX
+        0x68,                         // PLA
+        0x40,                         // RTI
+    });
+    put(0xFFFE, {0x00, 0x90});
+
+    const std::string text = "hello, world";
+    Emulator::testing = true;
+    for (Engine engine : {Engine::TABLE, Engine::THREADED, Engine::BLOCK_CACHE, Engine::JIT})
+    {
+        Emulator emulator(engine);
+        emulator.jit.hot_threshold = 0;
+        Acia acia(emulator);
+        emulator.mem.mapDevice(ACIA >> 8, 1, acia);
+        emulator.loadROM(rom);
+        emulator.run(1000);
+
+        std::thread host([&]
+        {
+            for (char c : text)
+            {
+                Byte byte = Byte(c);
+                while (acia.input(&byte, 1) == 0)
+                {
+                    std::this_thread::yield();
+                }
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+            }
+        });
+        bool received = runUntilDone(emulator, [&] { return emulator.cpu.X == Byte(text.size()); });
+        host.join();
+
+        REQUIRE(received);
+        for (std::size_t i = 0; i < text.size(); ++i)
+        {
+            REQUIRE(emulator.mem.readByte(Word(0x0300 + i)) == Byte(text[i]));
+        }
+    }
+}
+
+#if MOS6502_POSIX
+TEST_CASE("Serial port echoes through file descriptors")
+{
+    std::vector<Byte> rom(0x8000, 0xEA);
+    auto put = [&](Word address, std::vector<Byte> bytes) { std::copy(bytes.begin(), bytes.end(), rom.begin() + (address - 0x8000)); };
+    put(0x8000, {
+        0xA9, 0x0B, 0x8D, 0x02, 0x60, // LDA #DTR|RX_IRQ_DISABLE|TX_CONTROL, STA COMMAND
+        0xAD, 0x01, 0x60,             // LDA STATUS
+        0x29, 0x08,                   // AND #RDRF
+        0xF0, 0xF9,                   // BEQ $8005
+        0xAD, 0x00, 0x60,             // LDA DATA
+        0x8D, 0x00, 0x60,             // STA DATA
+        0xEE, 0x00, 0x03,             // INC $0300
+        0x4C, 0x05, 0x80,             // JMP $8005
+    });
+
+    int to_guest[2], from_guest[2];
+    REQUIRE(::pipe(to_guest) == 0);
+    REQUIRE(::pipe(from_guest) == 0);
+
+    Emulator::testing = true;
+    Emulator emulator;
+    Acia acia(emulator);
+    emulator.mem.mapDevice(ACIA >> 8, 1, acia);
+    emulator.loadROM(rom);
+    emulator.mem.writeByte(0x0300, 0);
+
+    const std::string text = "ping\n";
+    {
+        SerialPort port(acia);
+        REQUIRE(port.start(to_guest[0], from_guest[1]));
+        REQUIRE(::write(to_guest[1], text.data(), text.size()) == ssize_t(text.size()));
+        REQUIRE(runUntilDone(emulator, [&] { return emulator.mem.readByte(0x0300) == Byte(text.size()); }));
+    } // stopping drains what is left
+
+    char echoed[8] = {};
+    REQUIRE(::read(from_guest[0], echoed, text.size()) == ssize_t(text.size()));
+    REQUIRE(std::string(echoed) == text);
+
+    for (int fd : {to_guest[0], to_guest[1], from_guest[0], from_guest[1]})
+    {
+        ::close(fd);
+    }
+}
+#endif
@@ -0,0 +1,96 @@
+#include "catch2/catch_all.hpp"
+#include "mos6502.h"
+#include "recompiler.h"
+#include <cstring>
+#include <vector>
+
+// testing/asm/aot_test.bin, recompiled at build time by mos6502_add_aot()
+extern const AotImage aot_test_rom;
+
+static std::vector<Byte> romOf(const AotImage &image)
+{
+    return std::vector<Byte>(image.rom, image.rom + image.rom_size);
+}
+
+TEST_CASE("Recompiler follows branches and subroutines but not computed jumps")
+{
+    Recompiler recompiler(romOf(aot_test_rom));
+    recompiler.addEntry(Memory::ROM_START);
+    recompiler.discover();
+
+    const auto &blocks = recompiler.blocks();
+    REQUIRE(blocks.count(0x8000)); // RESET
+    REQUIRE(blocks.count(0x8002)); // LOOP, a branch target
+    REQUIRE(blocks.count(0x8006)); // JSR return point
+    REQUIRE(blocks.count(0x800E)); // BNE fall through
+    REQUIRE(blocks.count(0x8019)); // DOUBLE
+    REQUIRE(!blocks.count(0x801E)); // TAIL, only reached through JMP ($0010)
+
+    REQUIRE((int)blocks.at(0x8019).end == 0x801E);
+    REQUIRE(aot_test_rom.block_count == blocks.size());
+}
+
+TEST_CASE("Recompiler stops at the end of an image without a terminator")
+{
+    Recompiler recompiler({0xEA, 0xEA}); // NOP NOP, then nothing
+    recompiler.addEntry(Memory::ROM_START);
+    recompiler.discover();
+    REQUIRE(recompiler.blocks().size() == 1);
+    REQUIRE(recompiler.blocks().at(0x8000).instructions.size() == 2);
+    REQUIRE((int)recompiler.blocks().at(0x8000).end == 0x8002);
+
+    Recompiler wrapping({0xEA, 0xEA}, 0xFFFE); // runs past $FFFF
+    wrapping.addEntry(0xFFFE);
+    wrapping.discover();
+    REQUIRE(wrapping.blocks().size() == 1);
+    REQUIRE(wrapping.blocks().at(0xFFFE).instructions.size() == 2);
+}
+
+TEST_CASE("Linked AOT images are found by their ROM")
+{
+    std::vector<Byte> rom = romOf(aot_test_rom);
+    REQUIRE(findAotImage(rom.data(), rom.size(), aot_test_rom.base) == &aot_test_rom);
+    REQUIRE(findAotImage(rom.data(), rom.size(), Word(aot_test_rom.base + 0x100)) == nullptr);
+    REQUIRE(findAotImage(rom.data(), rom.size() - 1, aot_test_rom.base) == nullptr);
+    rom[0] ^= 0xFF;
+    REQUIRE(findAotImage(rom.data(), rom.size(), aot_test_rom.base) == nullptr);
+}
+
+TEST_CASE("AOT image matches the interpreter")
+{
+    Emulator::testing = true;
+
+    Emulator table(Engine::TABLE);
+    std::memset(table.mem.memory, 0, Memory::ROM_START);
+    table.loadROM(romOf(aot_test_rom));
+    table.run();
+
+    Emulator aot(Engine::AOT);
+    std::memset(aot.mem.memory, 0, Memory::ROM_START);
+    aot.aot.attach(aot_test_rom);
+    aot.loadROM(romOf(aot_test_rom));
+    aot.run();
+
+    REQUIRE((int)aot.mem.memory[0x0301] == 3);
+    REQUIRE((int)aot.mem.memory[0x0400] == 0xAA);
+    REQUIRE(aot.cpu == table.cpu);
+    REQUIRE(aot.cycles == table.cycles);
+    REQUIRE(std::memcmp(aot.mem.memory, table.mem.memory, sizeof(table.mem.memory)) == 0);
+}
+
+TEST_CASE("AOT blocks over modified ROM bytes are interpreted")
+{
+    Emulator::testing = true;
+
+    Emulator aot(Engine::AOT);
+    aot.aot.attach(aot_test_rom);
+    aot.loadROM(romOf(aot_test_rom));
+    aot.mem.writeByte(0x801C, 0x02); // DOUBLE now adds 2
+    aot.run();
+
+    for (int x = 0; x < 0x40; ++x)
+    {
+        REQUIRE((int)aot.mem.memory[0x0300 + x] == Byte(2 * x + 2));
+    }
+    REQUIRE((int)aot.mem.memory[0x0400] == 0xAA);
+}
@@ -0,0 +1,100 @@
+#include "catch2/catch_all.hpp"
+#include "mos6502.h"
+#include "audio.h"
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <vector>
+
+constexpr Word AUDIO = 0x6000;
+
+TEST_CASE("Audio renders logged writes at their cycle")
+{
+    Emulator::testing = true;
+    Emulator emulator;
+    Audio audio(emulator, 8'000);
+    emulator.mem.mapDevice(AUDIO >> 8, 1, audio);
+
+    emulator.mem.writeByte(AUDIO + Audio::SQUARE1_LOW, 125); // 1 MHz / (16 * 125) = 500 Hz, 16 samples a wave
+    REQUIRE((int)emulator.mem.readByte(AUDIO + 8 + Audio::SQUARE1_LOW) == 125); // mirrored every 8 bytes
+    REQUIRE(emulator.scheduler.next() == Scheduler::NEVER); // no output, no event
+
+    audio.stream(true);
+    REQUIRE(emulator.scheduler.next() == emulator.cycles + 1024 * 125);
+    emulator.cycles += 1000;
+    emulator.mem.writeByte(AUDIO + Audio::SQUARE1_VOLUME, 15); // sounds from sample 8 on
+    emulator.cycles += 4000;
+    audio.render();
+    REQUIRE(audio.samples_rendered == 40);
+
+    std::int16_t samples[64];
+    REQUIRE(audio.readSamples(samples, 64) == 40);
+    for (int i = 0; i < 40; ++i)
+    {
+        int expected = i < 8 ? 0 : (i & 8) ? -8191 : 8191; // the oscillator ran on while it was silent
+        REQUIRE((int)samples[i] == expected);
+    }
+
+    // a restored snapshot goes back in time, nothing is rendered twice
+    emulator.cycles -= 1000;
+    audio.render();
+    REQUIRE(audio.samples_rendered == 40);
+
+    // a restore between two logged writes, the later one is logged at an earlier cycle
+    emulator.cycles += 2000;
+    emulator.mem.writeByte(AUDIO + Audio::SQUARE1_VOLUME, 0); // sample 48
+    emulator.cycles -= 1500;
+    emulator.mem.writeByte(AUDIO + Audio::SQUARE1_VOLUME, 15); // sample 36, already rendered
+    emulator.cycles += 2500;
+    audio.render();
+    REQUIRE(audio.samples_rendered == 56);
+    REQUIRE(audio.readSamples(samples, 64) == 16);
+    for (int i = 0; i < 16; ++i)
+    {
+        REQUIRE((int)samples[i] == (((40 + i) & 8) ? -8191 : 8191)); // the write logged last wins
+    }
+    audio.stream(false);
+    REQUIRE(emulator.scheduler.next() == Scheduler::NEVER);
+}
+
+TEST_CASE("Audio cost follows the sample rate, not the guest")
+{
+    // toggles the DAC as fast as it can
+    std::vector<Byte> rom = {
+        0xA9, 0x00,       // 8000: LDA #0
+        0x8D, 0x00, 0x60, // 8002: STA DAC
+        0x49, 0xFF,       // 8005: EOR #$FF
+        0x4C, 0x02, 0x80, // 8007: JMP $8002
+    };
+
+    auto path = (std::filesystem::temp_directory_path() / "mos6502_audio.wav").string();
+
+    Emulator::testing = true;
+    for (Engine engine : {Engine::TABLE, Engine::THREADED, Engine::BLOCK_CACHE, Engine::JIT})
+    {
+        Emulator emulator(engine);
+        Audio audio(emulator, 44'100, 512);
+        emulator.mem.mapDevice(AUDIO >> 8, 1, audio);
+        emulator.loadROM(rom);
+
+        REQUIRE(audio.openWav(path));
+        emulator.run(100'000);
+        audio.closeWav();
+
+        // every sample up to the cycle it stopped on, however many writes there were
+        std::uint64_t samples = (emulator.cycles * 44'100 + 999'999) / 1'000'000;
+        REQUIRE(audio.samples_rendered == samples);
+
+        std::ifstream file(path, std::ios::binary);
+        std::vector<Byte> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        REQUIRE(bytes.size() == 44 + 2 * samples);
+        REQUIRE(std::memcmp(bytes.data(), "RIFF", 4) == 0);
+        REQUIRE(std::memcmp(bytes.data() + 8, "WAVEfmt ", 8) == 0);
+        std::uint32_t data_size;
+        std::memcpy(&data_size, bytes.data() + 40, 4);
+        REQUIRE(data_size == 2 * samples);
+    }
+    std::remove(path.c_str());
+}
@@ -0,0 +1,70 @@
+#include "catch2/catch_all.hpp"
+#include "mos6502.h"
+#include <cstring>
+#include <vector>
+
+// 2 + 3 * 2 (DEX) + 2 * 3 (BNE taken) + 2 (BNE not taken) + 5 (LDA crossing a page) cycles
+static const std::vector<Byte> COUNTDOWN = {
+    0xA2, 0x03,       // 8000: LDX #$03
+    0xCA,             // 8002: DEX          <- loop
+    0xD0, 0xFD,       // 8003: BNE $8002
+    0xA0, 0x20,       // 8005: LDY #$20
+    0xB9, 0xF0, 0x02, // 8007: LDA $02F0,Y  crosses into $0310
+    0x02,             // 800A: DONE
+};
+
+TEST_CASE("Cycle counter includes branch and page crossing penalties")
+{
+    Emulator::testing = true;
+    Emulator emulator;
+    emulator.loadROM(COUNTDOWN);
+    emulator.run();
+
+    REQUIRE(emulator.cycles == 2 + 3 * 2 + 2 * 3 + 2 + 2 + 5);
+}
+
+TEST_CASE("Batch execution stops on its budget")
+{
+    Emulator::testing = true;
+    Emulator emulator;
+    emulator.loadROM(COUNTDOWN);
+
+    SECTION("instructions")
+    {
+        REQUIRE(emulator.runInstructions(3) == StopReason::INSTRUCTION_BUDGET);
+        REQUIRE((int)emulator.cpu.program_counter == 0x8002);
+        REQUIRE((int)emulator.cpu.X == 2);
+        REQUIRE(emulator.cycles == 2 + 2 + 3);
+    }
+
+    SECTION("cycles")
+    {
+        REQUIRE(emulator.runFor(5) == StopReason::CYCLE_BUDGET);
+        REQUIRE(emulator.cycles == 7); // LDX, DEX and the taken BNE that went past the budget
+        REQUIRE(emulator.runFor(0) == StopReason::CYCLE_BUDGET);
+        REQUIRE(emulator.cycles == 7);
+    }
+
+    SECTION("pc")
+    {
+        REQUIRE(emulator.runUntil(0x8002) == StopReason::REACHED_PC);
+        REQUIRE((int)emulator.cpu.X == 3);
+        REQUIRE(emulator.runUntil(0x8002) == StopReason::REACHED_PC); // the next time around the loop
+        REQUIRE((int)emulator.cpu.X == 2);
+        REQUIRE(emulator.runUntil(0x9000) == StopReason::HALTED);
+        REQUIRE((int)emulator.cpu.program_counter == 0x800A);
+        REQUIRE(emulator.cycles == 2 + 3 * 2 + 2 * 3 + 2 + 2 + 5);
+    }
+}
+
+TEST_CASE("Batch execution traps on BRK outside of the test suite")
+{
+    Emulator::testing = false;
+    Emulator emulator;
+    emulator.loadROM({0xA9, 0x42, 0x00});
+    StopReason reason = emulator.runFor(1000);
+    Emulator::testing = true;
+
+    REQUIRE(reason == StopReason::TRAPPED);
+    REQUIRE((int)emulator.cpu.program_counter == 0x8002);
+}
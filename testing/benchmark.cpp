@@ -0,0 +1,164 @@
+#include "mos6502.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+
+/*
+ * Throughput benchmark for the emulator core.
+ * Runs a small program (loads, stores, arithmetic, branches and a subroutine) without
+ * any delays and reports millions of emulated instructions per second for each engine,
+ * AOT included: the program is recompiled into this executable by mos6502_add_aot().
+ * It also times plain RAM accesses and instruction fetches through the Memory bus against the
+ * pointer path the opcodes used before there were devices (a bare index into the array, no
+ * bookkeeping), with a device mapped so the bus has to tell pages apart. What is left between
+ * the two is one flag test per access, nothing watches the RAM pages here.
+ *
+ * usage: ./benchmarks [rounds], every round is ~720k instructions
+ */
+
+// testing/asm/bench.S, recompiled ahead of time for the AOT row. Loads, stores, arithmetic,
+// branches and a subroutine, repeated as many times as $F0 says
+extern const AotImage bench_rom;
+constexpr Word ROUNDS = 0x00F0;
+
+using Clock = std::chrono::steady_clock;
+
+static void report(const std::string &name, std::uint64_t instructions, Clock::duration elapsed,
+                   const char *unit = "instr", const char *rate = "MIPS")
+{
+    double seconds = std::chrono::duration<double>(elapsed).count();
+    std::cout << std::left << std::setw(24) << name
+              << std::right << std::setw(12) << instructions << " " << unit << "  "
+              << std::fixed << std::setprecision(3) << std::setw(9) << seconds << " s  "
+              << std::setprecision(2) << std::setw(9) << (instructions / seconds) / 1e6 << " " << rate << std::endl;
+}
+
+// single steps through the program, this also tells us how many instructions it takes
+static std::uint64_t benchCycle(const std::vector<Byte> &program, Byte rounds)
+{
+    Emulator emulator;
+    emulator.loadROM(program);
+    emulator.mem.writeByte(ROUNDS, rounds);
+
+    std::uint64_t instructions = 0;
+    auto start = Clock::now();
+    while (emulator.cycle())
+    {
+        ++instructions;
+    }
+    report("Emulator::cycle()", instructions, Clock::now() - start);
+    return instructions;
+}
+
+static void benchRun(const std::string &name, Engine engine, const std::vector<Byte> &program, Byte rounds,
+                     std::uint64_t instructions)
+{
+    Emulator emulator(engine);
+    if (engine == Engine::AOT)
+    {
+        emulator.aot.attach(bench_rom);
+    }
+    emulator.loadROM(program);
+    emulator.mem.writeByte(ROUNDS, rounds);
+
+    auto start = Clock::now();
+    emulator.run();
+    report(name, instructions, Clock::now() - start);
+}
+
+// never touched, it only makes the bus look at every page it is asked about
+struct IdleDevice : Device
+{
+    Byte read(Word) override { return 0; }
+    void write(Word, Byte) override {}
+};
+
+// a read and a dependent write per step, scattered over the RAM below the device
+template<typename Read, typename Write>
+static Byte touchRam(std::uint64_t steps, Read read, Write write)
+{
+    Word address = 0;
+    Byte value = 0;
+    for (std::uint64_t i = 0; i < steps; ++i)
+    {
+        value += read(address);
+        write(Word(address ^ 0x2A5), value);
+        address = Word(address * 5 + 0x3B) & 0x7FFF;
+    }
+    return value;
+}
+
+// best of a few repetitions, a single pass is short enough to be thrown off by the first page faults
+template<typename Pass>
+static void benchFastest(const std::string &name, std::uint64_t accesses, Pass pass)
+{
+    Clock::duration fastest = Clock::duration::max();
+    for (int repetition = 0; repetition < 5; ++repetition)
+    {
+        auto start = Clock::now();
+        volatile Byte sink = pass();
+        (void)sink;
+        fastest = std::min(fastest, Clock::now() - start);
+    }
+    report(name, accesses, fastest, "access", "M/s");
+}
+
+template<typename Read, typename Write>
+static void benchRam(const std::string &name, std::uint64_t steps, Read read, Write write)
+{
+    benchFastest(name, steps * 2, [&] { return touchRam(steps, read, write); });
+}
+
+// opcode and operand bytes, mostly straight on through the ROM like real code
+template<typename Fetch>
+static Byte walkCode(std::uint64_t steps, Fetch fetch)
+{
+    Word pc = Memory::ROM_START;
+    Byte value = 0;
+    for (std::uint64_t i = 0; i < steps; ++i)
+    {
+        value += fetch(pc);
+        pc = Word(pc + 1 + (value & 1)) | Memory::ROM_START;
+    }
+    return value;
+}
+
+static void benchBus(std::uint64_t steps)
+{
+    Emulator emulator;
+    IdleDevice device;
+    emulator.mem.mapDevice(0xD0, 0x10, device);
+    Memory &mem = emulator.mem;
+
+    benchRam(
+        "RAM pointer path", steps, [&](Word address) { return mem.memory[address]; },
+        [&](Word address, Byte value) { mem.memory[address] = value; });
+    benchRam(
+        "RAM Memory bus", steps, [&](Word address) { return mem.readByte(address); },
+        [&](Word address, Byte value) { mem.writeByte(address, value); });
+
+    benchFastest("fetch pointer path", steps, [&] { return walkCode(steps, [&](Word pc) { return mem.memory[pc]; }); });
+    benchFastest("fetch Memory bus", steps, [&] { return walkCode(steps, [&](Word pc) { return mem.fetchByte(pc); }); });
+}
+
+int main(int argc, char *argv[])
+{
+    Byte rounds = argc > 1 ? (Byte)std::strtoul(argv[1], nullptr, 10) : 64;
+    std::vector<Byte> program(bench_rom.rom, bench_rom.rom + bench_rom.rom_size);
+
+    // no delays, we want raw throughput
+    Emulator::testing = true;
+
+    std::uint64_t instructions = benchCycle(program, rounds);
+    benchRun("run() TABLE", Engine::TABLE, program, rounds, instructions);
+    benchRun("run() THREADED", Engine::THREADED, program, rounds, instructions);
+    benchRun("run() BLOCK_CACHE", Engine::BLOCK_CACHE, program, rounds, instructions);
+    benchRun("run() JIT", Engine::JIT, program, rounds, instructions);
+    benchRun("run() AOT", Engine::AOT, program, rounds, instructions);
+    benchBus(instructions);
+    return 0;
+}
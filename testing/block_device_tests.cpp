@@ -0,0 +1,209 @@
+#include "catch2/catch_all.hpp"
+#include "mos6502.h"
+#include "block_device.h"
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+constexpr Word DISK = 0x6000;
+
+// 64 sectors of 256 bytes, each byte is its sector number plus its offset
+static std::string makeImage(const char *name)
+{
+    auto path = (std::filesystem::temp_directory_path() / name).string();
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    for (int i = 0; i < 64 * 256; ++i)
+    {
+        file.put(char((i >> 8) + (i & 0xFF)));
+    }
+    return path;
+}
+
+static void command(Emulator &emulator, unsigned sector, Word address, Byte count, Byte command)
+{
+    emulator.mem.writeByte(DISK + BlockDevice::SECTOR_LOW, Byte(sector));
+    emulator.mem.writeByte(DISK + BlockDevice::SECTOR_MIDDLE, Byte(sector >> 8));
+    emulator.mem.writeByte(DISK + BlockDevice::SECTOR_HIGH, Byte(sector >> 16));
+    emulator.mem.writeByte(DISK + BlockDevice::ADDRESS_LOW, Byte(address));
+    emulator.mem.writeByte(DISK + BlockDevice::ADDRESS_HIGH, Byte(address >> 8));
+    emulator.mem.writeByte(DISK + BlockDevice::COUNT, count);
+    emulator.mem.writeByte(DISK + BlockDevice::COMMAND, command);
+}
+
+TEST_CASE("Block device moves sectors by DMA and stalls the bus")
+{
+    auto path = makeImage("mos6502_disk.img");
+
+    Emulator::testing = true;
+    Emulator emulator;
+    BlockDevice disk(emulator);
+    emulator.mem.mapDevice(DISK >> 8, 1, disk);
+    REQUIRE((emulator.mem.readByte(DISK + BlockDevice::COMMAND) & BlockDevice::READY) == 0);
+    REQUIRE(disk.open(path));
+    REQUIRE(disk.imageSize() == 64 * 256);
+
+    SECTION("reads into RAM in one go")
+    {
+        emulator.mem.writeByte(DISK + BlockDevice::CONTROL, BlockDevice::IRQ_ENABLE);
+        emulator.mem.trackDirty(true);
+        emulator.mem.clearDirty();
+        std::uint32_t generation = emulator.mem.page_generation[0x04];
+        std::uint64_t start = emulator.cycles;
+
+        command(emulator, 3, 0x0400, 2, BlockDevice::READ);
+        for (int i = 0; i < 512; ++i)
+        {
+            REQUIRE((int)emulator.mem.memory[0x0400 + i] == Byte(3 + (i >> 8) + (i & 0xFF)));
+        }
+        REQUIRE(emulator.mem.page_generation[0x04] != generation); // decoded code goes stale
+        REQUIRE(emulator.mem.isDirty(0x05));
+        REQUIRE(emulator.mem.isLineDirty(0x05C0));
+        REQUIRE_FALSE(emulator.mem.isDirty(0x06));
+
+        // busy until the engine pays for the transfer
+        REQUIRE(emulator.mem.readByte(DISK + BlockDevice::COMMAND) == (BlockDevice::READY | BlockDevice::BUSY));
+        REQUIRE_FALSE(emulator.interrupts.irq());
+        REQUIRE(emulator.scheduler.next() == start);
+        emulator.scheduler.dispatch(emulator.cycles);
+        REQUIRE(emulator.cycles == start + BlockDevice::SETUP_CYCLES + 512);
+        REQUIRE(emulator.interrupts.irq());
+        REQUIRE(emulator.mem.readByte(DISK + BlockDevice::COMMAND) == (BlockDevice::READY | BlockDevice::IRQ));
+        REQUIRE_FALSE(emulator.interrupts.irq()); // the read acknowledged it
+        REQUIRE(disk.bytes_transferred == 512);
+    }
+
+    SECTION("512 byte sectors and ROM on the way")
+    {
+        emulator.mem.writeByte(DISK + BlockDevice::CONTROL, BlockDevice::SECTOR_512);
+        emulator.mem.protect(0x11, 1);
+        command(emulator, 2, 0x1000, 2, BlockDevice::READ); // sectors 4 to 7 of 256
+        emulator.scheduler.dispatch(emulator.cycles);
+        REQUIRE((int)emulator.mem.memory[0x1000] == 4);
+        REQUIRE((int)emulator.mem.memory[0x1100] == 0); // dropped
+        REQUIRE((int)emulator.mem.memory[0x13FF] == Byte(7 + 0xFF));
+        REQUIRE(disk.bytes_transferred == 1024);
+    }
+
+    SECTION("errors")
+    {
+        std::uint64_t start = emulator.cycles;
+        command(emulator, 63, 0x0400, 2, BlockDevice::READ); // runs past the image
+        emulator.scheduler.dispatch(emulator.cycles);
+        REQUIRE(emulator.mem.readByte(DISK + BlockDevice::COMMAND) == (BlockDevice::READY | BlockDevice::IRQ | BlockDevice::ERROR));
+        REQUIRE(emulator.cycles == start + BlockDevice::SETUP_CYCLES);
+
+        command(emulator, 0, 0xFF00, 2, BlockDevice::READ); // runs past $FFFF
+        emulator.scheduler.dispatch(emulator.cycles);
+        REQUIRE((emulator.mem.readByte(DISK + BlockDevice::COMMAND) & BlockDevice::ERROR) != 0);
+
+        command(emulator, 0, 0x0400, 1, BlockDevice::READ); // the next command clears it
+        emulator.scheduler.dispatch(emulator.cycles);
+        REQUIRE((emulator.mem.readByte(DISK + BlockDevice::COMMAND) & BlockDevice::ERROR) == 0);
+        REQUIRE(disk.bytes_transferred == 256);
+    }
+
+    SECTION("writes are marked and synced in runs")
+    {
+        for (int i = 0; i < 0x300; ++i)
+        {
+            emulator.mem.writeByte(Word(0x2000 + i), Byte(0xA0 ^ i));
+        }
+        std::uint64_t start = emulator.cycles;
+        command(emulator, 10, 0x2000, 2, BlockDevice::WRITE);
+        command(emulator, 40, 0x2100, 1, BlockDevice::WRITE);
+        command(emulator, 41, 0x2200, 1, BlockDevice::WRITE);
+        emulator.scheduler.dispatch(emulator.cycles);
+        REQUIRE(disk.dirtySectors() == 4);
+        REQUIRE(disk.syncs == 0);
+        REQUIRE(emulator.scheduler.next() == start + disk.flush_cycles); // from the first write
+
+        command(emulator, 0, 0, 1, BlockDevice::FLUSH);
+        REQUIRE(disk.dirtySectors() == 0);
+        REQUIRE(disk.syncs > 0);
+        REQUIRE(disk.syncs <= 2); // the two runs, or one if they share a host page
+        emulator.scheduler.dispatch(emulator.cycles);
+        REQUIRE(emulator.scheduler.next() == Scheduler::NEVER);
+        disk.close();
+
+        std::ifstream file(path, std::ios::binary);
+        std::vector<Byte> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        REQUIRE(bytes.size() == 64 * 256);
+        REQUIRE((int)bytes[10 * 256] == 0xA0);
+        REQUIRE((int)bytes[11 * 256 + 0xFF] == Byte(0xA0 ^ 0x1FF));
+        REQUIRE((int)bytes[40 * 256 + 1] == Byte(0xA0 ^ 0x101));
+        REQUIRE((int)bytes[41 * 256 + 2] == Byte(0xA0 ^ 0x202));
+        REQUIRE((int)bytes[12 * 256] == 12); // untouched
+    }
+
+    std::filesystem::remove(path);
+}
+
+TEST_CASE("Block device state carries over to another machine")
+{
+    Emulator::testing = true;
+    Emulator saved;
+    BlockDevice saved_disk(saved);
+    saved.mem.mapDevice(DISK >> 8, 1, saved_disk);
+    saved.mem.writeByte(DISK + BlockDevice::CONTROL, BlockDevice::IRQ_ENABLE);
+    command(saved, 0x123456, 0x1234, 7, BlockDevice::READ); // no image, an error
+
+    std::vector<Byte> state;
+    saved_disk.saveState(state);
+
+    Emulator loaded;
+    BlockDevice loaded_disk(loaded);
+    loaded.mem.mapDevice(DISK >> 8, 1, loaded_disk);
+    REQUIRE(loaded_disk.loadState(state.data(), state.size()));
+    REQUIRE_FALSE(loaded_disk.loadState(state.data(), state.size() - 1));
+
+    for (Word reg = 0; reg < BlockDevice::COMMAND; ++reg)
+    {
+        REQUIRE(loaded.mem.readByte(DISK + reg) == saved.mem.readByte(DISK + reg));
+    }
+    REQUIRE((int)loaded.mem.readByte(DISK + BlockDevice::CONTROL) == BlockDevice::IRQ_ENABLE);
+    REQUIRE(loaded.interrupts.irq()); // the command in flight counts as completed
+    REQUIRE(loaded.mem.readByte(DISK + BlockDevice::COMMAND) == (BlockDevice::IRQ | BlockDevice::ERROR));
+}
+
+TEST_CASE("Block device loads a guest program on every engine")
+{
+    // reads sectors 4 and 5 to $0400 and waits for the IRQ, the handler counts in $0300
+    std::vector<Byte> rom(0x8000, 0xEA);
+    auto put = [&](Word address, std::vector<Byte> bytes) { std::copy(bytes.begin(), bytes.end(), rom.begin() + (address - 0x8000)); };
+    put(0x8000, {
+        0xA9, 0x04, 0x8D, 0x00, 0x60, // LDA #4, STA SECTOR_LOW
+        0xA9, 0x00, 0x8D, 0x03, 0x60, // LDA #0, STA ADDRESS_LOW
+        0xA9, 0x04, 0x8D, 0x04, 0x60, // LDA #4, STA ADDRESS_HIGH
+        0xA9, 0x02, 0x8D, 0x05, 0x60, // LDA #2, STA COUNT
+        0xA9, 0x01, 0x8D, 0x07, 0x60, // LDA #IRQ_ENABLE, STA CONTROL
+        0x58,                         // CLI
+        0xA9, 0x01, 0x8D, 0x06, 0x60, // LDA #READ, STA COMMAND
+        0x4C, 0x1F, 0x80,             // JMP $801F
+    });
+    put(0x9000, {0xAD, 0x06, 0x60, 0xEE, 0x00, 0x03, 0x40}); // LDA STATUS, INC $0300, RTI
+    put(0xFFFE, {0x00, 0x90});
+
+    auto path = makeImage("mos6502_disk_guest.img");
+
+    Emulator::testing = true;
+    for (Engine engine : {Engine::TABLE, Engine::THREADED, Engine::BLOCK_CACHE, Engine::JIT})
+    {
+        Emulator emulator(engine);
+        emulator.jit.hot_threshold = 0;
+        BlockDevice disk(emulator);
+        emulator.mem.mapDevice(DISK >> 8, 1, disk);
+        REQUIRE(disk.open(path));
+        emulator.loadROM(rom);
+        emulator.mem.writeByte(0x0300, 0);
+
+        emulator.run(5'000);
+        REQUIRE((int)emulator.mem.readByte(0x0300) == 1);
+        REQUIRE((int)emulator.mem.readByte(0x0400) == 4);
+        REQUIRE((int)emulator.mem.readByte(0x05FF) == Byte(5 + 0xFF));
+        REQUIRE(disk.bytes_transferred == 512);
+    }
+
+    std::filesystem::remove(path);
+}
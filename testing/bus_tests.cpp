@@ -0,0 +1,272 @@
+#include "catch2/catch_all.hpp"
+#include "mos6502.h"
+#include "mapper.h"
+#include "rom_image.h"
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+// hands out increasing values and records every access
+struct RecordingDevice : Device
+{
+    struct Access
+    {
+        bool write;
+        Word address;
+        Byte value;
+
+        bool operator==(const Access &) const = default;
+    };
+
+    Byte read(Word address) override
+    {
+        accesses.push_back({false, address, next});
+        return next++;
+    }
+
+    void write(Word address, Byte value) override { accesses.push_back({true, address, value}); }
+
+    std::vector<Access> accesses;
+    Byte next = 0x40;
+};
+
+static const std::vector<Byte> POLL_LOOP = {
+    0xA2, 0x04,       // 8000: LDX #$04
+    0xAD, 0x00, 0xD0, // 8002: LDA $D000    <- loop
+    0x9D, 0x00, 0x02, // 8005: STA $0200,X
+    0xEE, 0x01, 0xD0, // 8008: INC $D001
+    0xCA,             // 800B: DEX
+    0xD0, 0xF4,       // 800C: BNE $8002
+    0x02,             // 800E: DONE
+};
+
+TEST_CASE("Device pages see every access in order")
+{
+    Emulator::testing = true;
+    for (Engine engine : {Engine::TABLE, Engine::THREADED, Engine::BLOCK_CACHE, Engine::JIT})
+    {
+        Emulator emulator(engine);
+        emulator.jit.hot_threshold = 1;
+        RecordingDevice device;
+        emulator.mem.mapDevice(0xD0, 1, device);
+        emulator.loadROM(POLL_LOOP);
+        emulator.run();
+
+        // INC writes the value it read back before the result
+        std::vector<RecordingDevice::Access> expected;
+        Byte value = 0x40;
+        for (int i = 0; i < 4; ++i)
+        {
+            expected.push_back({false, 0xD000, value});
+            expected.push_back({false, 0xD001, Byte(value + 1)});
+            expected.push_back({true, 0xD001, Byte(value + 1)});
+            expected.push_back({true, 0xD001, Byte(value + 2)});
+            value += 2;
+        }
+        REQUIRE(device.accesses == expected);
+
+        // the RAM next to it stays plain memory
+        for (int x = 1; x <= 4; ++x)
+        {
+            REQUIRE((int)emulator.mem.memory[0x0200 + x] == 0x40 + (4 - x) * 2);
+        }
+        REQUIRE((int)emulator.mem.memory[0xD001] == 0xFE);
+    }
+}
+
+TEST_CASE("Write protected ROM drops guest writes")
+{
+    Emulator::testing = true;
+    const std::vector<Byte> program = {
+        0xA9, 0x55,       // 8000: LDA #$55
+        0x8D, 0x10, 0x80, // 8002: STA $8010
+        0xEE, 0x11, 0x80, // 8005: INC $8011
+        0x02,             // 8008: DONE
+    };
+
+    for (Engine engine : {Engine::TABLE, Engine::THREADED, Engine::BLOCK_CACHE, Engine::JIT})
+    {
+        Emulator emulator(engine);
+        emulator.jit.hot_threshold = 0;
+        REQUIRE(emulator.loadROM(program, true));
+        emulator.run();
+
+        REQUIRE((int)emulator.cpu.accumulator == 0x55);
+        REQUIRE((int)emulator.mem.memory[0x8010] == 0xFE);
+        REQUIRE((int)emulator.mem.memory[0x8011] == 0xFE);
+    }
+
+    Emulator emulator;
+    REQUIRE_FALSE(emulator.loadROM(std::vector<Byte>(Memory::ROM_END - Memory::ROM_START + 1, 0xEA)));
+    REQUIRE((int)emulator.mem.memory[0x8000] == 0xFE);
+}
+
+TEST_CASE("Mappers switch banks of an image bigger than the address space")
+{
+    Emulator::testing = true;
+
+    // four 16 KB banks, each with its number at $8000 and a subroutine returning it at $8010
+    std::vector<Byte> image(4 * 0x4000, 0xEA);
+    for (int bank = 0; bank < 4; ++bank)
+    {
+        image[bank * 0x4000] = Byte(0xB0 + bank);
+        image[bank * 0x4000 + 0x10] = 0xA9; // LDA #bank
+        image[bank * 0x4000 + 0x11] = Byte(bank);
+        image[bank * 0x4000 + 0x12] = 0x60; // RTS
+    }
+
+    const std::vector<Byte> program = {
+        0xA2, 0x03,       // 0400: LDX #$03
+        0x8E, 0x00, 0x80, // 0402: STX $8000    <- loop, selects bank X
+        0x20, 0x10, 0x80, // 0405: JSR $8010
+        0x9D, 0x00, 0x03, // 0408: STA $0300,X
+        0xAD, 0x00, 0x80, // 040B: LDA $8000
+        0x9D, 0x10, 0x03, // 040E: STA $0310,X
+        0xCA,             // 0411: DEX
+        0x10, 0xEE,       // 0412: BPL $0402
+        0x02,             // 0414: DONE
+    };
+
+    for (Engine engine : {Engine::TABLE, Engine::THREADED, Engine::BLOCK_CACHE, Engine::JIT})
+    {
+        Emulator emulator(engine);
+        emulator.jit.hot_threshold = 0;
+        std::copy(program.begin(), program.end(), emulator.mem.memory + 0x0400);
+        emulator.cpu.program_counter = 0x0400;
+
+        LatchMapper mapper(emulator.mem, image.data(), image.size());
+        mapper.addWindow(0x80, 0x40);
+        mapper.mapRegisters(0x8000, 0xBFFF);
+        REQUIRE(mapper.banks(0) == 4);
+        emulator.run();
+
+        for (int x = 0; x < 4; ++x)
+        {
+            REQUIRE((int)emulator.mem.memory[0x0300 + x] == x);
+            REQUIRE((int)emulator.mem.memory[0x0310 + x] == 0xB0 + x);
+        }
+        REQUIRE(mapper.bank(0) == 0);
+        REQUIRE(mapper.switches == 5);
+        REQUIRE((int)image[0] == 0xB0); // never written through
+        REQUIRE((int)emulator.mem.memory[0x8000] == 0xFE);
+    }
+}
+
+TEST_CASE("ROM files are mapped onto the bus without copying")
+{
+    Emulator::testing = true;
+    const std::vector<Byte> program = {
+        0xAD, 0x00, 0x90, // 9000: LDA $9000
+        0x8D, 0x00, 0x03, // 9003: STA $0300
+        0xEE, 0x01, 0x90, // 9006: INC $9001    dropped
+        0x02,             // 9009: DONE
+    };
+    std::string path = (std::filesystem::temp_directory_path() / "mos6502_rom_image_test.bin").string();
+    std::ofstream(path, std::ios_base::binary).write((const char *)program.data(), program.size());
+
+    RomImage image;
+    REQUIRE(image.open(path));
+    REQUIRE(image.size() == program.size());
+    REQUIRE((int)image.data()[0xFF] == 0); // the rest of the last page
+
+    Emulator emulator;
+    REQUIRE(emulator.mapROM(image.data(), image.size(), 0x9000));
+    emulator.cpu.program_counter = 0x9000;
+    REQUIRE_FALSE(emulator.run());
+
+    REQUIRE((int)emulator.mem.memory[0x0300] == 0xAD);
+    REQUIRE((int)emulator.mem.readByte(0x9001) == 0x00);
+    REQUIRE((int)emulator.mem.memory[0x9000] == 0xFE); // never copied
+    REQUIRE(emulator.mem.read_pages[0x90] == image.data());
+
+    REQUIRE_FALSE(emulator.mapROM(image.data(), image.size(), 0xFFFA));
+    image.close();
+    std::filesystem::remove(path);
+}
+
+TEST_CASE("Writes mark their pages and lines dirty")
+{
+    Emulator::testing = true;
+    const std::vector<Byte> program = {
+        0xA2, 0x05,       // 8000: LDX #$05
+        0x8D, 0x45, 0x03, // 8002: STA $0345
+        0x9D, 0x80, 0x04, // 8005: STA $0480,X
+        0x20, 0x0F, 0x80, // 8008: JSR $800F
+        0xEE, 0xC0, 0x07, // 800B: INC $07C0
+        0x02,             // 800E: DONE
+        0x60,             // 800F: RTS
+    };
+
+    for (Engine engine : {Engine::TABLE, Engine::THREADED, Engine::BLOCK_CACHE, Engine::JIT})
+    {
+        Emulator emulator(engine);
+        emulator.jit.hot_threshold = 0;
+        emulator.loadROM(program);
+        emulator.mem.trackDirty(true);
+        emulator.mem.clearDirty();
+        emulator.run();
+
+        std::vector<int> pages;
+        emulator.mem.forEachDirtyPage([&](std::size_t page) { pages.push_back((int)page); });
+        REQUIRE(pages == std::vector<int>{0x01, 0x03, 0x04, 0x07});
+        REQUIRE(emulator.mem.dirtyPageCount() == 4);
+
+        std::vector<int> lines;
+        emulator.mem.forEachDirtyLine([&](Word address) { lines.push_back(address); });
+        for (int line : {0x01C0, 0x0340, 0x0480, 0x07C0})
+        {
+            REQUIRE(std::find(lines.begin(), lines.end(), line) != lines.end());
+        }
+        for (int line : lines)
+        {
+            REQUIRE(emulator.mem.isDirty(Byte(line >> 8)));
+        }
+        REQUIRE_FALSE(emulator.mem.isLineDirty(0x0300));
+
+        emulator.mem.clearDirty(0x03);
+        REQUIRE_FALSE(emulator.mem.isDirty(0x03));
+        REQUIRE_FALSE(emulator.mem.isLineDirty(0x0345));
+        emulator.mem.clearDirty();
+        REQUIRE(emulator.mem.dirtyPageCount() == 0);
+    }
+}
+
+TEST_CASE("RAM writes are bare stores until something watches the page")
+{
+    Emulator::testing = true;
+    Emulator emulator(Engine::BLOCK_CACHE);
+    Memory &mem = emulator.mem;
+    std::uint32_t generation = mem.page_generation[0x03];
+
+    mem.writeByte(0x0300, 1);
+    REQUIRE(mem.bare_write[0x03]);
+    REQUIRE(mem.page_generation[0x03] == generation);
+    REQUIRE_FALSE(mem.isDirty(0x03)); // dirty tracking is off by default
+
+    // a snapshot shares the page until its first write
+    Snapshot snapshot = emulator.snapshot();
+    REQUIRE_FALSE(mem.bare_write[0x03]);
+    mem.writeByte(0x0301, 2);
+    REQUIRE(mem.page_generation[0x03] != generation);
+    REQUIRE(mem.bare_write[0x03]);
+    emulator.restore(snapshot);
+    REQUIRE((int)mem.readByte(0x0301) != 2);
+
+    // code decoded from RAM keeps its page watched
+    mem.writeByte(0x0400, 0xEA); // NOP
+    mem.writeByte(0x0401, 0x02); // DONE
+    emulator.cpu.program_counter = 0x0400;
+    emulator.runBlock();
+    REQUIRE_FALSE(mem.bare_write[0x04]);
+    generation = mem.page_generation[0x04];
+    mem.writeByte(0x0400, 0xE8);
+    REQUIRE(mem.page_generation[0x04] != generation);
+
+    mem.trackDirty(true);
+    REQUIRE_FALSE(mem.bare_write[0x05]);
+    mem.writeByte(0x0500, 3);
+    REQUIRE(mem.isDirty(0x05));
+    mem.trackDirty(false);
+    REQUIRE(mem.bare_write[0x05]);
+}
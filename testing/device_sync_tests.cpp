@@ -0,0 +1,86 @@
+#include "catch2/catch_all.hpp"
+#include "mos6502.h"
+#include "clocked_device.h"
+#include <vector>
+
+// reads back the low byte of the cycle it has been run to, counting how often it had to catch up
+class CycleProbe : public ClockedDevice
+{
+public:
+    using ClockedDevice::ClockedDevice;
+    using ClockedDevice::wakeAt;
+
+    std::uint64_t ran = 0;
+    std::size_t catch_ups = 0;
+    std::vector<std::uint64_t> deadlines;
+
+protected:
+    Byte readRegister(Word) override { return Byte(syncedTo()); }
+    void writeRegister(Word, Byte) override {}
+    void catchUp(std::uint64_t from, std::uint64_t to) override
+    {
+        ran += to - from;
+        catch_ups++;
+    }
+    void deadline(std::uint64_t cycle) override { deadlines.push_back(cycle); }
+};
+
+static const std::vector<Byte> PROBE = {
+    0xA2, 0x00,       // 8000: LDX #$00     2
+    0xEA,             // 8002: NOP          4
+    0xAD, 0x00, 0x60, // 8003: LDA $6000    8, reads at 4
+    0x8D, 0x00, 0x03, // 8006: STA $0300    12
+    0xAE, 0x00, 0x60, // 8009: LDX $6000    16, reads at 12
+    0x02,             // 800C: DONE
+};
+
+TEST_CASE("Clocked devices catch up to the cycle of the access")
+{
+    Emulator::testing = true;
+    for (Engine engine : {Engine::TABLE, Engine::THREADED, Engine::BLOCK_CACHE})
+    {
+        for (bool batch : {false, true})
+        {
+            Emulator emulator(engine);
+            CycleProbe probe(emulator);
+            emulator.mem.mapDevice(0x60, 1, probe);
+            emulator.loadROM(PROBE);
+
+            if (batch)
+            {
+                emulator.runFor(1000);
+            }
+            else
+            {
+                emulator.run();
+            }
+            REQUIRE((int)emulator.mem.readByte(0x0300) == 4);
+            REQUIRE((int)emulator.cpu.X == 12);
+            REQUIRE(probe.ran == 12);
+            REQUIRE(probe.catch_ups == 2); // once per access, however many cycles in between
+        }
+    }
+}
+
+TEST_CASE("Clocked devices catch up for their deadlines")
+{
+    Emulator::testing = true;
+    Emulator emulator;
+    CycleProbe probe(emulator);
+    emulator.mem.mapDevice(0x60, 1, probe);
+    emulator.loadROM({0x4C, 0x00, 0x80}); // JMP $8000
+
+    probe.wakeAt(1000);
+    emulator.run(5000);
+    REQUIRE(probe.deadlines == std::vector<std::uint64_t>{1000});
+    REQUIRE(probe.syncedTo() >= 1000);
+    REQUIRE(probe.syncedTo() < 1003);
+    REQUIRE(probe.catch_ups == 1);
+
+    // a restored snapshot goes back in time, the device just picks up from there
+    Snapshot start = emulator.snapshot();
+    emulator.run(100);
+    emulator.restore(start);
+    probe.sync();
+    REQUIRE(probe.syncedTo() == start.cycles);
+}
@@ -0,0 +1,226 @@
+#include "catch2/catch_all.hpp"
+#include "mos6502.h"
+#include <cstring>
+#include <vector>
+
+// exercises every addressing mode, the stack, subroutines and all branch kinds, then ends with DONE
+static const std::vector<Byte> ENGINE_PROGRAM = {
+    0xA2, 0x05,       // 8000: LDX #$05
+    0xA0, 0x03,       // 8002: LDY #$03
+    0xA9, 0x10,       // 8004: LDA #$10     <- loop
+    0x75, 0x20,       // 8006: ADC $20,X
+    0x9D, 0x00, 0x03, // 8008: STA $0300,X
+    0x99, 0x10, 0x03, // 800B: STA $0310,Y
+    0x91, 0x40,       // 800E: STA ($40),Y
+    0x81, 0x42,       // 8010: STA ($42,X)
+    0x3E, 0x00, 0x03, // 8012: ROL $0300,X
+    0x46, 0x21,       // 8015: LSR $21
+    0xE5, 0x22,       // 8017: SBC $22
+    0x48,             // 8019: PHA
+    0x08,             // 801A: PHP
+    0x20, 0x40, 0x80, // 801B: JSR $8040
+    0x28,             // 801E: PLP
+    0x68,             // 801F: PLA
+    0xCA,             // 8020: DEX
+    0x10, 0xE1,       // 8021: BPL $8004
+    0x6C, 0x50, 0x00, // 8023: JMP ($0050)
+    0x02,             // 8026: DONE (skipped by the jump)
+    0x02,             // 8027: DONE
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, // padding up to $8030
+    0x24, 0x21,       // 8030: BIT $21      <- jump target
+    0x18,             // 8032: CLC
+    0xA9, 0x7F,       // 8033: LDA #$7F
+    0x69, 0x01,       // 8035: ADC #$01
+    0x70, 0x02,       // 8037: BVS $803B
+    0x02,             // 8039: DONE (not reached)
+    0x02,             // 803A: DONE (not reached)
+    0xC9, 0x80,       // 803B: CMP #$80
+    0xF0, 0xE8,       // 803D: BEQ $8027
+    0x02,             // 803F: DONE (not reached)
+    0xE6, 0x21,       // 8040: INC $21      <- subroutine
+    0xC0, 0x02,       // 8042: CPY #$02
+    0xB0, 0x01,       // 8044: BCS $8047
+    0xC8,             // 8046: INY
+    0x88,             // 8047: DEY
+    0x60,             // 8048: RTS
+};
+
+static void setUpMemory(Emulator &emulator)
+{
+    std::memset(emulator.mem.memory, 0, Memory::ROM_START);
+    emulator.mem.memory[0x20] = 0x11;
+    emulator.mem.memory[0x21] = 0x81;
+    emulator.mem.memory[0x22] = 0x05;
+    emulator.mem.memory[0x40] = 0xF0; // ($40) -> $03F0
+    emulator.mem.memory[0x41] = 0x03;
+    emulator.mem.memory[0x47] = 0x20; // ($42,X) -> $0320 when X = 5
+    emulator.mem.memory[0x48] = 0x03;
+    emulator.mem.memory[0x50] = 0x30; // JMP ($0050) -> $8030
+    emulator.mem.memory[0x51] = 0x80;
+    emulator.loadROM(ENGINE_PROGRAM);
+}
+
+TEST_CASE("Engines agree on a full program")
+{
+    Emulator::testing = true;
+
+    Emulator table(Engine::TABLE);
+    setUpMemory(table);
+    table.run();
+    REQUIRE((int)table.cpu.program_counter == 0x8027);
+
+    for (Engine engine : {Engine::THREADED, Engine::BLOCK_CACHE, Engine::JIT})
+    {
+        Emulator emulator(engine);
+        emulator.jit.hot_threshold = 0;
+        setUpMemory(emulator);
+        emulator.run();
+
+        REQUIRE(emulator.cpu == table.cpu);
+        REQUIRE(emulator.cycles == table.cycles);
+        REQUIRE(std::memcmp(emulator.mem.memory, table.mem.memory, sizeof(table.mem.memory)) == 0);
+    }
+}
+
+TEST_CASE("Self-modifying code is picked up by every engine")
+{
+    Emulator::testing = true;
+    const std::vector<Byte> program = {
+        0xA2, 0x03,       // 8000: LDX #$03
+        0x8A,             // 8002: TXA          <- loop
+        0x8D, 0x00, 0x03, // 8003: STA $0300    the address is patched below
+        0xEE, 0x04, 0x80, // 8006: INC $8004
+        0xCA,             // 8009: DEX
+        0xD0, 0xF6,       // 800A: BNE $8002
+        0x02,             // 800C: DONE
+    };
+
+    for (Engine engine : {Engine::TABLE, Engine::THREADED, Engine::BLOCK_CACHE, Engine::JIT})
+    {
+        Emulator emulator(engine);
+        emulator.jit.hot_threshold = 0; // translate on first sight
+        std::memset(emulator.mem.memory, 0, Memory::ROM_START);
+        emulator.loadROM(program);
+        emulator.run();
+
+        REQUIRE((int)emulator.mem.memory[0x0300] == 3);
+        REQUIRE((int)emulator.mem.memory[0x0301] == 2);
+        REQUIRE((int)emulator.mem.memory[0x0302] == 1);
+        REQUIRE((int)emulator.mem.memory[0x8004] == 0x03);
+    }
+}
+
+TEST_CASE("Instructions that run over the end of a page")
+{
+    Emulator::testing = true;
+    const Byte program[] = {
+        0xA9, 0x42,       // 02FD: LDA #$42
+        0x8D, 0x10, 0x03, // 02FF: STA $0310    operand on the next page
+        0xAE, 0x10, 0x03, // 0302: LDX $0310
+        0xE8,             // 0305: INX
+        0x02,             // 0306: DONE
+    };
+
+    for (Engine engine : {Engine::TABLE, Engine::THREADED, Engine::BLOCK_CACHE, Engine::JIT})
+    {
+        Emulator emulator(engine);
+        emulator.jit.hot_threshold = 0;
+        std::memset(emulator.mem.memory, 0, Memory::ROM_START);
+        std::memcpy(emulator.mem.memory + 0x02FD, program, sizeof(program));
+        emulator.cpu.program_counter = 0x02FD;
+        emulator.run();
+
+        REQUIRE((int)emulator.mem.memory[0x0310] == 0x42);
+        REQUIRE((int)emulator.cpu.X == 0x43);
+        REQUIRE((int)emulator.cpu.program_counter == 0x0306);
+        REQUIRE(emulator.cycles == 2 + 4 + 4 + 2);
+    }
+}
+
+TEST_CASE("Threaded engine stops on BRK outside of the test suite")
+{
+    Emulator::testing = false;
+    Emulator emulator(Engine::THREADED);
+    emulator.loadROM({0xA9, 0x42, 0x00, 0xA9, 0x00});
+    emulator.run();
+    Emulator::testing = true;
+
+    REQUIRE((int)emulator.cpu.accumulator == 0x42);
+    REQUIRE((int)emulator.cpu.program_counter == 0x8002);
+}
+
+TEST_CASE("Decimal mode arithmetic on every engine")
+{
+    Emulator::testing = true;
+    const std::vector<Byte> program = {
+        0xF8,       // 8000: SED
+        0x18,       // 8001: CLC
+        0xA9, 0x58, // 8002: LDA #$58
+        0x69, 0x46, // 8004: ADC #$46     58 + 46 = 04, carry
+        0x85, 0x00, // 8006: STA $00
+        0xA9, 0x12, // 8008: LDA #$12
+        0xE9, 0x21, // 800A: SBC #$21     12 - 21 = 91, borrow
+        0x85, 0x01, // 800C: STA $01
+        0x18,       // 800E: CLC
+        0xA9, 0x99, // 800F: LDA #$99
+        0x69, 0x01, // 8011: ADC #$01     99 + 01 = 00, carry, N from the unadjusted sum and no Z
+        0x85, 0x02, // 8013: STA $02
+        0x08,       // 8015: PHP
+        0x68,       // 8016: PLA
+        0x85, 0x03, // 8017: STA $03
+        0x02,       // 8019: DONE
+    };
+
+    for (Engine engine : {Engine::TABLE, Engine::THREADED, Engine::BLOCK_CACHE, Engine::JIT})
+    {
+        Emulator emulator(engine);
+        emulator.jit.hot_threshold = 0;
+        emulator.loadROM(program);
+        emulator.run();
+
+        REQUIRE((int)emulator.mem.memory[0x00] == 0x04);
+        REQUIRE((int)emulator.mem.memory[0x01] == 0x91);
+        REQUIRE((int)emulator.mem.memory[0x02] == 0x00);
+        REQUIRE((int)emulator.mem.memory[0x03] ==
+                (MOS_6502::P_NEGATIVE | MOS_6502::P_UNUSED | MOS_6502::P_BREAK | MOS_6502::P_DECIMAL | MOS_6502::P_CARRY));
+    }
+}
+
+TEST_CASE("Decimal mode matches the worked examples for valid BCD")
+{
+    Emulator::testing = true;
+    struct Example
+    {
+        Byte opcode, carry, a, b, result, carry_out;
+    };
+    // from the NMOS decimal mode tutorial, SBC borrows when the carry is clear
+    const Example examples[] = {
+        {0x69, 0, 0x12, 0x34, 0x46, 0}, {0x69, 0, 0x15, 0x26, 0x41, 0}, {0x69, 0, 0x81, 0x92, 0x73, 1},
+        {0xE9, 0, 0x46, 0x12, 0x33, 1}, {0xE9, 1, 0x40, 0x13, 0x27, 1}, {0xE9, 0, 0x32, 0x02, 0x29, 1},
+        {0xE9, 1, 0x21, 0x34, 0x87, 0},
+    };
+
+    for (const Example &example : examples)
+    {
+        for (Engine engine : {Engine::TABLE, Engine::JIT})
+        {
+            Emulator emulator(engine);
+            emulator.jit.hot_threshold = 0;
+            emulator.loadROM({
+                0xF8,                                   // SED
+                Byte(example.carry ? 0x38 : 0x18),      // SEC or CLC
+                0xA9, example.a,                        // LDA #a
+                example.opcode, example.b,              // ADC or SBC #b
+                0x85, 0x00,                             // STA $00
+                0x08,                                   // PHP
+                0x68,                                   // PLA
+                0x85, 0x01,                             // STA $01
+                0x02,                                   // DONE
+            });
+            emulator.run();
+
+            REQUIRE((int)emulator.mem.memory[0x00] == example.result);
+            REQUIRE((emulator.mem.memory[0x01] & MOS_6502::P_CARRY) == example.carry_out);
+        }
+    }
+}
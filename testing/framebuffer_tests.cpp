@@ -0,0 +1,172 @@
+#include "catch2/catch_all.hpp"
+#include "mos6502.h"
+#include "framebuffer.h"
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+constexpr Word SCREEN = 0x4000;
+
+// P6 with an 8 bit maximum, the pixels as RGB triplets
+static std::vector<Byte> readPpm(const std::string &path, unsigned &width, unsigned &height)
+{
+    std::ifstream file(path, std::ios::binary);
+    std::string magic;
+    unsigned maximum = 0;
+    file >> magic >> width >> height >> maximum;
+    file.get();
+    std::vector<Byte> rgb((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    return magic == "P6" && maximum == 255 ? rgb : std::vector<Byte>();
+}
+
+TEST_CASE("Framebuffer writes mark their tiles")
+{
+    Emulator::testing = true;
+    Emulator emulator;
+    Framebuffer screen(emulator, 20, 12); // 3x2 tiles, the last column and row cut short
+    screen.map(SCREEN >> 8);
+    REQUIRE(screen.tileCount() == 6);
+
+    emulator.mem.writeByte(SCREEN + 0, 0x11);       // (0, 0), tile 0
+    emulator.mem.writeByte(SCREEN + 19, 0x22);      // (19, 0), tile 2
+    emulator.mem.writeByte(SCREEN + 11 * 20, 0x33); // (0, 11), tile 3
+    emulator.mem.writeByte(SCREEN + 240, 0x44);     // past the screen, dropped
+
+    REQUIRE(screen.isTileDirty(0));
+    REQUIRE_FALSE(screen.isTileDirty(1));
+    REQUIRE(screen.isTileDirty(2));
+    REQUIRE(screen.isTileDirty(3));
+    REQUIRE_FALSE(screen.isTileDirty(4));
+    REQUIRE_FALSE(screen.isTileDirty(5));
+
+    REQUIRE((int)emulator.mem.readByte(SCREEN + 19) == 0x22); // straight from the pixels
+    REQUIRE((int)emulator.mem.readByte(SCREEN + 240) == 0);
+    REQUIRE((int)screen.pixels()[11 * 20] == 0x33);
+
+    std::vector<Byte> state;
+    screen.saveState(state);
+    REQUIRE(state.size() == 240);
+    Emulator other;
+    Framebuffer loaded(other, 20, 12);
+    REQUIRE(loaded.loadState(state.data(), state.size()));
+    REQUIRE_FALSE(loaded.loadState(state.data(), 100));
+    REQUIRE((int)loaded.pixels()[19] == 0x22);
+}
+
+TEST_CASE("Framebuffer writes changed frames as PPM")
+{
+    // a white line across the top left tile, then long enough to reach the first frame
+    std::vector<Byte> rom = {
+        0xA9, 0xFF,             // 8000: LDA #$FF
+        0xA2, 0x07,             // 8002: LDX #7
+        0x9D, 0x00, 0x40,       // 8004: STA $4000,X
+        0xCA,                   // 8007: DEX
+        0x10, 0xFA,             // 8008: BPL $8004
+        0xA0, 0x00,             // 800A: LDY #0
+        0x88,                   // 800C: DEY
+        0xD0, 0xFD,             // 800D: BNE $800C, on past the first frame
+        0x02,                   // 800F: DONE
+    };
+
+    auto directory = std::filesystem::temp_directory_path() / "mos6502_frames";
+    std::filesystem::remove_all(directory);
+    std::filesystem::create_directories(directory);
+    std::string pattern = (directory / "%03u.ppm").string();
+
+    Emulator::testing = true;
+    Emulator emulator;
+    Framebuffer screen(emulator, 16, 16, 1'000); // a frame every 1000 cycles
+    screen.map(SCREEN >> 8);
+    emulator.loadROM(rom);
+
+    REQUIRE(screen.startPpm(pattern));
+    emulator.run();
+    screen.stop();
+
+    // frame 1 is the whole screen with the first row of the tile, nothing changes after it
+    REQUIRE(screen.frames_presented == 1);
+    REQUIRE(screen.frames_encoded == 1);
+    unsigned width = 0, height = 0;
+    std::vector<Byte> rgb = readPpm((directory / "001.ppm").string(), width, height);
+    REQUIRE(width == 16);
+    REQUIRE(height == 16);
+    REQUIRE(rgb.size() == 16 * 16 * 3);
+    REQUIRE((int)rgb[7 * 3] == 0xFF);
+    REQUIRE((int)rgb[8 * 3] == 0);
+    REQUIRE_FALSE(std::filesystem::exists(directory / "002.ppm"));
+
+    std::filesystem::remove_all(directory);
+}
+
+TEST_CASE("Framebuffer takes only PPM patterns with one frame number")
+{
+    auto directory = std::filesystem::temp_directory_path() / "mos6502_patterns";
+    std::filesystem::remove_all(directory);
+    std::filesystem::create_directories(directory);
+
+    Emulator::testing = true;
+    Emulator emulator;
+    Framebuffer screen(emulator, 16, 16, 1'000);
+    screen.map(SCREEN >> 8);
+
+    for (const char *pattern : {"frame.ppm", "%s.ppm", "%n%u.ppm", "%u%u.ppm", "%lu.ppm", "%*u.ppm", "%.3u.ppm", "%100u.ppm", "%"})
+    {
+        INFO(pattern);
+        REQUIRE_FALSE(screen.startPpm((directory / pattern).string()));
+    }
+
+    // LDY #0, DEY, BNE $8002, DONE: on past the first frame
+    emulator.loadROM({0xA0, 0x00, 0x88, 0xD0, 0xFD, 0x02});
+    REQUIRE(screen.startPpm((directory / "100%%-%03d.ppm").string()));
+    emulator.run();
+    screen.stop();
+    REQUIRE(std::filesystem::exists(directory / "100%-001.ppm"));
+
+    std::filesystem::remove_all(directory);
+}
+
+#if MOS6502_POSIX
+TEST_CASE("Framebuffer updates a shared RGB mapping in place")
+{
+    auto path = (std::filesystem::temp_directory_path() / "mos6502_frames.raw").string();
+
+    Emulator::testing = true;
+    Emulator emulator;
+    Framebuffer screen(emulator, 16, 8, 1'000);
+    screen.map(SCREEN >> 8);
+    screen.palette[0x01] = 0x102030;
+
+    REQUIRE(screen.startShared(path));
+    emulator.mem.writeByte(SCREEN + 9, 0x01);
+    emulator.cycles += 1000;
+    emulator.scheduler.dispatch(emulator.cycles);
+    REQUIRE(screen.frames_presented == 1);
+    emulator.mem.writeByte(SCREEN + 10, 0x01);
+    screen.stop();
+    REQUIRE(screen.frames_presented == 2);
+    REQUIRE(screen.frames_encoded == 2);
+
+    std::ifstream file(path, std::ios::binary);
+    std::vector<Byte> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    REQUIRE(bytes.size() == sizeof(Framebuffer::SharedHeader) + 16 * 8 * 3);
+    Framebuffer::SharedHeader header;
+    std::memcpy(&header, bytes.data(), sizeof(header));
+    REQUIRE(std::string(header.magic, 4) == "MOSF");
+    REQUIRE(header.width == 16);
+    REQUIRE(header.sequence == 4); // even, nothing half written
+    REQUIRE(header.frame == 2);
+
+    const Byte *rgb = bytes.data() + sizeof(header);
+    for (int pixel : {9, 10})
+    {
+        REQUIRE((int)rgb[pixel * 3] == 0x10);
+        REQUIRE((int)rgb[pixel * 3 + 1] == 0x20);
+        REQUIRE((int)rgb[pixel * 3 + 2] == 0x30);
+    }
+    std::remove(path.c_str());
+}
+#endif
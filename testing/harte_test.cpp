@@ -10,14 +10,13 @@ HarteTest::HarteTest(const std::string& file)
 {
     auto json = json::parse(file);
 
-    // TODO: just use cpu struct instead
     // load up the values
-    initial_state.cpu.program_counter = json["initial"]["pc"];
-    initial_state.cpu.S = json["initial"]["s"]; 
-    initial_state.cpu.accumulator = json["initial"]["a"];
-    initial_state.cpu.X = json["initial"]["x"]; 
-    initial_state.cpu.Y = json["initial"]["y"];
-    initial_state.cpu.P = json["initial"]["p"];
+    initial_state.program_counter = json["initial"]["pc"];
+    initial_state.S = json["initial"]["s"]; 
+    initial_state.accumulator = json["initial"]["a"];
+    initial_state.X = json["initial"]["x"]; 
+    initial_state.Y = json["initial"]["y"];
+    initial_state.setP(json["initial"]["p"]);
 
     for (const auto& pair : json["initial"]["ram"]) 
     {
@@ -27,12 +26,12 @@ HarteTest::HarteTest(const std::string& file)
     }
 
     // Load up the values for the final state
-    final_state.cpu.program_counter = json["final"]["pc"];
-    final_state.cpu.S = json["final"]["s"];
-    final_state.cpu.accumulator = json["final"]["a"];
-    final_state.cpu.X = json["final"]["x"];
-    final_state.cpu.Y = json["final"]["y"];
-    final_state.cpu.P = json["final"]["p"];
+    final_state.program_counter = json["final"]["pc"];
+    final_state.S = json["final"]["s"];
+    final_state.accumulator = json["final"]["a"];
+    final_state.X = json["final"]["x"];
+    final_state.Y = json["final"]["y"];
+    final_state.setP(json["final"]["p"]);
 
     for (const auto& pair : json["final"]["ram"]) 
     {
@@ -44,17 +43,12 @@ HarteTest::HarteTest(const std::string& file)
     cycles = json["cycles"].size();
 }
 
-bool HarteTest::run() 
+bool HarteTest::run(Engine engine) 
 {
     static int id = 0;
-    Emulator testbed;
+    Emulator testbed(engine);
     testbed.testing = true;
-    testbed.cpu = initial_state.cpu;
-
-    if (testbed.cpu.P & MOS_6502::P_DECIMAL) // not emulating this weird ahh stuff bro (it's so bad they removed it on newer ones)
-    {
-        return true;
-    }
+    testbed.cpu = initial_state;
 
     for (auto& [addr, val] : initial_mem_state.mem_states) 
     {
@@ -62,14 +56,25 @@ bool HarteTest::run()
     }
 
     // execute the instruction
-    testbed.cycle(); 
+    if (engine == Engine::JIT)
+    {
+        // translate the instruction on its own, the bytes after it are whatever the test left there
+        testbed.block_cache.max_block_length = 1;
+        testbed.jit.hot_threshold = 0;
+        testbed.runBlock();
+    }
+    else
+    {
+        testbed.cycle(); 
+    }
         
-    REQUIRE((uint32_t)testbed.cpu.accumulator == (uint32_t)final_state.cpu.accumulator);
-    REQUIRE((int)testbed.cpu.X == (int)final_state.cpu.X);
-    REQUIRE((int)testbed.cpu.Y == (int)final_state.cpu.Y);
-    REQUIRE((int)testbed.cpu.program_counter == (int)final_state.cpu.program_counter);
-    REQUIRE((int)testbed.cpu.S == (int)final_state.cpu.S);
-    REQUIRE((int)testbed.cpu.P == (int)final_state.cpu.P); // Processor status flags
+    REQUIRE((uint32_t)testbed.cpu.accumulator == (uint32_t)final_state.accumulator);
+    REQUIRE((int)testbed.cpu.X == (int)final_state.X);
+    REQUIRE((int)testbed.cpu.Y == (int)final_state.Y);
+    REQUIRE((int)testbed.cpu.program_counter == (int)final_state.program_counter);
+    REQUIRE((int)testbed.cpu.S == (int)final_state.S);
+    REQUIRE((int)testbed.cpu.P() == (int)final_state.P()); // Processor status flags
+    REQUIRE(testbed.cycles == cycles);
     
     for (auto& [addr, val] : final_mem_state.mem_states) 
     {
@@ -18,13 +18,13 @@ class HarteTest
 {
 public:
     explicit HarteTest(const std::string& file);
-    bool run();
+    bool run(Engine engine = Engine::TABLE);
     
     nlohmann::json json;
-    Emulator initial_state;
+    MOS_6502 initial_state;
     MemoryState initial_mem_state;
 
-    Emulator final_state;
+    MOS_6502 final_state;
     MemoryState final_mem_state;
 
     size_t cycles; 
@@ -6,7 +6,7 @@
 #include "nlohmann/json.hpp"
 #include <iostream>
 
-constexpr static auto TEST_JSON_PATH = "../testing/ProcessorTests/6502/v1/";
+constexpr static auto TEST_JSON_PATH = HARTE_TESTS_DIR;
 using namespace nlohmann;
 
 std::vector<json> getTestCases(const std::string &filename)
@@ -41,6 +41,10 @@ void runHarteTest(const std::string& opcodeFile)
         std::cout << "Running case #" << i << " for testfile " << opcodeFile << ":\n"; 
         auto testbed = HarteTest(cases[i].dump());
         REQUIRE(testbed.run());
+        if (MOS6502_JIT)
+        {
+            REQUIRE(testbed.run(Engine::JIT));
+        }
     }
 }
 
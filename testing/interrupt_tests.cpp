@@ -0,0 +1,176 @@
+#include "catch2/catch_all.hpp"
+#include "mos6502.h"
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+// spins at $8001, the IRQ handler counts in $0300 and the NMI handler in $0301
+static std::vector<Byte> spinner(bool irq_enabled)
+{
+    std::vector<Byte> rom(0x8000, 0xEA);
+    auto put = [&](Word address, std::vector<Byte> bytes) { std::copy(bytes.begin(), bytes.end(), rom.begin() + (address - 0x8000)); };
+    put(0x8000, {Byte(irq_enabled ? 0x58 : 0x78), 0x4C, 0x01, 0x80}); // CLI/SEI, JMP $8001
+    put(0x9000, {0xEE, 0x00, 0x03, 0x40});                           // INC $0300, RTI
+    put(0x9100, {0xEE, 0x01, 0x03, 0x40});                           // INC $0301, RTI
+    put(0xFFFA, {0x00, 0x91, 0x00, 0x80, 0x00, 0x90});               // NMI, RESET, IRQ/BRK
+    return rom;
+}
+
+static Emulator &prepare(Emulator &emulator, bool irq_enabled)
+{
+    emulator.jit.hot_threshold = 0;
+    emulator.loadROM(spinner(irq_enabled));
+    emulator.mem.writeByte(0x0300, 0);
+    emulator.mem.writeByte(0x0301, 0);
+    return emulator;
+}
+
+TEST_CASE("Interrupts push pc and P and jump through their vector")
+{
+    Emulator::testing = true;
+    Emulator emulator;
+    prepare(emulator, true).runInstructions(1); // CLI
+    emulator.cpu.setP(emulator.cpu.P() | MOS_6502::P_CARRY);
+    Word stack = Memory::STACK_BASE + emulator.cpu.S;
+
+    emulator.interrupts.assertIrq();
+    REQUIRE(emulator.runInstructions(0) == StopReason::INSTRUCTION_BUDGET);
+    REQUIRE((int)emulator.cpu.program_counter == 0x9000);
+    REQUIRE(emulator.cycles == 2 + 7);
+    REQUIRE(Word(Memory::STACK_BASE + emulator.cpu.S) == Word(stack - 3));
+    REQUIRE((int)emulator.mem.readByte(stack) == 0x80);
+    REQUIRE((int)emulator.mem.readByte(stack - 1) == 0x01);
+    REQUIRE((int)emulator.mem.readByte(stack - 2) == (MOS_6502::P_UNUSED | MOS_6502::P_CARRY)); // B clear, I still clear
+    REQUIRE(emulator.cpu.P() & MOS_6502::P_INT_DISABLE);
+
+    // the line is still held, but the handler runs with interrupts disabled
+    emulator.runInstructions(2);
+    REQUIRE((int)emulator.mem.readByte(0x0300) == 1);
+    REQUIRE((int)emulator.cpu.program_counter == 0x8001);
+
+    // RESET wins over everything else and doesn't push
+    emulator.interrupts.nmi();
+    emulator.interrupts.reset();
+    emulator.runInstructions(0);
+    REQUIRE((int)emulator.cpu.program_counter == 0x8000);
+    REQUIRE(Word(Memory::STACK_BASE + emulator.cpu.S) == Word(stack - 3));
+    REQUIRE(emulator.interrupts.pending() == 1); // the NMI was dropped, IRQ is still held
+}
+
+TEST_CASE("IRQ is level triggered and masked by I")
+{
+    Emulator::testing = true;
+    for (Engine engine : {Engine::TABLE, Engine::THREADED, Engine::BLOCK_CACHE, Engine::JIT})
+    {
+        for (bool irq_enabled : {true, false})
+        {
+            Emulator emulator(engine);
+            prepare(emulator, irq_enabled);
+            emulator.interrupt_poll_cycles = 100;
+
+            // a device holds the line from cycle 1000 to 5000
+            auto raise = emulator.scheduler.add([&](std::uint64_t) { emulator.interrupts.assertIrq(3); });
+            auto lower = emulator.scheduler.add([&](std::uint64_t) { emulator.interrupts.releaseIrq(3); });
+            emulator.scheduler.scheduleAt(raise, 1000);
+            emulator.scheduler.scheduleAt(lower, 5000);
+
+            emulator.run(5000);
+            int taken = emulator.mem.readByte(0x0300);
+            emulator.run(5000);
+
+            if (irq_enabled)
+            {
+                REQUIRE(taken >= 30); // taken again at every poll while held
+                REQUIRE((int)emulator.mem.readByte(0x0300) == taken);
+            }
+            else
+            {
+                REQUIRE(taken == 0);
+            }
+        }
+    }
+}
+
+// raises IRQ 5 when written, from inside the engine's run
+struct IrqOnWrite : Device
+{
+    Emulator &emulator;
+    explicit IrqOnWrite(Emulator &emulator) : emulator(emulator) {}
+    Byte read(Word) override { return 0; }
+    void write(Word, Byte) override { emulator.interrupts.assertIrq(5); }
+};
+
+TEST_CASE("Lines raised by a device during a run are taken without waiting for a poll")
+{
+    Emulator::testing = true;
+    for (Engine engine : {Engine::TABLE, Engine::THREADED, Engine::BLOCK_CACHE, Engine::JIT})
+    {
+        Emulator emulator(engine);
+        prepare(emulator, true);
+        emulator.mem.writeByte(0x8001, 0x8D); // STA $0200, JMP $8004
+        emulator.mem.writeByte(0x8002, 0x00);
+        emulator.mem.writeByte(0x8003, 0x02);
+        emulator.mem.writeByte(0x8004, 0x4C);
+        emulator.mem.writeByte(0x8005, 0x04);
+        emulator.mem.writeByte(0x8006, 0x80);
+        IrqOnWrite device(emulator);
+        emulator.mem.mapDevice(0x02, 1, device);
+        emulator.interrupt_poll_cycles = 1'000'000;
+
+        // the line stays up, the handler runs once straight away and then only at polls
+        emulator.run(100'000);
+        REQUIRE((int)emulator.mem.readByte(0x0300) == 1);
+    }
+}
+
+TEST_CASE("NMI is edge triggered and can come from another thread")
+{
+    Emulator::testing = true;
+    Emulator emulator(Engine::JIT);
+    prepare(emulator, false); // NMI ignores I
+    emulator.interrupt_poll_cycles = 1000;
+
+    std::thread host([&]
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        emulator.interrupts.nmi();
+    });
+    auto give_up = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+    while (emulator.mem.readByte(0x0301) == 0 && std::chrono::steady_clock::now() < give_up)
+    {
+        emulator.run(100'000);
+    }
+    host.join();
+
+    emulator.run(100'000);
+    REQUIRE((int)emulator.mem.readByte(0x0301) == 1);
+    REQUIRE((int)emulator.mem.readByte(0x0300) == 0);
+    REQUIRE(emulator.interrupts.pending() == 0);
+}
+
+TEST_CASE("Batch runs take interrupts raised by another thread")
+{
+    Emulator::testing = true;
+    Emulator emulator;
+    prepare(emulator, false);
+    emulator.interrupt_poll_cycles = 1000;
+    emulator.runInstructions(1); // SEI, nothing left for the first look at the lines to find
+
+    // raised once the batch below is under way, and long before it runs out
+    std::atomic<bool> started = false;
+    std::thread host([&]
+    {
+        while (!started.load())
+        {
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        emulator.interrupts.nmi();
+    });
+    started = true;
+    REQUIRE(emulator.runFor(20'000'000) == StopReason::CYCLE_BUDGET);
+    host.join();
+
+    REQUIRE((int)emulator.mem.readByte(0x0301) == 1);
+    REQUIRE(emulator.interrupts.pending() == 0);
+}
@@ -0,0 +1,164 @@
+#include "catch2/catch_all.hpp"
+#include "mos6502.h"
+#include <cstring>
+#include <random>
+#include <vector>
+
+struct Opcode
+{
+    Byte code;
+    AddressMode mode;
+};
+
+// everything that can run straight through: no jumps, subroutines or interrupts
+static std::vector<Opcode> straightLineOpcodes()
+{
+    std::vector<Opcode> opcodes;
+#define X(code, op, mode)                                                 \
+    if (!ops::ENDS_BLOCK[code] || AddressMode::mode == AddressMode::RELATIVE) \
+    {                                                                     \
+        opcodes.push_back({code, AddressMode::mode});                     \
+    }
+    OFFICIAL_OPCODES(X)
+#undef X
+    return opcodes;
+}
+
+/*
+ * A random program that always terminates: branches only skip forward over whole instructions
+ * and direct writes stay below $0800, so the code can't be modified.
+ */
+static std::vector<Byte> randomProgram(std::mt19937 &rng, std::size_t length)
+{
+    static const std::vector<Opcode> opcodes = straightLineOpcodes();
+    Emulator decoder;
+
+    std::vector<std::vector<Byte>> instructions;
+    for (std::size_t i = 0; i < length; ++i)
+    {
+        Opcode opcode = opcodes[rng() % opcodes.size()];
+        if (opcode.code == 0x81 || opcode.code == 0x91) // STA through a pointer could hit the code
+        {
+            opcode = {0xEA, AddressMode::IMPLICIT};
+        }
+
+        Word operand = rng();
+        if (opcode.mode == AddressMode::ABSOLUTE)
+        {
+            operand &= 0x07FF;
+        }
+        else if (opcode.mode == AddressMode::ABSOLUTE_AND_X || opcode.mode == AddressMode::ABSOLUTE_AND_Y)
+        {
+            operand &= 0x06FF;
+        }
+
+        std::vector<Byte> bytes = {opcode.code, Byte(operand), Byte(operand >> 8)};
+        bytes.resize(decoder.instruction_map[opcode.code].args_count);
+        instructions.push_back(bytes);
+    }
+
+    std::vector<Byte> program;
+    for (std::size_t i = 0; i < instructions.size(); ++i)
+    {
+        if (decoder.instruction_map[instructions[i][0]].addressing_mode == AddressMode::RELATIVE)
+        {
+            std::size_t skipped = rng() % 4;
+            Byte offset = 0;
+            for (std::size_t j = i + 1; j < instructions.size() && j <= i + skipped; ++j)
+            {
+                offset += instructions[j].size();
+            }
+            instructions[i][1] = offset;
+        }
+        program.insert(program.end(), instructions[i].begin(), instructions[i].end());
+    }
+    program.push_back(0x02); // DONE
+    return program;
+}
+
+static void setUp(Emulator &emulator, std::mt19937 &rng, const std::vector<Byte> &program)
+{
+    // the rest of RAM is compared too, so it can't keep whatever an earlier test left there
+    std::memset(emulator.mem.memory, 0, Memory::ROM_START);
+    for (std::size_t address = 0; address < 0x0800; ++address)
+    {
+        emulator.mem.memory[address] = rng();
+    }
+    emulator.cpu.accumulator = rng();
+    emulator.cpu.X = rng();
+    emulator.cpu.Y = rng();
+    emulator.cpu.S = rng();
+    emulator.cpu.setP(rng() | MOS_6502::P_UNUSED);
+    emulator.loadROM(program);
+}
+
+TEST_CASE("JIT matches the interpreter on random programs")
+{
+    Emulator::testing = true;
+    for (unsigned seed = 0; seed < 300; ++seed)
+    {
+        std::mt19937 program_rng(seed);
+        auto program = randomProgram(program_rng, 64);
+
+        Emulator table(Engine::TABLE);
+        Emulator jit(Engine::JIT);
+        jit.jit.hot_threshold = 0;
+
+        std::mt19937 state_rng(seed), same_state_rng(seed);
+        setUp(table, state_rng, program);
+        setUp(jit, same_state_rng, program);
+
+        table.run();
+        jit.run();
+
+        INFO("seed " << seed);
+        REQUIRE(jit.cpu == table.cpu);
+        REQUIRE(jit.cycles == table.cycles);
+        REQUIRE(std::memcmp(jit.mem.memory, table.mem.memory, sizeof(table.mem.memory)) == 0);
+        if (MOS6502_JIT)
+        {
+            REQUIRE(jit.jit.codeSize() > 0);
+        }
+    }
+}
+
+TEST_CASE("JIT translates hot loops and leaves them when they modify themselves")
+{
+    Emulator::testing = true;
+    const std::vector<Byte> program = {
+        0xA2, 0x00,       // 8000: LDX #$00
+        0xA0, 0x20,       // 8002: LDY #$20
+        0x8A,             // 8004: TXA          <- loop
+        0x18,             // 8005: CLC
+        0x79, 0x00, 0x02, // 8006: ADC $0200,Y
+        0x9D, 0x00, 0x03, // 8009: STA $0300,X
+        0xE8,             // 800C: INX
+        0xD0, 0xF5,       // 800D: BNE $8004
+        0xEE, 0x13, 0x80, // 800F: INC $8013    patches the store below
+        0x8D, 0x00, 0x04, // 8012: STA $0400
+        0x88,             // 8015: DEY
+        0xD0, 0xEC,       // 8016: BNE $8004
+        0x02,             // 8018: DONE
+    };
+
+    Emulator table(Engine::TABLE);
+    Emulator jit(Engine::JIT);
+    for (Emulator *emulator : {&table, &jit})
+    {
+        std::memset(emulator->mem.memory, 0, Memory::ROM_START);
+        for (int i = 0; i < 0x40; ++i)
+        {
+            emulator->mem.memory[0x0200 + i] = Byte(i * 3);
+        }
+        emulator->loadROM(program);
+        emulator->run();
+    }
+
+    REQUIRE(jit.cpu == table.cpu);
+    REQUIRE(std::memcmp(jit.mem.memory, table.mem.memory, sizeof(table.mem.memory)) == 0);
+    REQUIRE((int)jit.mem.memory[0x8013] == 0x20);
+    if (MOS6502_JIT)
+    {
+        REQUIRE(jit.jit.codeSize() > 0);
+    }
+}
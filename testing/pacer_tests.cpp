@@ -0,0 +1,68 @@
+#include "catch2/catch_all.hpp"
+#include "mos6502.h"
+#include <chrono>
+#include <vector>
+
+// 2 + 40 * (2 + 256 * 2 + 255 * 3 + 2 + 2 + 3) - 1 = 51,441 cycles
+static const std::vector<Byte> BUSY_LOOP = {
+    0xA0, 0x28, // 8000: LDY #$28
+    0xA2, 0x00, // 8002: LDX #$00  <- outer
+    0xCA,       // 8004: DEX       <- inner
+    0xD0, 0xFD, // 8005: BNE $8004
+    0x88,       // 8007: DEY
+    0xD0, 0xF8, // 8008: BNE $8002
+    0x02,       // 800A: DONE
+};
+
+static double runSeconds(Emulator &emulator)
+{
+    auto start = std::chrono::steady_clock::now();
+    emulator.run();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+TEST_CASE("Paced runs follow the wall clock")
+{
+    auto engine = GENERATE(Engine::TABLE, Engine::THREADED, Engine::BLOCK_CACHE, Engine::JIT);
+    Emulator::testing = false;
+    Emulator emulator(engine);
+    emulator.loadROM(BUSY_LOOP);
+
+    SECTION("paced")
+    {
+        emulator.pacer.clock_hz = 2'000'000; // about 26ms of emulated time
+        double seconds = runSeconds(emulator);
+        Emulator::testing = true;
+
+        REQUIRE(emulator.cycles == 51441);
+        REQUIRE(seconds >= 0.9 * 51441 / 2'000'000);
+        REQUIRE(emulator.pacer.stats().slices >= 20);
+        REQUIRE(emulator.pacer.stats().slept.count() > 0);
+        // only the overshoot of the sleeps is spun, at most pacer.spin per slice
+        REQUIRE(emulator.pacer.stats().spun <= emulator.pacer.stats().slices * emulator.pacer.spin);
+    }
+
+    SECTION("without spinning")
+    {
+        emulator.pacer.clock_hz = 2'000'000;
+        emulator.pacer.spin = Pacer::Duration(0);
+        double seconds = runSeconds(emulator);
+        Emulator::testing = true;
+
+        REQUIRE(emulator.cycles == 51441);
+        REQUIRE(seconds >= 0.9 * 51441 / 2'000'000);
+        REQUIRE(emulator.pacer.stats().spun.count() == 0);
+    }
+
+    SECTION("turbo")
+    {
+        emulator.pacer.clock_hz = 1000; // almost a minute if it were paced
+        emulator.pacer.turbo = true;
+        double seconds = runSeconds(emulator);
+        Emulator::testing = true;
+
+        REQUIRE(emulator.cycles == 51441);
+        REQUIRE(seconds < 5);
+        REQUIRE(emulator.pacer.stats().slept.count() == 0);
+    }
+}
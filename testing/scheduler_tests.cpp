@@ -0,0 +1,117 @@
+#include "catch2/catch_all.hpp"
+#include "mos6502.h"
+#include "scheduler.h"
+#include <vector>
+
+// 2 + 40 * (2 + 256 * 2 + 255 * 3 + 2 + 2 + 3) - 1 = 51,441 cycles
+static const std::vector<Byte> BUSY_LOOP = {
+    0xA0, 0x28, // 8000: LDY #$28
+    0xA2, 0x00, // 8002: LDX #$00  <- outer
+    0xCA,       // 8004: DEX       <- inner
+    0xD0, 0xFD, // 8005: BNE $8004
+    0x88,       // 8007: DEY
+    0xD0, 0xF8, // 8008: BNE $8002
+    0x02,       // 800A: DONE
+};
+
+TEST_CASE("Scheduler runs events in deadline order")
+{
+    std::uint64_t cycles = 100;
+    Scheduler scheduler(cycles);
+    std::vector<int> fired;
+    auto a = scheduler.add([&](std::uint64_t) { fired.push_back(0); });
+    auto b = scheduler.add([&](std::uint64_t) { fired.push_back(1); });
+    auto c = scheduler.add([&](std::uint64_t) { fired.push_back(2); });
+    auto d = scheduler.add([&](std::uint64_t) { fired.push_back(3); });
+
+    scheduler.scheduleAt(c, 300);
+    scheduler.scheduleIn(a, 200); // 300 as well, a was added first
+    scheduler.scheduleAt(b, 150);
+    scheduler.scheduleAt(d, 120);
+    REQUIRE(scheduler.next() == 120);
+
+    scheduler.scheduleAt(d, 400); // moved back
+    scheduler.cancel(b);
+    REQUIRE_FALSE(scheduler.pending(b));
+    REQUIRE(scheduler.next() == 300);
+
+    scheduler.dispatch(299);
+    REQUIRE(fired.empty());
+    scheduler.dispatch(1000);
+    REQUIRE(fired == std::vector<int>{0, 2, 3});
+    REQUIRE(scheduler.next() == Scheduler::NEVER);
+    REQUIRE(scheduler.dispatched == 3);
+}
+
+TEST_CASE("Callbacks can add events while they run")
+{
+    std::uint64_t cycles = 0;
+    Scheduler scheduler(cycles);
+    std::vector<Scheduler::Event> added;
+    int fired = 0;
+    auto first = scheduler.add([&](std::uint64_t)
+    {
+        for (int i = 0; i < 100; ++i) // enough to move every entry
+        {
+            added.push_back(scheduler.add([&](std::uint64_t) { fired++; }));
+            scheduler.scheduleAt(added.back(), 20);
+        }
+        fired++;
+    });
+    scheduler.scheduleAt(first, 10);
+
+    scheduler.dispatch(10);
+    REQUIRE(fired == 1);
+    scheduler.dispatch(20);
+    REQUIRE(fired == 101);
+
+    // the first callback survived the move and runs again, along with the events it adds
+    scheduler.scheduleAt(first, 30);
+    scheduler.dispatch(30);
+    REQUIRE(fired == 202);
+    REQUIRE(added.size() == 200);
+}
+
+TEST_CASE("Periodic events run on every engine")
+{
+    Emulator::testing = true;
+    for (Engine engine : {Engine::TABLE, Engine::THREADED, Engine::BLOCK_CACHE, Engine::JIT})
+    {
+        Emulator emulator(engine);
+        emulator.jit.hot_threshold = 0;
+        emulator.loadROM(BUSY_LOOP);
+
+        std::uint64_t fired = 0;
+        std::uint64_t latest = 0; // cycles after the deadline
+        Scheduler::Event timer = 0;
+        timer = emulator.scheduler.add([&](std::uint64_t deadline)
+        {
+            REQUIRE(emulator.cycles >= deadline);
+            latest = std::max(latest, emulator.cycles - deadline);
+            fired++;
+            emulator.scheduler.scheduleAt(timer, deadline + 1000);
+        });
+        emulator.scheduler.scheduleIn(timer, 1000);
+
+        REQUIRE_FALSE(emulator.run());
+        REQUIRE(emulator.cycles == 51441);
+        REQUIRE(fired == 51);
+        REQUIRE(latest < 16); // the blocks of the loop are two instructions long
+        REQUIRE(emulator.scheduler.deadline(timer) == 52000);
+    }
+}
+
+TEST_CASE("Batch execution runs due events")
+{
+    Emulator::testing = true;
+    Emulator emulator;
+    emulator.loadROM(BUSY_LOOP);
+
+    // cuts the inner loop short by clearing X from the outside
+    auto event = emulator.scheduler.add([&](std::uint64_t) { emulator.cpu.X = 1; });
+    emulator.scheduler.scheduleAt(event, 100);
+
+    REQUIRE(emulator.runFor(200) == StopReason::CYCLE_BUDGET);
+    REQUIRE(emulator.scheduler.dispatched == 1);
+    REQUIRE((int)emulator.cpu.Y == 0x27); // into the second outer iteration
+}
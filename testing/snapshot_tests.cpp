@@ -0,0 +1,132 @@
+#include "catch2/catch_all.hpp"
+#include "mos6502.h"
+#include "mapper.h"
+#include "save_state.h"
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+// counts $0300 up from its current value, one store per call of the loop
+static const std::vector<Byte> COUNTER = {
+    0xA2, 0x10,       // 8000: LDX #$10
+    0xEE, 0x00, 0x03, // 8002: INC $0300    <- loop
+    0xCA,             // 8005: DEX
+    0xD0, 0xFA,       // 8006: BNE $8002
+    0x02,             // 8008: DONE
+};
+
+TEST_CASE("Snapshots restore registers, cycles and memory")
+{
+    Emulator::testing = true;
+    Emulator emulator;
+    emulator.loadROM(COUNTER);
+    emulator.mem.writeByte(0x0300, 0);
+    emulator.runInstructions(4);
+
+    Snapshot snapshot = emulator.snapshot();
+    REQUIRE((int)emulator.mem.readByte(0x0300) == 1);
+
+    emulator.run();
+    REQUIRE((int)emulator.mem.readByte(0x0300) == 0x10);
+
+    emulator.restore(snapshot);
+    REQUIRE(emulator.cpu == snapshot.cpu);
+    REQUIRE(emulator.cycles == snapshot.cycles);
+    REQUIRE((int)emulator.mem.readByte(0x0300) == 1);
+
+    // running on from the snapshot gets to the same place again
+    emulator.run();
+    REQUIRE((int)emulator.mem.readByte(0x0300) == 0x10);
+
+    // only written pages are copied, the rest is shared with the last snapshot
+    Snapshot next = emulator.snapshot();
+    REQUIRE(next.pages[0x03] != snapshot.pages[0x03]);
+    REQUIRE(next.pages[0x80] == snapshot.pages[0x80]);
+}
+
+TEST_CASE("Forked machines share pages until they write them")
+{
+    Emulator::testing = true;
+    for (Engine engine : {Engine::TABLE, Engine::THREADED, Engine::BLOCK_CACHE, Engine::JIT})
+    {
+        Emulator parent(engine);
+        parent.jit.hot_threshold = 0;
+        parent.loadROM(COUNTER);
+        parent.mem.writeByte(0x0300, 0);
+        parent.runInstructions(4);
+
+        auto child = parent.fork();
+        REQUIRE(child->cpu == parent.cpu);
+        REQUIRE(child->mem.copy_on_write[0x03]);
+        REQUIRE(child->mem.read_pages[0x03] == parent.mem.shared_pages[0x03]->data());
+
+        child->run();
+        REQUIRE((int)child->mem.readByte(0x0300) == 0x10);
+        REQUIRE_FALSE(child->mem.copy_on_write[0x03]);
+        REQUIRE(child->mem.copy_on_write[0x04]); // never written, still shared
+
+        // the parent never sees the child's writes
+        REQUIRE((int)parent.mem.readByte(0x0300) == 1);
+        REQUIRE((int)parent.mem.shared_pages[0x03]->at(0) == 1);
+        parent.run();
+        REQUIRE((int)parent.mem.readByte(0x0300) == 0x10);
+        REQUIRE(parent.cycles == child->cycles);
+    }
+}
+
+TEST_CASE("Save states round trip through a file")
+{
+    Emulator::testing = true;
+    std::vector<Byte> image(4 * 0x1000);
+    for (std::size_t i = 0; i < image.size(); ++i)
+    {
+        image[i] = Byte(i >> 12);
+    }
+    std::string path = (std::filesystem::temp_directory_path() / "mos6502_save_state_test.bin").string();
+
+    Emulator saved;
+    LatchMapper saved_mapper(saved.mem, image.data(), image.size());
+    saved_mapper.addWindow(0xC0, 0x10);
+    saved_mapper.mapRegisters(0xC000, 0xCFFF);
+    saved.loadROM(COUNTER);
+    saved.mem.writeByte(0x0300, 0);
+    for (int i = 0; i < 0x100; ++i)
+    {
+        saved.mem.writeByte(Word(0x0400 + i), Byte(i * 7)); // doesn't compress
+    }
+    saved.runInstructions(4);
+    saved.mem.writeByte(0xC000, 2);
+    REQUIRE(SaveState::write(saved, path));
+
+    Emulator loaded;
+    LatchMapper loaded_mapper(loaded.mem, image.data(), image.size());
+    loaded_mapper.addWindow(0xC0, 0x10);
+    loaded_mapper.mapRegisters(0xC000, 0xCFFF);
+
+    SaveState state;
+    REQUIRE(state.open(path));
+    REQUIRE(state.restore(loaded));
+    REQUIRE(loaded.cpu == saved.cpu);
+    REQUIRE(loaded.cycles == saved.cycles);
+    REQUIRE(loaded_mapper.bank(0) == 2);
+    REQUIRE((int)loaded.mem.readByte(0xC123) == 2);
+    for (int i = 0; i < 0x100; ++i)
+    {
+        REQUIRE(loaded.mem.readByte(Word(0x0400 + i)) == Byte(i * 7));
+    }
+
+    // stored raw, the machine reads it straight out of the mapped file
+    REQUIRE(loaded.mem.copy_on_write[0x04]);
+    REQUIRE(loaded.mem.read_pages[0x04] == state.snapshot().pages[0x04]->data());
+
+    saved.run();
+    loaded.run();
+    REQUIRE(loaded.cpu == saved.cpu);
+    REQUIRE(loaded.cycles == saved.cycles);
+    REQUIRE((int)loaded.mem.readByte(0x0300) == 0x10);
+
+    // anything else is turned away
+    std::ofstream(path, std::ios_base::binary | std::ios_base::trunc) << "M65S garbage";
+    REQUIRE_FALSE(state.open(path));
+    std::filesystem::remove(path);
+}
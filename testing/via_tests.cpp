@@ -0,0 +1,140 @@
+#include "catch2/catch_all.hpp"
+#include "mos6502.h"
+#include "via.h"
+#include <vector>
+
+constexpr Word VIA = 0x6000;
+
+TEST_CASE("VIA timers count down from the cycle counter")
+{
+    Emulator::testing = true;
+    Emulator emulator;
+    Via via(emulator);
+    emulator.mem.mapDevice(VIA >> 8, 1, via);
+
+    SECTION("T1 one-shot")
+    {
+        emulator.mem.writeByte(VIA + Via::T1C_L, 100);
+        emulator.mem.writeByte(VIA + Via::T1C_H, 0);
+        emulator.cycles += 50;
+        REQUIRE((int)emulator.mem.readByte(VIA + Via::T1C_L) == 50);
+        REQUIRE((int)emulator.mem.readByte(VIA + Via::T1C_H) == 0);
+
+        emulator.cycles += 52; // past 0 and through $FFFF
+        REQUIRE(emulator.mem.readByte(VIA + Via::IFR) == Via::IRQ_T1);
+        REQUIRE((int)emulator.mem.readByte(VIA + Via::T1C_L) == 100); // reloaded, the read clears the flag
+        REQUIRE(emulator.mem.readByte(VIA + Via::IFR) == 0);
+
+        emulator.cycles += 1000; // one-shot, it doesn't come back
+        REQUIRE(emulator.mem.readByte(VIA + Via::IFR) == 0);
+        REQUIRE(emulator.scheduler.next() == Scheduler::NEVER); // never enabled, never scheduled
+    }
+
+    SECTION("T2 and the shift register")
+    {
+        emulator.mem.writeByte(VIA + Via::T2C_L, 0x10);
+        emulator.mem.writeByte(VIA + Via::T2C_H, 0x00);
+        emulator.mem.writeByte(VIA + Via::ACR, 0x08); // shift in under phi2
+        emulator.mem.writeByte(VIA + Via::SR, 0x00);
+
+        emulator.cycles += 16;
+        REQUIRE(emulator.mem.readByte(VIA + Via::IFR) == Via::IRQ_SR);
+        emulator.cycles += 1;
+        REQUIRE(emulator.mem.readByte(VIA + Via::IFR) == (Via::IRQ_SR | Via::IRQ_T2));
+        REQUIRE((int)emulator.mem.readByte(VIA + Via::SR) == 0xFF);
+        REQUIRE((int)emulator.mem.readByte(VIA + Via::T2C_L) == 0xFF); // counting on through $FFFF
+        REQUIRE(emulator.mem.readByte(VIA + Via::IFR) == 0);
+    }
+
+    SECTION("enabled flags hold IRQ until they are cleared")
+    {
+        emulator.mem.writeByte(VIA + Via::IER, Via::IRQ_ANY | Via::IRQ_T1 | Via::IRQ_CA1);
+        REQUIRE((int)emulator.mem.readByte(VIA + Via::IER) == 0xC2);
+
+        via.ca1();
+        REQUIRE(emulator.interrupts.irq());
+        REQUIRE(emulator.mem.readByte(VIA + Via::IFR) == (Via::IRQ_ANY | Via::IRQ_CA1));
+        emulator.mem.readByte(VIA + Via::ORA);
+        REQUIRE_FALSE(emulator.interrupts.irq());
+
+        emulator.mem.writeByte(VIA + Via::T1C_L, 0x20);
+        emulator.mem.writeByte(VIA + Via::T1C_H, 0x00);
+        REQUIRE(emulator.scheduler.next() == emulator.cycles + 0x21);
+
+        emulator.mem.writeByte(VIA + Via::IER, Via::IRQ_T1); // masked again, the event goes
+        REQUIRE(emulator.scheduler.next() == Scheduler::NEVER);
+    }
+
+    SECTION("ports")
+    {
+        emulator.mem.writeByte(VIA + Via::DDRB, 0xF0);
+        emulator.mem.writeByte(VIA + Via::ORB, 0xA5);
+        via.input_b = 0x0C;
+        REQUIRE((int)emulator.mem.readByte(VIA + Via::ORB) == 0xAC);
+        REQUIRE((int)via.portB() == 0xAC);
+        REQUIRE((int)emulator.mem.readByte(VIA + 0x10 + Via::DDRB) == 0xF0); // mirrored every 16 bytes
+    }
+}
+
+TEST_CASE("VIA state carries over to another machine")
+{
+    Emulator::testing = true;
+    Emulator saved;
+    Via saved_via(saved);
+    saved.mem.mapDevice(VIA >> 8, 1, saved_via);
+    saved.mem.writeByte(VIA + Via::ACR, Via::T1_FREE_RUN);
+    saved.mem.writeByte(VIA + Via::T1C_L, 0x34);
+    saved.mem.writeByte(VIA + Via::T1C_H, 0x12);
+    saved.mem.writeByte(VIA + Via::DDRA, 0x0F);
+    saved.cycles += 0x100;
+
+    std::vector<Byte> state;
+    saved_via.saveState(state);
+
+    Emulator loaded;
+    loaded.cycles = 12345;
+    Via loaded_via(loaded);
+    loaded.mem.mapDevice(VIA >> 8, 1, loaded_via);
+    REQUIRE(loaded_via.loadState(state.data(), state.size()));
+    REQUIRE_FALSE(loaded_via.loadState(state.data(), state.size() - 1));
+
+    for (Word reg = 0; reg < 0x10; ++reg)
+    {
+        if (reg != Via::SR) // reading it starts a shift
+        {
+            REQUIRE(loaded.mem.readByte(VIA + reg) == saved.mem.readByte(VIA + reg));
+        }
+    }
+}
+
+TEST_CASE("VIA T1 interrupts a guest program on every engine")
+{
+    // T1 free-running every 1000 cycles, the handler counts in $0300
+    std::vector<Byte> rom(0x8000, 0xEA);
+    auto put = [&](Word address, std::vector<Byte> bytes) { std::copy(bytes.begin(), bytes.end(), rom.begin() + (address - 0x8000)); };
+    put(0x8000, {
+        0xA9, 0x40, 0x8D, 0x0B, 0x60, // LDA #$40, STA ACR
+        0xA9, 0xC0, 0x8D, 0x0E, 0x60, // LDA #$C0, STA IER
+        0xA9, 0xE6, 0x8D, 0x04, 0x60, // LDA #<998, STA T1C_L
+        0xA9, 0x03, 0x8D, 0x05, 0x60, // LDA #>998, STA T1C_H
+        0x58,                         // CLI
+        0x4C, 0x15, 0x80,             // JMP $8015
+    });
+    put(0x9000, {0xAD, 0x04, 0x60, 0xEE, 0x00, 0x03, 0x40}); // LDA T1C_L, INC $0300, RTI
+    put(0xFFFE, {0x00, 0x90});
+
+    Emulator::testing = true;
+    for (Engine engine : {Engine::TABLE, Engine::THREADED, Engine::BLOCK_CACHE, Engine::JIT})
+    {
+        Emulator emulator(engine);
+        emulator.jit.hot_threshold = 0;
+        Via via(emulator);
+        emulator.mem.mapDevice(VIA >> 8, 1, via);
+        emulator.loadROM(rom);
+        emulator.mem.writeByte(0x0300, 0);
+
+        emulator.run(100'500);
+        REQUIRE((int)emulator.mem.readByte(0x0300) == 100);
+        REQUIRE(emulator.scheduler.dispatched == 100);
+    }
+}